@@ -0,0 +1,290 @@
+#ifndef ALLOCATORS
+#define ALLOCATORS
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <mutex>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <type_traits>
+
+// allocators for the storage of matrix<T, Alloc>, all handing out memory
+// aligned to at least a cache line:
+//   - aligned_allocator goes to the heap every time, like std::allocator, but
+//     aligned so packets and packed gemm panels never straddle cache lines.
+//   - arena_allocator bumps a pointer through an arena. deallocation does
+//     nothing; the memory comes back all at once with arena::reset(), e.g.
+//     after each batch of requests, and is reused from then on. the
+//     library's own temporaries come from arenas that reset themselves once
+//     an evaluation is over (see scratch_pool in matrix.hpp).
+//   - pool_allocator takes buffers from a buffer_pool, which keeps freed
+//     buffers by size and hands them out again for the same size, so a loop
+//     building matrices of the same shapes stops calling malloc after the
+//     first iteration.
+
+namespace detail {
+
+constexpr size_t cache_line = 64;
+
+// over-aligned allocation without C++17 aligned new: the block is padded and
+// the pointer operator new returned is stored right in front of the aligned
+// one
+inline void* aligned_allocate(size_t bytes, size_t align) {
+  if (bytes > SIZE_MAX - align - sizeof(void*))
+    throw std::bad_alloc();
+  void* const raw = ::operator new(bytes + align - 1 + sizeof(void*));
+  uintptr_t const start = reinterpret_cast<uintptr_t>(raw) + sizeof(void*);
+  void** const aligned = reinterpret_cast<void**>(
+    (start + align - 1) & ~(uintptr_t(align) - 1));
+  aligned[-1] = raw;
+  return aligned;
+}
+
+inline void aligned_deallocate(void* p) {
+  if (p)
+    ::operator delete(static_cast<void**>(p)[-1]);
+}
+
+template<typename T>
+size_t allocation_bytes(size_t n) {
+  if (n > SIZE_MAX / sizeof(T))
+    throw std::bad_array_new_length();
+  return n * sizeof(T);
+}
+
+} // namespace detail
+
+template<typename T, size_t Align = detail::cache_line>
+struct aligned_allocator {
+  static_assert(Align >= alignof(T) && (Align & (Align - 1)) == 0,
+                "alignment must be a power of two and at least alignof(T)");
+  using value_type = T;
+
+  template<typename U>
+  struct rebind { using other = aligned_allocator<U, Align>; };
+
+  aligned_allocator() = default;
+  template<typename U>
+  aligned_allocator(aligned_allocator<U, Align> const&) {}
+
+  T* allocate(size_t n) {
+    return static_cast<T*>(
+      detail::aligned_allocate(detail::allocation_bytes<T>(n), Align));
+  }
+
+  void deallocate(T* p, size_t) {
+    detail::aligned_deallocate(p);
+  }
+};
+
+template<typename T, typename U, size_t Align>
+bool operator==(aligned_allocator<T, Align> const&, aligned_allocator<U, Align> const&) {
+  return true;
+}
+
+template<typename T, typename U, size_t Align>
+bool operator!=(aligned_allocator<T, Align> const&, aligned_allocator<U, Align> const&) {
+  return false;
+}
+
+// memory for one thread's temporaries, in blocks that are kept across resets.
+// not thread safe: use one arena per thread, which is what arena::local() is.
+class arena {
+  struct block {
+    char* data;
+    size_t size;
+  };
+
+  std::vector<block> blocks_;
+  size_t current_ = 0;  // block allocations are bumped from
+  size_t used_ = 0;     // bytes taken from it
+  size_t block_size_;
+
+public:
+  explicit arena(size_t block_size = size_t(1) << 20)
+    : block_size_(block_size) {}
+
+  arena(arena const&) = delete;
+  arena& operator=(arena const&) = delete;
+
+  ~arena() {
+    for (block const& b : blocks_)
+      detail::aligned_deallocate(b.data);
+  }
+
+  void* allocate(size_t bytes) {
+    bytes = (bytes + detail::cache_line - 1) & ~(detail::cache_line - 1);
+    for (; current_ < blocks_.size(); current_++, used_ = 0) {
+      if (blocks_[current_].size - used_ >= bytes) {
+        void* const p = blocks_[current_].data + used_;
+        used_ += bytes;
+        return p;
+      }
+    }
+    size_t const size = std::max(block_size_, bytes);
+    blocks_.push_back({static_cast<char*>(
+                         detail::aligned_allocate(size, detail::cache_line)), size});
+    used_ = bytes;
+    return blocks_.back().data;
+  }
+
+  // everything allocated so far becomes free again at once. whatever still
+  // points into the arena, matrices included, must not be used afterwards.
+  void reset() {
+    current_ = 0;
+    used_ = 0;
+  }
+
+  // bytes held in blocks, used or not
+  size_t capacity() const {
+    size_t total = 0;
+    for (block const& b : blocks_)
+      total += b.size;
+    return total;
+  }
+
+  static arena& local() {
+    thread_local arena a;
+    return a;
+  }
+};
+
+// allocates from an arena, by default the calling thread's arena::local().
+// the arena travels with the storage on move and swap, so moving a matrix
+// never copies its elements into another arena.
+template<typename T>
+struct arena_allocator {
+  using value_type = T;
+  using propagate_on_container_move_assignment = std::true_type;
+  using propagate_on_container_swap = std::true_type;
+
+  arena* source;
+
+  arena_allocator() : source(&arena::local()) {}
+  explicit arena_allocator(arena& a) : source(&a) {}
+  template<typename U>
+  arena_allocator(arena_allocator<U> const& other) : source(other.source) {}
+
+  T* allocate(size_t n) {
+    static_assert(alignof(T) <= detail::cache_line, "over-aligned type");
+    return static_cast<T*>(source->allocate(detail::allocation_bytes<T>(n)));
+  }
+
+  void deallocate(T*, size_t) {}
+};
+
+template<typename T, typename U>
+bool operator==(arena_allocator<T> const& lhs, arena_allocator<U> const& rhs) {
+  return lhs.source == rhs.source;
+}
+
+template<typename T, typename U>
+bool operator!=(arena_allocator<T> const& lhs, arena_allocator<U> const& rhs) {
+  return lhs.source != rhs.source;
+}
+
+// freed buffers, kept by size up to max_cached bytes in total. thread safe,
+// so storage may be freed on another thread than the one that allocated it.
+class buffer_pool {
+  std::mutex mutex_;
+  std::unordered_map<size_t, std::vector<void*> > free_;
+  size_t cached_ = 0;
+  size_t max_cached_;
+
+public:
+  explicit buffer_pool(size_t max_cached = size_t(1) << 30)
+    : max_cached_(max_cached) {}
+
+  buffer_pool(buffer_pool const&) = delete;
+  buffer_pool& operator=(buffer_pool const&) = delete;
+
+  ~buffer_pool() {
+    trim();
+  }
+
+  void* allocate(size_t bytes) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto it = free_.find(bytes);
+      if (it != free_.end() && !it->second.empty()) {
+        void* const p = it->second.back();
+        it->second.pop_back();
+        cached_ -= bytes;
+        return p;
+      }
+    }
+    return detail::aligned_allocate(bytes, detail::cache_line);
+  }
+
+  void deallocate(void* p, size_t bytes) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (cached_ + bytes <= max_cached_) {
+        free_[bytes].push_back(p);
+        cached_ += bytes;
+        return;
+      }
+    }
+    detail::aligned_deallocate(p);
+  }
+
+  // gives every cached buffer back to the heap
+  void trim() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& size : free_)
+      for (void* p : size.second)
+        detail::aligned_deallocate(p);
+    free_.clear();
+    cached_ = 0;
+  }
+
+  size_t cached_bytes() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return cached_;
+  }
+
+  // never destroyed, so matrices with static storage can still give their
+  // buffers back during exit
+  static buffer_pool& shared() {
+    static buffer_pool* pool = new buffer_pool;
+    return *pool;
+  }
+};
+
+// allocates from a buffer_pool, by default buffer_pool::shared()
+template<typename T>
+struct pool_allocator {
+  using value_type = T;
+  using propagate_on_container_move_assignment = std::true_type;
+  using propagate_on_container_swap = std::true_type;
+
+  buffer_pool* source;
+
+  pool_allocator() : source(&buffer_pool::shared()) {}
+  explicit pool_allocator(buffer_pool& pool) : source(&pool) {}
+  template<typename U>
+  pool_allocator(pool_allocator<U> const& other) : source(other.source) {}
+
+  T* allocate(size_t n) {
+    static_assert(alignof(T) <= detail::cache_line, "over-aligned type");
+    return static_cast<T*>(source->allocate(detail::allocation_bytes<T>(n)));
+  }
+
+  void deallocate(T* p, size_t n) {
+    source->deallocate(p, n * sizeof(T));
+  }
+};
+
+template<typename T, typename U>
+bool operator==(pool_allocator<T> const& lhs, pool_allocator<U> const& rhs) {
+  return lhs.source == rhs.source;
+}
+
+template<typename T, typename U>
+bool operator!=(pool_allocator<T> const& lhs, pool_allocator<U> const& rhs) {
+  return lhs.source != rhs.source;
+}
+
+#endif
@@ -0,0 +1,239 @@
+#ifndef ASSEMBLY
+#define ASSEMBLY
+
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <cassert>
+#include "sparse.hpp"
+
+// assembly of sparse matrices from (row, col, value) triplets in any order,
+// duplicates summed, as finite element and graph codes produce them.
+//
+// triplets are first bucketed by row, a radix pass on the high bits of the
+// row index: chunks of the input are counted into buckets in parallel and
+// scattered stably into place. every row then lives in a single bucket, so
+// the buckets are finished independently, in parallel: sorted by column
+// within each row and merged into csr arrays, or added straight into a
+// dense matrix.
+//
+// the sorting only depends on where the triplets go. assembly_pattern keeps
+// its outcome, the slot of every triplet in the csr arrays, so assembling
+// new values for the same structure (the next time step, the next Newton
+// iteration) is a single pass adding each value into its slot.
+
+template<typename T>
+struct triplet {
+  size_t row;
+  size_t col;
+  T value;
+};
+
+namespace detail {
+
+// indices of triplets grouped by row >> shift: bucket b is [start[b],
+// start[b + 1]) of order, in input order within the bucket
+struct row_buckets {
+  size_t shift = 0;
+  std::vector<size_t> start;
+  std::vector<size_t> order;
+};
+
+// buckets of at most 4096 rows: enough of them to spread over threads,
+// few enough that every chunk of input keeps a histogram of them
+constexpr size_t max_row_buckets = 4096;
+
+template<typename T>
+row_buckets bucket_by_row(size_t rows, std::vector<triplet<T> > const& triplets) {
+  row_buckets b;
+  while (((std::max<size_t>(rows, 1) - 1) >> b.shift) >= max_row_buckets)
+    b.shift++;
+  size_t const buckets = ((std::max<size_t>(rows, 1) - 1) >> b.shift) + 1;
+  size_t const n = triplets.size();
+  size_t const chunks = n < parallel_eval_threshold() ? 1 :
+    std::min<size_t>(4 * default_thread_pool_ptr()->size(), n / 4096 + 1);
+
+  // count[c * buckets + k]: triplets of chunk c in bucket k, then where
+  // chunk c starts writing bucket k
+  std::vector<size_t> count(chunks * buckets);
+  auto chunk = [n, chunks](size_t c) { return n / chunks * c + std::min(c, n % chunks); };
+  for_each_row_range(chunks, n / chunks + 1, [&](size_t first, size_t last) {
+    for (size_t c = first; c < last; c++)
+      for (size_t t = chunk(c); t < chunk(c + 1); t++) {
+        assert(triplets[t].row < rows);
+        count[c * buckets + (triplets[t].row >> b.shift)]++;
+      }
+  });
+
+  b.start.resize(buckets + 1);
+  size_t offset = 0;
+  for (size_t k = 0; k < buckets; k++) {
+    b.start[k] = offset;
+    for (size_t c = 0; c < chunks; c++) {
+      size_t const size = count[c * buckets + k];
+      count[c * buckets + k] = offset;
+      offset += size;
+    }
+  }
+  b.start[buckets] = offset;
+
+  b.order.resize(n);
+  for_each_row_range(chunks, n / chunks + 1, [&](size_t first, size_t last) {
+    for (size_t c = first; c < last; c++)
+      for (size_t t = chunk(c); t < chunk(c + 1); t++)
+        b.order[count[c * buckets + (triplets[t].row >> b.shift)]++] = t;
+  });
+  return b;
+}
+
+// runs f(bucket) for every bucket, in parallel
+template<typename F>
+void for_each_bucket(row_buckets const& b, F const& f) {
+  size_t const buckets = b.start.size() - 1;
+  for_each_row_range(buckets, b.order.size() / buckets + 1,
+                     [&f](size_t first, size_t last) {
+    for (size_t k = first; k < last; k++)
+      f(k);
+  });
+}
+
+} // namespace detail
+
+// the csr structure of a set of triplets, and the slot each of them is
+// summed into
+class assembly_pattern {
+  size_t rows_ = 0;
+  size_t cols_ = 0;
+  std::vector<size_t> row_ptr_;
+  std::vector<size_t> col_idx_;
+  detail::row_buckets buckets_;
+  // slot_[i]: where triplet buckets_.order[i] goes in the values
+  std::vector<size_t> slot_;
+
+public:
+  assembly_pattern() = default;
+
+  template<typename T>
+  assembly_pattern(size_t rows, size_t cols, std::vector<triplet<T> > const& triplets)
+    : rows_(rows), cols_(cols), row_ptr_(rows + 1),
+      buckets_(detail::bucket_by_row(rows, triplets)), slot_(triplets.size()) {
+    std::vector<size_t>& order = buckets_.order;
+    auto const same = [&triplets](size_t a, size_t b) {
+      return triplets[a].row == triplets[b].row && triplets[a].col == triplets[b].col;
+    };
+
+    // sorts each bucket by row with a counting sort, then each row by
+    // column, duplicates in input order so they are always summed in the
+    // same order, and counts distinct entries
+    detail::for_each_bucket(buckets_, [&](size_t k) {
+      static thread_local std::vector<size_t> count;
+      static thread_local std::vector<std::pair<size_t, size_t> > entries;
+      size_t const first_row = k << buckets_.shift;
+      size_t const last_row = std::min((k + 1) << buckets_.shift, rows);
+      size_t const first = buckets_.start[k], last = buckets_.start[k + 1];
+      count.assign(last_row - first_row + 1, 0);
+      for (size_t i = first; i < last; i++)
+        count[triplets[order[i]].row - first_row + 1]++;
+      std::partial_sum(count.begin(), count.end(), count.begin());
+      entries.resize(last - first);
+      for (size_t i = first; i < last; i++) {
+        triplet<T> const& t = triplets[order[i]];
+        assert(t.col < cols);
+        entries[count[t.row - first_row]++] = {t.col, order[i]};
+      }
+      // count[r] is now where row r + 1 starts
+      for (size_t r = first_row, begin = 0; r < last_row; r++) {
+        size_t const end = count[r - first_row];
+        std::sort(entries.begin() + begin, entries.begin() + end);
+        for (size_t j = begin; j < end; j++)
+          if (j == begin || entries[j].first != entries[j - 1].first)
+            row_ptr_[r + 1]++;
+        begin = end;
+      }
+      for (size_t i = first; i < last; i++)
+        order[i] = entries[i - first].second;
+    });
+    std::partial_sum(row_ptr_.begin(), row_ptr_.end(), row_ptr_.begin());
+    col_idx_.resize(row_ptr_.back());
+
+    detail::for_each_bucket(buckets_, [&](size_t k) {
+      size_t slot = 0;
+      for (size_t i = buckets_.start[k]; i < buckets_.start[k + 1]; i++) {
+        triplet<T> const& t = triplets[order[i]];
+        if (i == buckets_.start[k] || triplets[order[i - 1]].row != t.row)
+          slot = row_ptr_[t.row];
+        else if (same(order[i - 1], order[i]))
+          slot--;
+        col_idx_[slot] = t.col;
+        slot_[i] = slot++;
+      }
+    });
+  }
+
+  size_t num_rows() const {
+    return rows_;
+  }
+
+  size_t num_cols() const {
+    return cols_;
+  }
+
+  // distinct (row, col) pairs
+  size_t nonzeros() const {
+    return col_idx_.size();
+  }
+
+  // the matrix of triplets with the same positions, in the same order, as
+  // those the pattern was built from; only their values are read
+  template<typename T>
+  csr_matrix<T> assemble(std::vector<triplet<T> > const& triplets) const {
+    csr_matrix<T> result(rows_, cols_, row_ptr_, col_idx_, std::vector<T>(nonzeros()));
+    assemble(triplets, result);
+    return result;
+  }
+
+  // same, into the values of dst, a matrix assembled from this pattern
+  // before
+  template<typename T>
+  void assemble(std::vector<triplet<T> > const& triplets, csr_matrix<T>& dst) const {
+    assert(triplets.size() == slot_.size());
+    assert(dst.num_rows() == rows_ && dst.nonzeros() == nonzeros());
+    std::vector<T>& values = dst.values();
+    detail::for_each_bucket(buckets_, [&](size_t k) {
+      size_t const first_row = k << buckets_.shift;
+      size_t const last_row = std::min((k + 1) << buckets_.shift, rows_);
+      std::fill(values.begin() + row_ptr_[first_row],
+                values.begin() + row_ptr_[last_row], T());
+      for (size_t i = buckets_.start[k]; i < buckets_.start[k + 1]; i++) {
+        triplet<T> const& t = triplets[buckets_.order[i]];
+        assert(col_idx_[slot_[i]] == t.col);
+        values[slot_[i]] += t.value;
+      }
+    });
+  }
+};
+
+template<typename T>
+csr_matrix<T> assemble_csr(size_t rows, size_t cols,
+                           std::vector<triplet<T> > const& triplets) {
+  return assembly_pattern(rows, cols, triplets).assemble(triplets);
+}
+
+// straight into dense storage: the buckets only keep threads off each
+// other's rows, nothing is sorted
+template<typename T, typename Alloc = std::allocator<T>, typename Layout = row_major>
+matrix<T, Alloc, Layout> assemble_dense(size_t rows, size_t cols,
+                                        std::vector<triplet<T> > const& triplets) {
+  std::vector<T, Alloc> data(Layout::size(rows, cols));
+  detail::row_buckets const buckets = detail::bucket_by_row(rows, triplets);
+  detail::for_each_bucket(buckets, [&](size_t k) {
+    for (size_t i = buckets.start[k]; i < buckets.start[k + 1]; i++) {
+      triplet<T> const& t = triplets[buckets.order[i]];
+      assert(t.col < cols);
+      data[Layout::index(t.row, t.col, rows, cols)] += t.value;
+    }
+  });
+  return matrix<T, Alloc, Layout>(rows, cols, std::move(data));
+}
+
+#endif
@@ -0,0 +1,509 @@
+#ifndef FIXED
+#define FIXED
+
+#include <array>
+#include <vector>
+#include <cassert>
+#include <type_traits>
+#include "matrix.hpp"
+
+// matrices whose size is part of their type, for the small transforms (3 x 3,
+// 4 x 4, 6 x 6) that are applied over and over.
+//
+// fixed_matrix<T, R, C> keeps its elements inline, row by row, in an
+// array: no allocation, and copies are plain stores. its size is
+// known to the expression nodes above it (see matrix_expr::static_rows), so
+// adding or multiplying operands of the wrong size doesn't compile, and
+// every loop the evaluator runs over it has constant bounds, which the
+// compiler unrolls and vectorizes:
+//   element-wise   a fixed number of packets and a fixed tail
+//   a * b          rows of b scaled by each element of a row of a and
+//                  summed, over registers. nested product operands are
+//                  evaluated first into fixed temporaries.
+//   (a * b) + c    products of fixed operands inside larger expressions are
+//                  never materialized; each element is a dot product of
+//                  fixed length, computed where it is read.
+// fixed_matrix takes part in expressions with matrix<T> like any other
+// operand. a product of a fixed and a dynamic matrix goes through gemm,
+// which reads the fixed one in place.
+//
+// either dimension may also be dynamic_extent, for operands with one fixed
+// dimension: an N x 4 point cloud is fixed_matrix<float, dynamic_extent, 4>,
+// a block of N 16-element features fixed_matrix<float, 16, dynamic_extent>.
+// those keep their elements in an aligned std::vector and are evaluated in
+// parallel above parallel_eval_threshold() like matrix, with the known
+// dimension still a constant in every loop: rows of a fixed width unroll, and
+// products whose inner dimension is fixed go through multiply_narrow (see
+// matrix.hpp) rather than gemm.
+
+template<typename T, size_t R, size_t C>
+class fixed_matrix;
+
+namespace detail {
+
+// inline for fixed sizes, on the heap when one dimension is dynamic
+template<typename T, size_t R, size_t C,
+         bool Fixed = R != dynamic_extent && C != dynamic_extent>
+struct fixed_storage {
+  using type = std::vector<T, aligned_allocator<T> >;
+
+  static void resize(type& elems, size_t size) {
+    elems.resize(size);
+  }
+};
+
+// std::array, but writable in constant expressions: its non-const
+// operator[] and data() are only constexpr from C++17 on
+template<typename T, size_t N>
+struct fixed_array {
+  T elems[N > 0 ? N : 1];
+
+  constexpr fixed_array() : elems() {}
+
+  constexpr fixed_array(std::array<T, N> const& other) : elems() {
+    for (size_t i = 0; i < N; i++)
+      elems[i] = other[i];
+  }
+
+  constexpr size_t size() const {
+    return N;
+  }
+
+  constexpr T* data() {
+    return elems;
+  }
+
+  constexpr T const* data() const {
+    return elems;
+  }
+
+  constexpr T& operator[](size_t i) {
+    return elems[i];
+  }
+
+  constexpr T const& operator[](size_t i) const {
+    return elems[i];
+  }
+};
+
+template<typename T, size_t R, size_t C>
+struct fixed_storage<T, R, C, true> {
+  using type = fixed_array<T, R * C>;
+
+  static constexpr void resize(type&, size_t size) {
+    assert(size == R * C);
+  }
+};
+
+// element updates of assign() and update(). lambdas can't be called in
+// constant expressions before C++17
+struct assign_op {
+  template<typename L, typename V>
+  constexpr V operator()(L, V rhs) const {
+    return rhs;
+  }
+};
+
+struct add_op {
+  template<typename L, typename V>
+  constexpr auto operator()(L lhs, V rhs) const -> decltype(lhs + rhs) {
+    return lhs + rhs;
+  }
+};
+
+struct subtract_op {
+  template<typename L, typename V>
+  constexpr auto operator()(L lhs, V rhs) const -> decltype(lhs - rhs) {
+    return lhs - rhs;
+  }
+};
+
+// an operand of an inline product, read many times over: fixed matrices as
+// they are, anything else evaluated once into one
+template<typename T, size_t R, size_t C>
+constexpr fixed_matrix<T, R, C> const& fixed_operand(fixed_matrix<T, R, C> const& m) {
+  return m;
+}
+
+template<typename E>
+constexpr fixed_matrix<expr_value_t<E>, E::static_rows, E::static_cols>
+fixed_operand(E const& expr) {
+  return expr;
+}
+
+} // namespace detail
+
+template<typename T, size_t R, size_t C>
+class fixed_matrix : public matrix_expr<fixed_matrix<T, R, C> > {
+  static_assert(R != dynamic_extent || C != dynamic_extent,
+                "use matrix<T> when neither dimension is fixed");
+  using matrix_expr<fixed_matrix<T, R, C> >::num_rows_;
+  using matrix_expr<fixed_matrix<T, R, C> >::num_cols_;
+  using storage_traits = detail::fixed_storage<T, R, C>;
+  using storage = typename storage_traits::type;
+  static constexpr bool is_fixed_size = R != dynamic_extent && C != dynamic_extent;
+  storage elems_;
+
+  struct inline_product_tag {};
+
+  // scaled products and their sums (see detail::gemm_expr) are evaluated
+  // element-wise, with the product materialized first: the small products
+  // of fixed operands don't go to gemm anyway
+  template<typename E>
+  using eval_tag = std::conditional_t<
+    is_fixed_size && detail::is_inline_product<E>::value &&
+    std::is_same<expr_value_t<E>, T>::value,
+    inline_product_tag,
+    std::conditional_t<std::is_same<detail::eval_tag<E, T, row_major>, detail::gemm_tag>::value,
+                       detail::elementwise_tag<E, T, row_major>,
+                       detail::eval_tag<E, T, row_major> > >;
+
+  constexpr size_t size() const {
+    return num_rows() * num_cols();
+  }
+
+  constexpr void reshape(size_t rows, size_t cols) {
+    assert(detail::extents_agree(R, rows) && detail::extents_agree(C, cols));
+    num_rows_ = rows;
+    num_cols_ = cols;
+    storage_traits::resize(elems_, rows * cols);
+  }
+
+  // f(first, last) over [0, n) of n rows width elements wide: all at once
+  // for fixed sizes, which are too small to split, over the thread pool like
+  // matrix otherwise
+  template<typename F>
+  void for_each_range(size_t n, size_t width, F const& f) const {
+    if (is_fixed_size)
+      f(size_t(0), n);
+    else
+      detail::for_each_row_range(n, width, f);
+  }
+
+  // constant expressions can't use packets or gemm: inline products are
+  // computed as usual there, anything else element by element
+  template<typename E>
+  constexpr void evaluate(E const& expr) {
+    static_assert(detail::extents_agree(E::static_rows, R) &&
+                  detail::extents_agree(E::static_cols, C),
+                  "assigning an expression of a different size");
+    using tag = eval_tag<E>;
+    if (detail::is_constant_evaluated() && !std::is_same<tag, inline_product_tag>::value)
+      evaluate(expr, detail::element_tag());
+    else
+      evaluate(expr, tag());
+  }
+
+  // the result is computed aside, in registers for small sizes, since the
+  // operands may be this matrix
+  template<typename E>
+  constexpr void evaluate(E const& prod, inline_product_tag) {
+    auto const& a = detail::fixed_operand(prod.lhs());
+    auto const& b = detail::fixed_operand(prod.rhs());
+    constexpr size_t K = std::decay_t<decltype(a)>::static_cols;
+    storage c{};
+#pragma GCC unroll 16
+    for (size_t i = 0; i < R; i++)
+#pragma GCC unroll 16
+      for (size_t k = 0; k < K; k++) {
+        T const aik = a.at(i, k);
+#pragma GCC unroll 16
+        for (size_t j = 0; j < C; j++)
+          c[i * C + j] += aik * b.at(k, j);
+      }
+    elems_ = c;
+  }
+
+  // other products go to gemm, or multiply_narrow for a fixed inner
+  // dimension. fixed sizes are computed aside like inline products, others
+  // only when an operand reads this matrix's storage (c = c * b).
+  template<typename E>
+  void evaluate(E const& prod, detail::product_tag) {
+    T const* const first = elems_.data();
+    T const* const last = first + elems_.size();
+    if (is_fixed_size || detail::shares_storage(prod.lhs(), first, last) ||
+        detail::shares_storage(prod.rhs(), first, last)) {
+      fixed_matrix result(prod.num_rows(), prod.num_cols());
+      detail::multiply_into(result.data(), result.num_cols(), 1, prod.lhs(), prod.rhs());
+      elems_ = std::move(result.elems_);
+      num_rows_ = result.num_rows_;
+      num_cols_ = result.num_cols_;
+      return;
+    }
+    reshape(prod.num_rows(), prod.num_cols());
+    detail::multiply_into(elems_.data(), num_cols(), 1, prod.lhs(), prod.rhs());
+  }
+
+  // views reading this matrix elsewhere than at the element being written
+  // (see detail::overlaps_elsewhere) are evaluated aside. at a fixed size
+  // they can only be this matrix as a whole.
+  template<typename E>
+  constexpr bool reads_elsewhere(E const& expr) const {
+    return !is_fixed_size &&
+      detail::overlaps_elsewhere(expr, detail::dense_operand<T>{
+                                   elems_.data(), num_rows(), num_cols(),
+                                   std::ptrdiff_t(num_cols()), 1}, true);
+  }
+
+  template<typename E, typename Tag>
+  constexpr void evaluate(E const& expr, Tag) {
+    if (reads_elsewhere(expr)) {
+      fixed_matrix result;
+      result.evaluate(expr, Tag());
+      elems_ = std::move(result.elems_);
+      num_rows_ = result.num_rows_;
+      num_cols_ = result.num_cols_;
+      return;
+    }
+    // no detail::prepared here, whose destructor rules it out of constant
+    // expressions
+    expr.prepare();
+    reshape(expr.num_rows(), expr.num_cols());
+    assign(expr, detail::assign_op(), Tag());
+    expr.unprepare();
+  }
+
+  template<typename E, typename Op>
+  constexpr void assign(E const& expr, Op const& op, detail::element_tag) {
+    assign(expr, op, std::integral_constant<bool, is_fixed_size>());
+  }
+
+  // inline products read other elements than the one being written, so at a
+  // fixed size the result is computed aside. they only take fixed size
+  // operands, so never read a matrix with a dynamic dimension.
+  template<typename E, typename Op>
+  constexpr void assign(E const& expr, Op const& op, std::true_type) {
+    storage result{};
+#pragma GCC unroll 16
+    for (size_t i = 0; i < R; i++)
+#pragma GCC unroll 16
+      for (size_t j = 0; j < C; j++)
+        result[i * C + j] = static_cast<T>(op(elems_[i * C + j], expr.at(i, j)));
+    elems_ = result;
+  }
+
+  template<typename E, typename Op>
+  void assign(E const& expr, Op const& op, std::false_type) {
+    size_t const cols = num_cols();
+    for_each_range(num_rows(), cols, [this, &expr, &op, cols](size_t first, size_t last) {
+      T* const dst = elems_.data();
+      for (size_t i = first; i < last; i++)
+#pragma GCC unroll 16
+        for (size_t j = 0; j < cols; j++)
+          dst[i * cols + j] = static_cast<T>(op(dst[i * cols + j], expr.at(i, j)));
+    });
+  }
+
+  template<typename E, typename Op>
+  void assign(E const& expr, Op const& op, detail::linear_tag) {
+    for_each_range(size(), 1, [this, &expr, &op](size_t first, size_t last) {
+      using traits = packet_traits<T>;
+      T* const dst = elems_.data();
+      size_t i = first;
+#pragma GCC unroll 16
+      for (; i + traits::lanes <= last; i += traits::lanes)
+        traits::store(dst + i, op(traits::load(dst + i), expr.packet(i)));
+#pragma GCC unroll 16
+      for (; i < last; i++)
+        dst[i] = op(dst[i], expr.at(i));
+    });
+  }
+
+  // strided linear expressions (views) a row at a time
+  template<typename E, typename Op>
+  void assign(E const& expr, Op const& op, detail::strided_linear_tag) {
+    size_t const rows = num_rows(), cols = num_cols();
+    for_each_range(rows, cols, [this, &expr, &op, rows, cols](size_t first, size_t last) {
+      detail::assign_lines<row_major>(elems_.data(), cols, rows, cols, first, last,
+                                      expr, op, detail::strided_linear_tag());
+    });
+  }
+
+  // anything else that has no flat form (sparse operands, transposes) is
+  // read element by element
+  template<typename E, typename Op, typename Tag>
+  void assign(E const& expr, Op const& op, Tag) {
+    assign(expr, op, detail::element_tag());
+  }
+
+  template<typename E, typename Op>
+  constexpr fixed_matrix& update(matrix_expr<E> const& expr, Op const& op) {
+    E const& derived = static_cast<E const&>(expr);
+    static_assert(detail::extents_agree(E::static_rows, R) &&
+                  detail::extents_agree(E::static_cols, C),
+                  "operands of different sizes");
+    assert(derived.num_rows() == num_rows() && derived.num_cols() == num_cols());
+    if (reads_elsewhere(derived)) {
+      fixed_matrix const copy(derived);
+      return update(copy, op);
+    }
+    derived.prepare();
+    if (detail::is_constant_evaluated())
+      assign(derived, op, detail::element_tag());
+    else
+      assign(derived, op, detail::elementwise_tag<E, T, row_major>());
+    derived.unprepare();
+    return *this;
+  }
+
+public:
+  static constexpr bool is_linear = true;
+  static constexpr bool is_strided_linear = true;
+  using layout = row_major;
+  static constexpr size_t static_rows = R;
+  static constexpr size_t static_cols = C;
+
+  // all zeros. a dynamic dimension starts out empty
+  constexpr fixed_matrix() : elems_() {
+    num_rows_ = R == dynamic_extent ? 0 : R;
+    num_cols_ = C == dynamic_extent ? 0 : C;
+  }
+
+  constexpr fixed_matrix(size_t rows, size_t cols) : elems_() {
+    reshape(rows, cols);
+  }
+
+  // takes over the elements, row by row. the dynamic dimension, if any,
+  // follows from their number
+  constexpr explicit fixed_matrix(storage elems) : elems_(std::move(elems)) {
+    num_rows_ = R == dynamic_extent ? elems_.size() / C : R;
+    num_cols_ = C == dynamic_extent ? elems_.size() / R : C;
+    assert(elems_.size() == num_rows_ * num_cols_);
+  }
+
+  // fixed_matrix<int, 2, 3> m = { {1, 2, 3}, {4, 5, 6} };
+  // at a fixed size, this and the other constructors are constexpr:
+  //   constexpr fixed_matrix<double, 2, 2> flip = { {0, 1}, {1, 0} };
+  //   constexpr fixed_matrix<double, 2, 2> m = flip * flip + flip;
+  // is computed by the compiler and stored with the program's constants.
+  constexpr fixed_matrix(std::initializer_list<std::initializer_list<T> > list) : elems_() {
+    reshape(list.size(), list.size() == 0 ? 0 : list.begin()->size());
+    size_t i = 0;
+    for (auto const& row : list) {
+      assert(row.size() == num_cols());
+      size_t j = 0;
+      for (auto const& elem : row)
+        elems_[i * num_cols() + j++] = elem;
+      i++;
+    }
+  }
+
+  template<typename E>
+  constexpr fixed_matrix(matrix_expr<E> const& expr) : fixed_matrix() {
+    evaluate(static_cast<E const&>(expr));
+  }
+
+  template<typename E>
+  constexpr fixed_matrix& operator=(matrix_expr<E> const& expr) {
+    evaluate(static_cast<E const&>(expr));
+    return *this;
+  }
+
+  constexpr size_t num_rows() const {
+    return R == dynamic_extent ? num_rows_ : R;
+  }
+
+  constexpr size_t num_cols() const {
+    return C == dynamic_extent ? num_cols_ : C;
+  }
+
+  constexpr T at(size_t row, size_t col) const {
+    assert(row < num_rows() && col < num_cols());
+    return elems_[row * num_cols() + col];
+  }
+
+  constexpr T& at(size_t row, size_t col) {
+    assert(row < num_rows() && col < num_cols());
+    return elems_[row * num_cols() + col];
+  }
+
+  constexpr T at(size_t i) const {
+    return elems_[i];
+  }
+
+  packet_t<T> packet(size_t i) const {
+    return packet_traits<T>::load(elems_.data() + i);
+  }
+
+  packet_t<T> packet(size_t row, size_t col) const {
+    return packet_traits<T>::load(elems_.data() + row * num_cols() + col);
+  }
+
+  constexpr T const* data() const {
+    return elems_.data();
+  }
+
+  constexpr T* data() {
+    return elems_.data();
+  }
+
+  template<typename E>
+  constexpr fixed_matrix& operator+=(matrix_expr<E> const& expr) {
+    return update(expr, detail::add_op());
+  }
+
+  template<typename E>
+  constexpr fixed_matrix& operator-=(matrix_expr<E> const& expr) {
+    return update(expr, detail::subtract_op());
+  }
+
+  template<typename S>
+  constexpr typename std::enable_if<detail::is_scalar_operand<S>::value, fixed_matrix&>::type
+  operator*=(S const& scalar) {
+    return update(*this * scalar, detail::assign_op());
+  }
+
+  template<typename E>
+  constexpr fixed_matrix& operator*=(matrix_expr<E> const& expr) {
+    static_assert(detail::extents_agree(E::static_rows, C) &&
+                  detail::extents_agree(E::static_cols, C),
+                  "the product changes the size");
+    return *this = *this * static_cast<E const&>(expr);
+  }
+};
+
+// views of fixed matrices, see view(matrix&)
+template<typename T, size_t R, size_t C>
+matrix_view<T> view(fixed_matrix<T, R, C>& m) {
+  return {m.data(), m.num_rows(), m.num_cols()};
+}
+
+template<typename T, size_t R, size_t C>
+matrix_view<T const> view(fixed_matrix<T, R, C> const& m) {
+  return {m.data(), m.num_rows(), m.num_cols()};
+}
+
+template<typename T, size_t R, size_t C>
+void view(fixed_matrix<T, R, C>&&) = delete;
+
+namespace detail {
+
+template<typename T, size_t R, size_t C>
+dense_operand<T> as_dense(fixed_matrix<T, R, C> const& m, scratch_handle<T>&) {
+  return {m.data(), m.num_rows(), m.num_cols(), std::ptrdiff_t(m.num_cols()), 1};
+}
+
+template<typename T, size_t R, size_t C>
+bool shares_storage(fixed_matrix<T, R, C> const& operand, T const* first, T const* last) {
+  T const* const data = operand.data();
+  return data < last && first < data + operand.num_rows() * operand.num_cols();
+}
+
+template<typename T, size_t R, size_t C>
+bool overlaps_elsewhere(fixed_matrix<T, R, C> const& operand, dense_operand<T> const& dst,
+                        bool in_place) {
+  return overlaps_elsewhere(dense_operand<T>{operand.data(), operand.num_rows(),
+                                             operand.num_cols(),
+                                             std::ptrdiff_t(operand.num_cols()), 1},
+                            dst, in_place);
+}
+
+template<typename T, size_t R, size_t C>
+bool same_elements(fixed_matrix<T, R, C> const& operand, dense_operand<T> const& dst) {
+  scratch_handle<T> none;
+  return same_elements(as_dense(operand, none), dst);
+}
+
+} // namespace detail
+
+#endif
@@ -0,0 +1,218 @@
+#ifndef GEMM
+#define GEMM
+
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+#include "allocators.hpp"
+#include "gemm_kernels.hpp"
+#include "thread_pool.hpp"
+
+// blocked general matrix multiplication: C = alpha * A * B + beta * C
+//
+// follows the structure of GotoBLAS / BLIS. the product is cut into
+//   nc wide panels of B   -- a kc x nc panel is packed and stays in L3,
+//   mc tall blocks of A   -- an mc x kc block is packed and stays in L2,
+//   mr x nr micro-tiles   -- computed by the microkernel out of registers,
+//                            streaming a kc x nr sliver of B from L1.
+// packing copies the operands into contiguous, zero-padded buffers laid out in
+// exactly the order the microkernel reads them, so the inner loop never
+// strides through memory regardless of how A and B are stored.
+//
+// the microkernels themselves, and the choice between them, live in
+// gemm_kernels.hpp.
+//
+// operands are described by a pointer plus a row and column stride, so
+// row-major, column-major and transposed operands all go through the same
+// engine.
+
+template<typename T>
+struct strided_operand {
+  T const* data;
+  std::ptrdiff_t row_stride;
+  std::ptrdiff_t col_stride;
+
+  T operator()(size_t row, size_t col) const {
+    return data[static_cast<std::ptrdiff_t>(row) * row_stride +
+                static_cast<std::ptrdiff_t>(col) * col_stride];
+  }
+};
+
+// cache blocking. kc is chosen so a kc x nr sliver of B fills about half of
+// L1, mc so the packed block of A fills about half of L2, and nc so the packed
+// panel of B stays well inside L3. all of them depend on the micro-tile shape,
+// which is only known once a kernel has been picked at runtime.
+struct gemm_blocking {
+  static constexpr size_t l1 = 32 * 1024;
+  static constexpr size_t l2 = 512 * 1024;
+  static constexpr size_t l3 = 8 * 1024 * 1024;
+  // m * n * k from which a product is spread over the thread pool
+  static constexpr size_t parallel_work = size_t(1) << 21;
+
+  size_t kc;
+  size_t mc;
+  size_t nc;
+
+  template<typename T>
+  static gemm_blocking for_kernel(gemm_kernel<T> const& kern) {
+    size_t const kc = std::min<size_t>(512, std::max<size_t>(
+        64, l1 / 2 / (kern.nr * sizeof(T))));
+    size_t const mc = std::max<size_t>(1, l2 / 2 / (kc * sizeof(T)) / kern.mr) *
+                      kern.mr;
+    size_t const nc = std::max<size_t>(1, l3 / 4 / (kc * sizeof(T)) / kern.nr) *
+                      kern.nr;
+    return {kc, mc, nc};
+  }
+};
+
+namespace detail {
+
+// packs the mc x kc block of A starting at (row0, col0) into slivers of mr
+// rows. each sliver is stored column after column, so the microkernel reads
+// mr consecutive values per step of k. rows past mc are zero-filled.
+template<typename T, typename A>
+void pack_a(T* dst, A const& a, size_t MR, size_t row0, size_t col0,
+            size_t mc, size_t kc) {
+  for (size_t i = 0; i < mc; i += MR) {
+    size_t const rows = std::min(MR, mc - i);
+    for (size_t p = 0; p < kc; p++) {
+      size_t r = 0;
+      for (; r < rows; r++)
+        *dst++ = a(row0 + i + r, col0 + p);
+      for (; r < MR; r++)
+        *dst++ = T();
+    }
+  }
+}
+
+// packs the kc x nc panel of B starting at (row0, col0) into slivers of nr
+// columns, each stored row after row. columns past nc are zero-filled.
+template<typename T, typename B>
+void pack_b(T* dst, B const& b, size_t NR, size_t row0, size_t col0,
+            size_t kc, size_t nc) {
+  for (size_t j = 0; j < nc; j += NR) {
+    size_t const cols = std::min(NR, nc - j);
+    for (size_t p = 0; p < kc; p++) {
+      size_t c = 0;
+      for (; c < cols; c++)
+        *dst++ = b(row0 + p, col0 + j + c);
+      for (; c < NR; c++)
+        *dst++ = T();
+    }
+  }
+}
+
+// packing buffers are kept per thread and reused, so repeated products of
+// similar size do not go back to the allocator. they are cache line aligned,
+// so the microkernel's loads from packed panels never split a line.
+template<typename T>
+T* gemm_buffer(std::vector<T, aligned_allocator<T> >& buf, size_t size) {
+  if (buf.size() < size)
+    buf.resize(size);
+  return buf.data();
+}
+
+} // namespace detail
+
+// C (m x n) = alpha * A (m x k) * B (k x n) + beta * C
+// A and B are any accessors callable as a(row, col); they are only read while
+// packing, so they don't have to be cheap. C is strided.
+template<typename T, typename A, typename B>
+void gemm(size_t m, size_t n, size_t k, T alpha, A const& a, B const& b,
+          T beta, T* c, std::ptrdiff_t rs_c, std::ptrdiff_t cs_c) {
+  if (m == 0 || n == 0)
+    return;
+
+  if (k == 0) { // nothing to multiply, only scale C
+    for (size_t i = 0; i < m; i++)
+      for (size_t j = 0; j < n; j++) {
+        T& dst = c[static_cast<std::ptrdiff_t>(i) * rs_c +
+                   static_cast<std::ptrdiff_t>(j) * cs_c];
+        dst = beta == T() ? T() : beta * dst;
+      }
+    return;
+  }
+
+  gemm_kernel<T> const kern = active_gemm_kernel<T>();
+  gemm_blocking const blk = gemm_blocking::for_kernel(kern);
+  size_t const MR = kern.mr, NR = kern.nr;
+  size_t const KC = blk.kc, NC = blk.nc;
+  size_t MC = blk.mc;
+
+  // the blocks of A are independent, so they are spread over the pool. when
+  // there are fewer blocks than threads they are cut down to keep every thread
+  // busy.
+  std::shared_ptr<thread_pool> pool;
+  if (m * n * k >= gemm_blocking::parallel_work)
+    pool = default_thread_pool_ptr();
+  size_t const threads = pool ? pool->size() : 1;
+  if (threads > 1)
+    MC = std::min(MC, ((m + threads - 1) / threads + MR - 1) / MR * MR);
+
+  static thread_local std::vector<T, aligned_allocator<T> > a_buf, b_buf;
+  T* const b_pack = detail::gemm_buffer(b_buf, (std::min(NC, n) + NR) *
+                                                std::min(KC, k));
+
+  for (size_t jc = 0; jc < n; jc += NC) {
+    size_t const nc = std::min(NC, n - jc);
+
+    for (size_t pc = 0; pc < k; pc += KC) {
+      size_t const kc = std::min(KC, k - pc);
+      // only the first panel along k applies the caller's beta, the rest
+      // accumulate onto it
+      T const beta_pc = pc == 0 ? beta : T(1);
+
+      // packs slivers [first, last) of the panel of B
+      auto pack_slivers = [&](size_t first, size_t last) {
+        size_t const col = first * NR;
+        detail::pack_b(b_pack + col * kc, b, NR, pc, jc + col, kc,
+                       std::min(nc, last * NR) - col);
+      };
+
+      // multiplies blocks [first, last) of A with the packed panel of B.
+      // every thread packs into its own buffer
+      auto multiply_blocks = [&](size_t first, size_t last) {
+        T* const a_pack = detail::gemm_buffer(a_buf, (MC + MR) * kc);
+
+        for (size_t ic = first * MC; ic < std::min(m, last * MC); ic += MC) {
+          size_t const mc = std::min(MC, m - ic);
+
+          detail::pack_a(a_pack, a, MR, ic, pc, mc, kc);
+
+          for (size_t jr = 0; jr < nc; jr += NR) {
+            for (size_t ir = 0; ir < mc; ir += MR) {
+              T* c_tile = c + static_cast<std::ptrdiff_t>(ic + ir) * rs_c +
+                              static_cast<std::ptrdiff_t>(jc + jr) * cs_c;
+              kern.fn(kc, alpha, a_pack + ir * kc, b_pack + jr * kc,
+                      beta_pc, c_tile, rs_c, cs_c,
+                      std::min(MR, mc - ir), std::min(NR, nc - jr));
+            }
+          }
+        }
+      };
+
+      size_t const slivers = (nc + NR - 1) / NR;
+      size_t const blocks = (m + MC - 1) / MC;
+      if (threads > 1) {
+        pool->parallel_for(slivers, (slivers + threads - 1) / threads,
+                           pack_slivers);
+        pool->parallel_for(blocks, 1, multiply_blocks);
+      } else {
+        pack_slivers(0, slivers);
+        multiply_blocks(0, blocks);
+      }
+    }
+  }
+}
+
+// convenience overload for plain strided operands
+template<typename T>
+void gemm(size_t m, size_t n, size_t k, T alpha,
+          T const* a, std::ptrdiff_t rs_a, std::ptrdiff_t cs_a,
+          T const* b, std::ptrdiff_t rs_b, std::ptrdiff_t cs_b,
+          T beta, T* c, std::ptrdiff_t rs_c, std::ptrdiff_t cs_c) {
+  gemm(m, n, k, alpha, strided_operand<T>{a, rs_a, cs_a},
+       strided_operand<T>{b, rs_b, cs_b}, beta, c, rs_c, cs_c);
+}
+
+#endif
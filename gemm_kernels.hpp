@@ -0,0 +1,333 @@
+#ifndef GEMM_KERNELS
+#define GEMM_KERNELS
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+// gemm microkernels and the runtime selection between them.
+//
+// every kernel computes one mr x nr tile of C from packed slivers of A and B
+// (see gemm.hpp for the packing format). the scalar kernel works for any
+// element type. float, double and 32 bit int additionally get hand-vectorized
+// kernels for SSE4.2, AVX2+FMA and AVX-512; all of them are compiled into the
+// same binary and the widest one the host supports is picked with cpuid the
+// first time a product runs.
+
+enum class gemm_isa { scalar, sse42, avx2, avx512 };
+
+template<typename T>
+using gemm_kernel_fn = void (*)(size_t kc, T alpha, T const* a, T const* b,
+                                T beta, T* c, std::ptrdiff_t rs_c,
+                                std::ptrdiff_t cs_c, size_t m, size_t n);
+
+template<typename T>
+struct gemm_kernel {
+  size_t mr;
+  size_t nr;
+  gemm_kernel_fn<T> fn;
+};
+
+namespace detail {
+
+// C (m x n corner) = alpha * AB + beta * C, AB being a computed tile with
+// leading dimension ld. beta == 0 never reads C, so C may be uninitialized.
+template<typename T>
+void gemm_write_back(T const* ab, size_t ld, T alpha, T beta, T* c,
+                     std::ptrdiff_t rs_c, std::ptrdiff_t cs_c,
+                     size_t m, size_t n) {
+  for (size_t i = 0; i < m; i++) {
+    for (size_t j = 0; j < n; j++) {
+      T& dst = c[static_cast<std::ptrdiff_t>(i) * rs_c +
+                 static_cast<std::ptrdiff_t>(j) * cs_c];
+      T const val = alpha * ab[i * ld + j];
+      dst = beta == T() ? val : val + beta * dst;
+    }
+  }
+}
+
+// reference microkernel: accumulates an mr x nr tile in a local array the
+// compiler can keep in registers, then writes back the m x n valid corner.
+template<size_t MR, size_t NR, typename T>
+void gemm_microkernel(size_t kc, T alpha, T const* a, T const* b, T beta,
+                      T* c, std::ptrdiff_t rs_c, std::ptrdiff_t cs_c,
+                      size_t m, size_t n) {
+  T ab[MR * NR] = {};
+
+  for (size_t p = 0; p < kc; p++) {
+    for (size_t i = 0; i < MR; i++)
+      for (size_t j = 0; j < NR; j++)
+        ab[i * NR + j] += a[i] * b[j];
+    a += MR;
+    b += NR;
+  }
+
+  gemm_write_back(ab, NR, alpha, beta, c, rs_c, cs_c, m, n);
+}
+
+} // namespace detail
+
+#if (defined(__GNUC__) || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define MATRIX_X86_KERNELS 1
+#include <immintrin.h>
+
+// functions (and templates) declared between these are compiled for the given
+// instruction set regardless of the -m flags used for the rest of the program
+#if defined(__clang__)
+#define MATRIX_TARGET_BEGIN(isa) \
+  _Pragma("clang attribute push") \
+  _Pragma(isa)
+#define MATRIX_TARGET_END _Pragma("clang attribute pop")
+#define MATRIX_TARGET_SSE42 \
+  "clang attribute (__attribute__((target(\"sse4.2\"))), apply_to = function)"
+#define MATRIX_TARGET_AVX2 \
+  "clang attribute (__attribute__((target(\"avx2,fma\"))), apply_to = function)"
+#define MATRIX_TARGET_AVX512 \
+  "clang attribute (__attribute__((target(\"avx512f\"))), apply_to = function)"
+#else
+#define MATRIX_TARGET_BEGIN(isa) \
+  _Pragma("GCC push_options") \
+  _Pragma(isa)
+#define MATRIX_TARGET_END _Pragma("GCC pop_options")
+#define MATRIX_TARGET_SSE42 "GCC target(\"sse4.2\")"
+#define MATRIX_TARGET_AVX2 "GCC target(\"avx2,fma\")"
+#define MATRIX_TARGET_AVX512 "GCC target(\"avx512f\")"
+#endif
+
+// each instruction set provides vector traits for double (f64), float (f32)
+// and int32 (i32) and then pulls in the shared microkernel template.
+
+MATRIX_TARGET_BEGIN(MATRIX_TARGET_SSE42)
+namespace detail {
+namespace sse42 {
+
+struct f64 {
+  using type = double;
+  using reg = __m128d;
+  static constexpr size_t lanes = 2;
+  static reg zero() { return _mm_setzero_pd(); }
+  static reg set1(type x) { return _mm_set1_pd(x); }
+  static reg load(type const* p) { return _mm_loadu_pd(p); }
+  static void store(type* p, reg x) { _mm_storeu_pd(p, x); }
+  static reg mul(reg a, reg b) { return _mm_mul_pd(a, b); }
+  static reg fmadd(reg a, reg b, reg c) { return _mm_add_pd(_mm_mul_pd(a, b), c); }
+};
+
+struct f32 {
+  using type = float;
+  using reg = __m128;
+  static constexpr size_t lanes = 4;
+  static reg zero() { return _mm_setzero_ps(); }
+  static reg set1(type x) { return _mm_set1_ps(x); }
+  static reg load(type const* p) { return _mm_loadu_ps(p); }
+  static void store(type* p, reg x) { _mm_storeu_ps(p, x); }
+  static reg mul(reg a, reg b) { return _mm_mul_ps(a, b); }
+  static reg fmadd(reg a, reg b, reg c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+};
+
+struct i32 {
+  using type = std::int32_t;
+  using reg = __m128i;
+  static constexpr size_t lanes = 4;
+  static reg zero() { return _mm_setzero_si128(); }
+  static reg set1(type x) { return _mm_set1_epi32(x); }
+  static reg load(type const* p) { return _mm_loadu_si128(reinterpret_cast<reg const*>(p)); }
+  static void store(type* p, reg x) { _mm_storeu_si128(reinterpret_cast<reg*>(p), x); }
+  static reg mul(reg a, reg b) { return _mm_mullo_epi32(a, b); }
+  static reg fmadd(reg a, reg b, reg c) { return _mm_add_epi32(_mm_mullo_epi32(a, b), c); }
+};
+
+#include "gemm_microkernel.inc"
+
+} // namespace sse42
+} // namespace detail
+MATRIX_TARGET_END
+
+MATRIX_TARGET_BEGIN(MATRIX_TARGET_AVX2)
+namespace detail {
+namespace avx2 {
+
+struct f64 {
+  using type = double;
+  using reg = __m256d;
+  static constexpr size_t lanes = 4;
+  static reg zero() { return _mm256_setzero_pd(); }
+  static reg set1(type x) { return _mm256_set1_pd(x); }
+  static reg load(type const* p) { return _mm256_loadu_pd(p); }
+  static void store(type* p, reg x) { _mm256_storeu_pd(p, x); }
+  static reg mul(reg a, reg b) { return _mm256_mul_pd(a, b); }
+  static reg fmadd(reg a, reg b, reg c) { return _mm256_fmadd_pd(a, b, c); }
+};
+
+struct f32 {
+  using type = float;
+  using reg = __m256;
+  static constexpr size_t lanes = 8;
+  static reg zero() { return _mm256_setzero_ps(); }
+  static reg set1(type x) { return _mm256_set1_ps(x); }
+  static reg load(type const* p) { return _mm256_loadu_ps(p); }
+  static void store(type* p, reg x) { _mm256_storeu_ps(p, x); }
+  static reg mul(reg a, reg b) { return _mm256_mul_ps(a, b); }
+  static reg fmadd(reg a, reg b, reg c) { return _mm256_fmadd_ps(a, b, c); }
+};
+
+struct i32 {
+  using type = std::int32_t;
+  using reg = __m256i;
+  static constexpr size_t lanes = 8;
+  static reg zero() { return _mm256_setzero_si256(); }
+  static reg set1(type x) { return _mm256_set1_epi32(x); }
+  static reg load(type const* p) { return _mm256_loadu_si256(reinterpret_cast<reg const*>(p)); }
+  static void store(type* p, reg x) { _mm256_storeu_si256(reinterpret_cast<reg*>(p), x); }
+  static reg mul(reg a, reg b) { return _mm256_mullo_epi32(a, b); }
+  static reg fmadd(reg a, reg b, reg c) { return _mm256_add_epi32(_mm256_mullo_epi32(a, b), c); }
+};
+
+#include "gemm_microkernel.inc"
+
+} // namespace avx2
+} // namespace detail
+MATRIX_TARGET_END
+
+MATRIX_TARGET_BEGIN(MATRIX_TARGET_AVX512)
+namespace detail {
+namespace avx512 {
+
+struct f64 {
+  using type = double;
+  using reg = __m512d;
+  static constexpr size_t lanes = 8;
+  static reg zero() { return _mm512_setzero_pd(); }
+  static reg set1(type x) { return _mm512_set1_pd(x); }
+  static reg load(type const* p) { return _mm512_loadu_pd(p); }
+  static void store(type* p, reg x) { _mm512_storeu_pd(p, x); }
+  static reg mul(reg a, reg b) { return _mm512_mul_pd(a, b); }
+  static reg fmadd(reg a, reg b, reg c) { return _mm512_fmadd_pd(a, b, c); }
+};
+
+struct f32 {
+  using type = float;
+  using reg = __m512;
+  static constexpr size_t lanes = 16;
+  static reg zero() { return _mm512_setzero_ps(); }
+  static reg set1(type x) { return _mm512_set1_ps(x); }
+  static reg load(type const* p) { return _mm512_loadu_ps(p); }
+  static void store(type* p, reg x) { _mm512_storeu_ps(p, x); }
+  static reg mul(reg a, reg b) { return _mm512_mul_ps(a, b); }
+  static reg fmadd(reg a, reg b, reg c) { return _mm512_fmadd_ps(a, b, c); }
+};
+
+struct i32 {
+  using type = std::int32_t;
+  using reg = __m512i;
+  static constexpr size_t lanes = 16;
+  static reg zero() { return _mm512_setzero_si512(); }
+  static reg set1(type x) { return _mm512_set1_epi32(x); }
+  static reg load(type const* p) { return _mm512_loadu_si512(p); }
+  static void store(type* p, reg x) { _mm512_storeu_si512(p, x); }
+  static reg mul(reg a, reg b) { return _mm512_mullo_epi32(a, b); }
+  static reg fmadd(reg a, reg b, reg c) { return _mm512_add_epi32(_mm512_mullo_epi32(a, b), c); }
+};
+
+#include "gemm_microkernel.inc"
+
+} // namespace avx512
+} // namespace detail
+MATRIX_TARGET_END
+
+#endif // x86 kernels
+
+namespace detail {
+
+inline gemm_isa detect_gemm_isa() {
+#ifdef MATRIX_X86_KERNELS
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f"))
+    return gemm_isa::avx512;
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    return gemm_isa::avx2;
+  if (__builtin_cpu_supports("sse4.2"))
+    return gemm_isa::sse42;
+#endif
+  return gemm_isa::scalar;
+}
+
+inline gemm_isa& active_gemm_isa() {
+  static gemm_isa isa = detect_gemm_isa();
+  return isa;
+}
+
+// kernel table for one element type. types without vector traits only have
+// the scalar kernel.
+template<typename T, typename enable = void>
+struct gemm_kernels {
+  static gemm_kernel<T> get(gemm_isa) {
+    return {4, 4, &gemm_microkernel<4, 4, T>};
+  }
+};
+
+#ifdef MATRIX_X86_KERNELS
+// picks the traits of one element type out of each instruction set namespace
+template<typename T> struct x86_traits;
+template<> struct x86_traits<double> {
+  using sse42 = sse42::f64; using avx2 = avx2::f64; using avx512 = avx512::f64;
+};
+template<> struct x86_traits<float> {
+  using sse42 = sse42::f32; using avx2 = avx2::f32; using avx512 = avx512::f32;
+};
+template<> struct x86_traits<std::int32_t> {
+  using sse42 = sse42::i32; using avx2 = avx2::i32; using avx512 = avx512::i32;
+};
+
+template<typename T, typename = void>
+struct has_x86_traits : std::false_type {};
+template<typename T>
+struct has_x86_traits<T, decltype(void(sizeof(x86_traits<T>)))> : std::true_type {};
+
+// every kernel keeps 12 accumulators: mr = 4 rows of 2 registers for the 16
+// register SSE file, mr = 6 rows of 2 registers for AVX2 and AVX-512
+template<typename T>
+struct gemm_kernels<T, typename std::enable_if<has_x86_traits<T>::value>::type> {
+  using traits = x86_traits<T>;
+
+  static gemm_kernel<T> get(gemm_isa isa) {
+    switch (isa) {
+    case gemm_isa::avx512:
+      return {6, 2 * traits::avx512::lanes,
+              &avx512::microkernel<typename traits::avx512, 6, 2>};
+    case gemm_isa::avx2:
+      return {6, 2 * traits::avx2::lanes,
+              &avx2::microkernel<typename traits::avx2, 6, 2>};
+    case gemm_isa::sse42:
+      return {4, 2 * traits::sse42::lanes,
+              &sse42::microkernel<typename traits::sse42, 4, 2>};
+    default:
+      return {4, 4, &gemm_microkernel<4, 4, T>};
+    }
+  }
+};
+#endif
+
+} // namespace detail
+
+// instruction set of the kernels currently in use
+inline gemm_isa gemm_kernel_isa() {
+  return detail::active_gemm_isa();
+}
+
+// restricts the kernels to at most the given instruction set, e.g. to compare
+// against the scalar path or to avoid AVX-512 frequency drops. requests above
+// what the host supports are clamped. not thread safe with running products.
+inline gemm_isa set_gemm_kernel_isa(gemm_isa isa) {
+  gemm_isa const supported = detail::detect_gemm_isa();
+  detail::active_gemm_isa() = isa < supported ? isa : supported;
+  return detail::active_gemm_isa();
+}
+
+template<typename T>
+gemm_kernel<T> active_gemm_kernel() {
+  return detail::gemm_kernels<T>::get(gemm_kernel_isa());
+}
+
+#endif
@@ -0,0 +1,219 @@
+#ifndef GEMV
+#define GEMV
+
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include "allocators.hpp"
+#include "packet.hpp"
+#include "thread_pool.hpp"
+
+// matrix-vector products: y = alpha * A * x + beta * y
+//
+// every element of A is read once and takes part in a single multiply-add,
+// so the product runs at the speed A streams in from memory. gemm would pack
+// A first, reading it twice, and pad x to its micro-tile; here A is read in
+// place, in the order it is stored, with enough independent accumulators to
+// keep loads in flight:
+//   rows contiguous     y_i is the dot product of row i with x, four rows at
+//                       a time, so each packet of x loaded serves four rows
+//   columns contiguous  y is updated with x_j times column j, four columns
+//                       at a time, so each packet of y is loaded and stored
+//                       once per four columns
+// rows of A (elements of y) are split over the thread pool, no two threads
+// writing the same element of y, and A is spread over enough cores to reach
+// full memory bandwidth. a vector times a matrix, y' = x' * A, is the same
+// product with the strides of A swapped.
+
+// elements of A from which a product is spread over the thread pool
+constexpr size_t gemv_parallel_work = size_t(1) << 16;
+
+namespace detail {
+
+template<typename T>
+using gemv_buffer = std::vector<T, aligned_allocator<T> >;
+
+// x itself when it is contiguous, otherwise a contiguous copy in buf
+template<typename T>
+T const* contiguous_vector(T const* x, size_t n, std::ptrdiff_t inc, gemv_buffer<T>& buf) {
+  if (inc == 1)
+    return x;
+  if (buf.size() < n)
+    buf.resize(n);
+  for (size_t i = 0; i < n; i++)
+    buf[i] = x[static_cast<std::ptrdiff_t>(i) * inc];
+  return buf.data();
+}
+
+// sum of the lanes of a packet
+template<typename T>
+T horizontal_sum(packet_t<T> p) {
+  T lanes[packet_traits<T>::lanes];
+  std::memcpy(lanes, &p, sizeof(p));
+  T sum = T();
+  for (size_t l = 0; l < packet_traits<T>::lanes; l++)
+    sum += lanes[l];
+  return sum;
+}
+
+template<typename T>
+void gemv_store(T& y, T alpha, T dot, T beta) {
+  y = beta == T() ? alpha * dot : alpha * dot + beta * y;
+}
+
+// rows [first, last) of A with contiguous rows, rs_a apart. x is contiguous
+template<typename T>
+void gemv_rows(size_t first, size_t last, size_t n, T alpha, T const* a,
+               std::ptrdiff_t rs_a, T const* x, T beta, T* y, std::ptrdiff_t incy) {
+  using traits = packet_traits<T>;
+  constexpr size_t L = traits::lanes;
+  size_t i = first;
+  for (; i + 4 <= last; i += 4) {
+    T const* const r0 = a + static_cast<std::ptrdiff_t>(i) * rs_a;
+    T const* const r1 = r0 + rs_a;
+    T const* const r2 = r1 + rs_a;
+    T const* const r3 = r2 + rs_a;
+    packet_t<T> s0 = traits::set1(T()), s1 = s0, s2 = s0, s3 = s0;
+    size_t k = 0;
+    for (; k + L <= n; k += L) {
+      packet_t<T> const xk = traits::load(x + k);
+      s0 += traits::load(r0 + k) * xk;
+      s1 += traits::load(r1 + k) * xk;
+      s2 += traits::load(r2 + k) * xk;
+      s3 += traits::load(r3 + k) * xk;
+    }
+    T d0 = horizontal_sum<T>(s0), d1 = horizontal_sum<T>(s1);
+    T d2 = horizontal_sum<T>(s2), d3 = horizontal_sum<T>(s3);
+    for (; k < n; k++) {
+      d0 += r0[k] * x[k];
+      d1 += r1[k] * x[k];
+      d2 += r2[k] * x[k];
+      d3 += r3[k] * x[k];
+    }
+    gemv_store(y[static_cast<std::ptrdiff_t>(i) * incy], alpha, d0, beta);
+    gemv_store(y[static_cast<std::ptrdiff_t>(i + 1) * incy], alpha, d1, beta);
+    gemv_store(y[static_cast<std::ptrdiff_t>(i + 2) * incy], alpha, d2, beta);
+    gemv_store(y[static_cast<std::ptrdiff_t>(i + 3) * incy], alpha, d3, beta);
+  }
+  // the last few rows alone, over two accumulators
+  for (; i < last; i++) {
+    T const* const r = a + static_cast<std::ptrdiff_t>(i) * rs_a;
+    packet_t<T> s0 = traits::set1(T()), s1 = s0;
+    size_t k = 0;
+    for (; k + 2 * L <= n; k += 2 * L) {
+      s0 += traits::load(r + k) * traits::load(x + k);
+      s1 += traits::load(r + k + L) * traits::load(x + k + L);
+    }
+    for (; k + L <= n; k += L)
+      s0 += traits::load(r + k) * traits::load(x + k);
+    T dot = horizontal_sum<T>(s0 + s1);
+    for (; k < n; k++)
+      dot += r[k] * x[k];
+    gemv_store(y[static_cast<std::ptrdiff_t>(i) * incy], alpha, dot, beta);
+  }
+}
+
+// rows [first, last) of A with contiguous columns, cs_a apart. x and y are
+// contiguous
+template<typename T>
+void gemv_cols(size_t first, size_t last, size_t n, T alpha, T const* a,
+               std::ptrdiff_t cs_a, T const* x, T beta, T* y) {
+  using traits = packet_traits<T>;
+  constexpr size_t L = traits::lanes;
+  for (size_t i = first; i < last; i++)
+    y[i] = beta == T() ? T() : beta * y[i];
+  size_t j = 0;
+  for (; j + 4 <= n; j += 4) {
+    T const* const c0 = a + static_cast<std::ptrdiff_t>(j) * cs_a;
+    T const* const c1 = c0 + cs_a;
+    T const* const c2 = c1 + cs_a;
+    T const* const c3 = c2 + cs_a;
+    T const x0 = alpha * x[j], x1 = alpha * x[j + 1];
+    T const x2 = alpha * x[j + 2], x3 = alpha * x[j + 3];
+    packet_t<T> const p0 = traits::set1(x0), p1 = traits::set1(x1);
+    packet_t<T> const p2 = traits::set1(x2), p3 = traits::set1(x3);
+    size_t i = first;
+    for (; i + L <= last; i += L)
+      traits::store(y + i, traits::load(y + i) +
+                           (p0 * traits::load(c0 + i) + p1 * traits::load(c1 + i)) +
+                           (p2 * traits::load(c2 + i) + p3 * traits::load(c3 + i)));
+    for (; i < last; i++)
+      y[i] += (x0 * c0[i] + x1 * c1[i]) + (x2 * c2[i] + x3 * c3[i]);
+  }
+  for (; j < n; j++) {
+    T const* const c = a + static_cast<std::ptrdiff_t>(j) * cs_a;
+    T const xj = alpha * x[j];
+    packet_t<T> const p = traits::set1(xj);
+    size_t i = first;
+    for (; i + L <= last; i += L)
+      traits::store(y + i, traits::load(y + i) + p * traits::load(c + i));
+    for (; i < last; i++)
+      y[i] += xj * c[i];
+  }
+}
+
+// neither rows nor columns contiguous: one dot product per row
+template<typename T>
+void gemv_strided(size_t first, size_t last, size_t n, T alpha, T const* a,
+                  std::ptrdiff_t rs_a, std::ptrdiff_t cs_a, T const* x, T beta,
+                  T* y, std::ptrdiff_t incy) {
+  for (size_t i = first; i < last; i++) {
+    T const* const r = a + static_cast<std::ptrdiff_t>(i) * rs_a;
+    T dot = T();
+    for (size_t k = 0; k < n; k++)
+      dot += r[static_cast<std::ptrdiff_t>(k) * cs_a] * x[k];
+    gemv_store(y[static_cast<std::ptrdiff_t>(i) * incy], alpha, dot, beta);
+  }
+}
+
+} // namespace detail
+
+// y (m) = alpha * A (m x n) * x (n) + beta * y, A strided, x and y incx and
+// incy elements apart. y is not read when beta is zero. x must not overlap y.
+template<typename T>
+void gemv(size_t m, size_t n, T alpha, T const* a, std::ptrdiff_t rs_a,
+          std::ptrdiff_t cs_a, T const* x, std::ptrdiff_t incx, T beta, T* y,
+          std::ptrdiff_t incy) {
+  if (m == 0)
+    return;
+
+  static thread_local detail::gemv_buffer<T> x_buf;
+  T const* const xc = detail::contiguous_vector(x, n, incx, x_buf);
+
+  auto rows = [=](size_t first, size_t last) {
+    if (cs_a == 1 || n <= 1) {
+      detail::gemv_rows(first, last, n, alpha, a, rs_a, xc, beta, y, incy);
+    } else if (rs_a == 1 && incy == 1) {
+      detail::gemv_cols(first, last, n, alpha, a, cs_a, xc, beta, y);
+    } else if (rs_a == 1) {
+      // y strided: its slice is gathered into a buffer of this thread and
+      // scattered back
+      static thread_local detail::gemv_buffer<T> y_buf;
+      if (y_buf.size() < last - first)
+        y_buf.resize(last - first);
+      for (size_t i = first; i < last; i++)
+        y_buf[i - first] = y[static_cast<std::ptrdiff_t>(i) * incy];
+      detail::gemv_cols(size_t(0), last - first, n, alpha,
+                        a + static_cast<std::ptrdiff_t>(first), cs_a, xc, beta,
+                        y_buf.data());
+      for (size_t i = first; i < last; i++)
+        y[static_cast<std::ptrdiff_t>(i) * incy] = y_buf[i - first];
+    } else {
+      detail::gemv_strided(first, last, n, alpha, a, rs_a, cs_a, xc, beta, y, incy);
+    }
+  };
+
+  if (m * n < gemv_parallel_work) {
+    rows(0, m);
+    return;
+  }
+  // slices of a few thousand elements of A, a few per thread, in multiples
+  // of the four rows the kernels take at a time
+  std::shared_ptr<thread_pool> const pool = default_thread_pool_ptr();
+  size_t const min_rows = (size_t(1) << 12) / std::max<size_t>(n, 1) + 1;
+  size_t const grain = (std::max(min_rows, m / (4 * pool->size())) + 3) / 4 * 4;
+  pool->parallel_for(m, grain, rows);
+}
+
+#endif
@@ -0,0 +1,177 @@
+#ifndef LAYOUT
+#define LAYOUT
+
+#include <cstddef>
+#include <type_traits>
+
+// storage orders for matrix<T, Alloc, Layout>.
+//
+// a layout maps (row, col) of a rows x cols matrix to an offset into its
+// storage, and says how to walk the matrix in storage order: traversal is in
+// outer units (rows, columns or rows of tiles), which the evaluator splits
+// across threads, each visiting inner elements. strided layouts are plain
+// row / column strides that gemm reads directly; anything else is copied into
+// a row-major temporary first when it takes part in a product.
+
+struct row_major {
+  static constexpr bool strided = true;
+
+  static size_t size(size_t rows, size_t cols) {
+    return rows * cols;
+  }
+
+  static size_t index(size_t row, size_t col, size_t, size_t cols) {
+    return row * cols + col;
+  }
+
+  static std::ptrdiff_t row_stride(size_t, size_t cols) {
+    return cols;
+  }
+
+  static std::ptrdiff_t col_stride(size_t, size_t) {
+    return 1;
+  }
+
+  static size_t outer(size_t rows, size_t) {
+    return rows;
+  }
+
+  static size_t inner(size_t, size_t cols) {
+    return cols;
+  }
+
+  // position of the inner-th element along outer index outer
+  static size_t row_at(size_t outer, size_t) {
+    return outer;
+  }
+
+  static size_t col_at(size_t, size_t inner) {
+    return inner;
+  }
+
+  template<typename F>
+  static void for_each(size_t, size_t cols, size_t first, size_t last, F const& f) {
+    for (size_t i = first; i < last; i++)
+      for (size_t j = 0; j < cols; j++)
+        f(i, j);
+  }
+};
+
+struct col_major {
+  static constexpr bool strided = true;
+
+  static size_t size(size_t rows, size_t cols) {
+    return rows * cols;
+  }
+
+  static size_t index(size_t row, size_t col, size_t rows, size_t) {
+    return col * rows + row;
+  }
+
+  static std::ptrdiff_t row_stride(size_t, size_t) {
+    return 1;
+  }
+
+  static std::ptrdiff_t col_stride(size_t rows, size_t) {
+    return rows;
+  }
+
+  static size_t outer(size_t, size_t cols) {
+    return cols;
+  }
+
+  static size_t inner(size_t rows, size_t) {
+    return rows;
+  }
+
+  static size_t row_at(size_t, size_t inner) {
+    return inner;
+  }
+
+  static size_t col_at(size_t outer, size_t) {
+    return outer;
+  }
+
+  template<typename F>
+  static void for_each(size_t rows, size_t, size_t first, size_t last, F const& f) {
+    for (size_t j = first; j < last; j++)
+      for (size_t i = 0; i < rows; i++)
+        f(i, j);
+  }
+};
+
+// B x B tiles, each stored row-major, laid out tile row after tile row. both
+// dimensions are padded to a multiple of B. a tile of doubles at the default
+// B is 2KB, so walking either a row or a column of tiles stays within a few
+// pages, whichever direction the neighbouring operands are read in.
+template<size_t B = 16>
+struct tiled {
+  static_assert(B > 0 && (B & (B - 1)) == 0, "tile size must be a power of two");
+  static constexpr bool strided = false;
+  static constexpr size_t tile = B;
+
+  static size_t padded(size_t n) {
+    return (n + B - 1) / B * B;
+  }
+
+  static size_t size(size_t rows, size_t cols) {
+    return padded(rows) * padded(cols);
+  }
+
+  static size_t index(size_t row, size_t col, size_t, size_t cols) {
+    return ((row / B) * padded(cols) + (col / B) * B) * B + (row % B) * B + col % B;
+  }
+
+  static size_t outer(size_t rows, size_t) {
+    return (rows + B - 1) / B;
+  }
+
+  static size_t inner(size_t, size_t cols) {
+    return B * cols;
+  }
+
+  template<typename F>
+  static void for_each(size_t rows, size_t cols, size_t first, size_t last, F const& f) {
+    for (size_t ti = first; ti < last; ti++) {
+      size_t const row_end = ti * B + B < rows ? ti * B + B : rows;
+      for (size_t tj = 0; tj < cols; tj += B) {
+        size_t const col_end = tj + B < cols ? tj + B : cols;
+        for (size_t i = ti * B; i < row_end; i++)
+          for (size_t j = tj; j < col_end; j++)
+            f(i, j);
+      }
+    }
+  }
+};
+
+// layout of an expression whose operands are stored in different orders
+struct mixed_layout {
+  static constexpr bool strided = false;
+};
+
+namespace detail {
+
+template<typename L1, typename L2>
+using common_layout = typename std::conditional<
+  std::is_same<L1, L2>::value, L1, mixed_layout>::type;
+
+// storage order of the transpose of a matrix laid out in L, read through the
+// same storage: row- and column-major swap, nothing else has one
+template<typename L>
+struct transposed_layout {
+  using type = mixed_layout;
+};
+
+template<>
+struct transposed_layout<row_major> {
+  using type = col_major;
+};
+
+template<>
+struct transposed_layout<col_major> {
+  using type = row_major;
+};
+
+} // namespace detail
+
+#endif
@@ -4,116 +4,2060 @@
 #include <vector>
 #include <iostream>
 #include <cassert>
+#include <type_traits>
+#include <utility>
+#include <memory>
+#include <thread>
+#include <atomic>
 #include <boost/type_traits.hpp>
+#include "gemm.hpp"
+#include "gemv.hpp"
+#include "strassen.hpp"
+#include "thread_pool.hpp"
+#include "packet.hpp"
+#include "allocators.hpp"
+#include "layout.hpp"
+#include "transpose.hpp"
+
+namespace detail {
+
+// whether the caller is being evaluated in a constant expression, where
+// packets, gemm and the thread pool are out of reach (see fixed.hpp).
+// std::is_constant_evaluated() is C++20; GCC and Clang have had the
+// builtin behind it for longer.
+constexpr bool is_constant_evaluated() {
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_is_constant_evaluated();
+#else
+  return false;
+#endif
+}
+
+inline size_t& parallel_eval_threshold_ref() {
+  static size_t threshold = size_t(1) << 16;
+  return threshold;
+}
+
+// runs f(first_row, last_row) over all rows of a rows x cols result, split
+// across the default thread pool when the result has at least
+// parallel_eval_threshold() elements, and on the calling thread otherwise
+template<typename F>
+void for_each_row_range(size_t rows, size_t cols, F const& f) {
+  if (rows * cols < parallel_eval_threshold_ref()) {
+    f(size_t(0), rows);
+    return;
+  }
+  std::shared_ptr<thread_pool> const pool = default_thread_pool_ptr();
+  // a few chunks per thread for balance, but none too small to be worth it
+  size_t const min_rows = (size_t(1) << 12) / std::max<size_t>(cols, 1) + 1;
+  size_t const grain = std::max(min_rows, rows / (4 * pool->size()));
+  pool->parallel_for(rows, grain, f);
+}
+
+// folds map(first_row, last_row) over all rows of a rows x cols operand
+// with combine, split across the pool like for_each_row_range. partial
+// results are combined in row order (see thread_pool::parallel_reduce)
+template<typename R, typename Map, typename Combine>
+R reduce_row_range(size_t rows, size_t cols, R init, Map const& map,
+                   Combine const& combine) {
+  if (rows * cols < parallel_eval_threshold_ref())
+    return rows == 0 ? init : combine(init, map(size_t(0), rows));
+  std::shared_ptr<thread_pool> const pool = default_thread_pool_ptr();
+  size_t const min_rows = (size_t(1) << 12) / std::max<size_t>(cols, 1) + 1;
+  size_t const grain = std::max(min_rows, rows / (4 * pool->size()));
+  return pool->parallel_reduce(rows, grain, init, map, combine);
+}
+
+// prepares expr (see matrix_expr::prepare) for the lifetime of the guard,
+// one evaluation, and unprepares it at the end, so temporaries never outlive
+// the evaluation that made them: evaluating the same expression again after
+// its operands changed computes them anew
+template<typename E>
+class prepared {
+  E const& expr_;
+
+public:
+  explicit prepared(E const& expr) : expr_(expr) {
+    try {
+      expr_.prepare();
+    } catch (...) {
+      expr_.unprepare();
+      throw;
+    }
+  }
+
+  prepared(prepared const&) = delete;
+  prepared& operator=(prepared const&) = delete;
+
+  ~prepared() {
+    expr_.unprepare();
+  }
+};
+
+} // namespace detail
+
+// number of elements from which expressions are evaluated in parallel.
+// small matrices never touch the thread pool; SIZE_MAX disables parallel
+// evaluation entirely.
+inline size_t parallel_eval_threshold() {
+  return detail::parallel_eval_threshold_ref();
+}
+
+inline void set_parallel_eval_threshold(size_t elements) {
+  detail::parallel_eval_threshold_ref() = elements;
+}
+
+// a dimension only known at run time
+constexpr size_t dynamic_extent = size_t(-1);
 
 template<typename E> class matrix_expr { // expression template base class
 protected:
-  size_t num_rows_;
-  size_t num_cols_;
+  // initialized so fixed size expressions can be built in constant
+  // expressions (see fixed.hpp)
+  size_t num_rows_ = 0;
+  size_t num_cols_ = 0;
+
+public:
+  constexpr size_t num_rows() const {
+    return num_rows_;
+  }
+
+  constexpr size_t num_cols() const {
+    return num_cols_;
+  }
+
+  // at() will be called on each individual part of expr, to evaluate.
+  // this parent at() calls derived at()
+  constexpr auto at(size_t row, size_t col) const{ 
+    return static_cast<E const&>(*this).at(row,col);
+  }
+
+  // element-wise expressions whose operands share one element type and one
+  // layout can also be read in storage order by flat index, at(i), and a
+  // whole packet of lanes at a time, packet(i) (see packet.hpp). the
+  // evaluator then fuses the tree into a single vectorized pass over
+  // contiguous memory. nodes that provide both set this to true.
+  static constexpr bool is_linear = false;
+
+  // expressions whose elements are spread out with gaps between lines, like
+  // a block of a larger matrix (see matrix_view), can't be read by flat
+  // index, but still a packet at a time along a row (a column, for
+  // column-major operands) from any position, packet(row, col). the
+  // evaluator then walks the destination line by line and reads whole
+  // packets within each line. nodes that provide it set this to true.
+  static constexpr bool is_strided_linear = false;
+
+  // storage order of the operands (see layout.hpp), mixed_layout when they
+  // disagree. the evaluator compares it with the destination's layout to
+  // pick a flat pass or a tile by tile walk.
+  using layout = row_major;
+
+  // dimensions known at compile time, dynamic_extent otherwise. fixed size
+  // matrices (see fixed.hpp) set them, and the nodes above them work them out
+  // from their operands, so mismatched sizes fail to compile.
+  static constexpr size_t static_rows = dynamic_extent;
+  static constexpr size_t static_cols = dynamic_extent;
+
+  // called once by the evaluator before any element is read. nodes pass it on
+  // to their operands; products use it to materialize themselves (see
+  // matrix_prod), so reading them element by element afterwards is cheap.
+  constexpr void prepare() const {}
+
+  // called once the evaluation that prepared the expression is done, see
+  // detail::prepared. nodes pass it on like prepare(), products give their
+  // temporary back. unpreparing what wasn't prepared does nothing.
+  constexpr void unprepare() const {}
+  
+  friend std::ostream& operator<<(std::ostream& stream, const matrix_expr<E> & expr)  {
+    if (expr.num_rows() == 0)
+      return stream;
+
+    detail::prepared<E> const scope(static_cast<E const&>(expr));
+
+    for (size_t i = 0; i < expr.num_rows(); i++) {
+      for (size_t j = 0; j < expr.num_cols(); j++) {
+        stream << expr.at(i,j) << ' '; 
+      }
+      stream << '\n';
+    }
+    return stream;
+  }
+};
+
+// element type an expression evaluates to
+template<typename E>
+using expr_value_t = typename std::decay<
+  decltype(std::declval<E const&>().at(size_t(), size_t()))>::type;
+
+// largest element of an expression, see reduce.hpp
+template<typename E>
+expr_value_t<E> max(matrix_expr<E> const& expr);
+
+template<typename E1, typename E2, typename enable = void> class matrix_prod;
+template<typename E1, typename E2> class matrix_sum;
+template<typename E1, typename E2> class matrix_sub;
+template<typename T, typename Alloc = std::allocator<T>,
+         typename Layout = row_major> class matrix;
+template<typename T, typename Layout = row_major> class matrix_view;
+template<typename E> class matrix_transpose;
+template<typename T, size_t R, size_t C> class fixed_matrix;
+template<typename T, bool Column, typename Alloc = std::allocator<T> > class basic_vector;
+template<typename T> class scratch_pool;
+
+namespace detail {
+
+// operands of matrix_prod that are scaling factors rather than matrices
+template<typename T>
+struct is_scalar_operand
+  : std::integral_constant<bool, std::is_scalar<T>::value ||
+                                 boost::is_complex<T>::value> {};
+
+template<typename E>
+struct is_expr : std::is_base_of<matrix_expr<E>, E> {};
+
+// the operators below only take part in overload resolution for matrix
+// expressions (and scalars, for *). left unconstrained they would be found
+// by ADL for anything with a matrix among its template arguments, e.g. the
+// iterators of a std::vector<std::unique_ptr<matrix<T> > >.
+template<typename E1, typename E2, typename R>
+using enable_if_exprs = typename std::enable_if<
+  is_expr<E1>::value && is_expr<E2>::value, R>::type;
+
+template<typename E1, typename E2, typename R>
+using enable_if_product = typename std::enable_if<
+  (is_expr<E1>::value && (is_expr<E2>::value || is_scalar_operand<E2>::value)) ||
+  (is_scalar_operand<E1>::value && is_expr<E2>::value), R>::type;
+
+template<typename E>
+struct is_matrix_product : std::false_type {};
+
+template<typename E1, typename E2>
+struct is_matrix_product<matrix_prod<E1, E2> >
+  : std::integral_constant<bool, !is_scalar_operand<E1>::value &&
+                                 !is_scalar_operand<E2>::value> {};
+
+// matrix products whose dimensions are all known at compile time. they are
+// small, so each element is computed where it is read, a dot product of fixed
+// length, rather than the whole product by gemm into a scratch matrix.
+template<typename E1, typename E2>
+struct has_static_product_extents
+  : std::integral_constant<bool, E1::static_rows != dynamic_extent &&
+                                 E1::static_cols != dynamic_extent &&
+                                 E2::static_cols != dynamic_extent> {};
+
+template<typename E>
+struct is_inline_product : std::false_type {};
+
+template<typename E1, typename E2>
+struct is_inline_product<matrix_prod<E1, E2> >
+  : std::conditional_t<is_matrix_product<matrix_prod<E1, E2> >::value,
+                       has_static_product_extents<E1, E2>, std::false_type> {};
+
+// a dimension of an element-wise node: whichever operand knows it at
+// compile time, if any
+constexpr size_t common_extent(size_t lhs, size_t rhs) {
+  return lhs == dynamic_extent ? rhs : lhs;
+}
+
+constexpr bool extents_agree(size_t lhs, size_t rhs) {
+  return lhs == dynamic_extent || rhs == dynamic_extent || lhs == rhs;
+}
+
+// deepest inner dimension known at compile time that multiply_narrow
+// unrolls; deeper products go to gemm
+constexpr size_t max_narrow_depth = 16;
+
+template<typename E>
+struct is_transpose : std::false_type {};
+
+template<typename E>
+struct is_transpose<matrix_transpose<E> > : std::true_type {};
+
+// operands that only store their nonzeros (see sparse.hpp). reading them
+// through at() costs a search per element, so the evaluator visits their
+// nonzeros instead. a specialization for such an E provides
+//   is_sparse = true
+//   outer(e)       number of rows (columns) its nonzeros are grouped by
+//   nonzeros(e)    number of stored elements
+//   for_each_nonzero(e, first, last, f)
+//                  f(row, col, value) for each element stored in rows
+//                  (columns) [first, last)
+template<typename E, typename enable = void>
+struct sparse_traits {
+  static constexpr bool is_sparse = false;
+};
+
+// a sum or difference of a sparse operand and anything else: the other
+// operand is evaluated as usual and the nonzeros added on top
+template<typename E1, typename E2, bool Subtract>
+struct sparse_sum_operands {
+  static constexpr bool sparse_lhs = sparse_traits<E1>::is_sparse;
+  static constexpr bool value = sparse_lhs != sparse_traits<E2>::is_sparse;
+  // s - x is computed as -x + s
+  static constexpr bool negate_dense = Subtract && sparse_lhs;
+  static constexpr bool subtract_sparse = Subtract && !sparse_lhs;
+
+  template<typename S>
+  static auto const& dense(S const& sum) {
+    return pick(sum, std::integral_constant<bool, !sparse_lhs>());
+  }
+
+  template<typename S>
+  static auto const& sparse(S const& sum) {
+    return pick(sum, std::integral_constant<bool, sparse_lhs>());
+  }
+
+private:
+  template<typename S>
+  static E1 const& pick(S const& sum, std::true_type) {
+    return sum.lhs();
+  }
+
+  template<typename S>
+  static E2 const& pick(S const& sum, std::false_type) {
+    return sum.rhs();
+  }
+};
+
+template<typename E>
+struct sparse_sum : std::false_type {};
+
+template<typename E1, typename E2>
+struct sparse_sum<matrix_sum<E1, E2> > : sparse_sum_operands<E1, E2, false> {};
+
+template<typename E1, typename E2>
+struct sparse_sum<matrix_sub<E1, E2> > : sparse_sum_operands<E1, E2, true> {};
+
+template<typename E, typename T>
+using has_value_type = std::is_same<expr_value_t<E>, T>;
+
+// products of dense operands with element type T that go through gemm, so a
+// scaling and an accumulation can be folded into it (not sparse kernels,
+// multiply_narrow or inline products)
+template<typename E1, typename E2, typename T>
+struct dense_gemm_operands
+  : std::integral_constant<bool, !sparse_traits<E1>::is_sparse &&
+                                 !sparse_traits<E2>::is_sparse &&
+                                 (E1::static_cols == dynamic_extent ||
+                                  E1::static_cols > max_narrow_depth) &&
+                                 has_value_type<matrix_prod<E1, E2>, T>::value> {};
+
+template<typename E, typename T>
+struct is_gemm_product : std::false_type {};
+
+template<typename E1, typename E2, typename T>
+struct is_gemm_product<matrix_prod<E1, E2>, T>
+  : std::conditional_t<is_matrix_product<matrix_prod<E1, E2> >::value &&
+                       !is_inline_product<matrix_prod<E1, E2> >::value,
+                       dense_gemm_operands<E1, E2, T>, std::false_type> {};
+
+// alpha * op(A) * op(B), op(X) being X or transpose(X): a gemm product
+// scaled on either side, transposed as a whole, or both. the transpose of a
+// product, (A * B)' = B' * A', is a product of transposes, which gemm reads
+// with swapped strides.
+//   product(e)   the product A * B
+//   transposed   whether e is its transpose
+//   alpha(e)     the scalars it is multiplied by
+template<typename E, typename T, typename enable = void>
+struct scaled_product : std::false_type {};
+
+template<typename E, typename T>
+struct scaled_product<E, T, typename std::enable_if<is_gemm_product<E, T>::value>::type>
+  : std::true_type {
+  static constexpr bool transposed = false;
+
+  static E const& product(E const& e) {
+    return e;
+  }
+
+  static T alpha(E const&) {
+    return T(1);
+  }
+};
+
+template<typename S, typename E, typename T>
+struct scaled_product<matrix_prod<S, E>, T, typename std::enable_if<
+                        is_scalar_operand<S>::value && scaled_product<E, T>::value &&
+                        has_value_type<matrix_prod<S, E>, T>::value>::type>
+  : scaled_product<E, T> {
+  static auto const& product(matrix_prod<S, E> const& e) {
+    return scaled_product<E, T>::product(e.rhs());
+  }
+
+  static T alpha(matrix_prod<S, E> const& e) {
+    return T(e.lhs()) * scaled_product<E, T>::alpha(e.rhs());
+  }
+};
+
+template<typename E, typename S, typename T>
+struct scaled_product<matrix_prod<E, S>, T, typename std::enable_if<
+                        is_scalar_operand<S>::value && scaled_product<E, T>::value &&
+                        has_value_type<matrix_prod<E, S>, T>::value>::type>
+  : scaled_product<E, T> {
+  static auto const& product(matrix_prod<E, S> const& e) {
+    return scaled_product<E, T>::product(e.lhs());
+  }
+
+  static T alpha(matrix_prod<E, S> const& e) {
+    return scaled_product<E, T>::alpha(e.lhs()) * T(e.rhs());
+  }
+};
+
+template<typename E, typename T>
+struct scaled_product<matrix_transpose<E>, T,
+                      typename std::enable_if<scaled_product<E, T>::value>::type>
+  : scaled_product<E, T> {
+  static constexpr bool transposed = !scaled_product<E, T>::transposed;
+
+  static auto const& product(matrix_transpose<E> const& e) {
+    return scaled_product<E, T>::product(e.operand());
+  }
+
+  static T alpha(matrix_transpose<E> const& e) {
+    return scaled_product<E, T>::alpha(e.operand());
+  }
+};
+
+// beta * C: C scaled on either side, or C alone with beta = 1
+template<typename E, typename T, typename enable = void>
+struct scaled_term {
+  static E const& term(E const& e) {
+    return e;
+  }
+
+  static T beta(E const&) {
+    return T(1);
+  }
+};
+
+template<typename S, typename E, typename T>
+struct scaled_term<matrix_prod<S, E>, T, typename std::enable_if<
+                     is_scalar_operand<S>::value && has_value_type<E, T>::value>::type> {
+  static E const& term(matrix_prod<S, E> const& e) {
+    return e.rhs();
+  }
+
+  static T beta(matrix_prod<S, E> const& e) {
+    return T(e.lhs());
+  }
+};
+
+template<typename E, typename S, typename T>
+struct scaled_term<matrix_prod<E, S>, T, typename std::enable_if<
+                     is_scalar_operand<S>::value && has_value_type<E, T>::value>::type> {
+  static E const& term(matrix_prod<E, S> const& e) {
+    return e.lhs();
+  }
+
+  static T beta(matrix_prod<E, S> const& e) {
+    return T(e.rhs());
+  }
+};
+
+// expressions of element type T that are a single gemm call,
+//   alpha * op(A) * op(B) + beta * C
+// a scaled product (see scaled_product), alone or added to or subtracted
+// from anything else, C, which may be scaled itself:
+//   2 * (a * b) + c,  c - transpose(a) * b,  0.5 * c + transpose(a * b) * 3
+// the evaluator puts C in the destination, unless it is already there, and
+// has gemm scale the product and add it to beta * C as it writes each tile.
+//   scaled            scaled_product of the product term
+//   product_term(e)   that term
+//   alpha(e)          its scaling, negated when it is subtracted
+//   accumulates       whether there is a C; if so
+//   c(e), beta(e)     C without its scaling, and that scaling
+template<typename E, typename T, typename enable = void>
+struct gemm_expr : std::false_type {};
+
+template<typename E, typename T>
+struct gemm_expr<E, T, typename std::enable_if<scaled_product<E, T>::value>::type>
+  : std::true_type {
+  using scaled = scaled_product<E, T>;
+  static constexpr bool accumulates = false;
+
+  static E const& product_term(E const& e) {
+    return e;
+  }
+
+  static T alpha(E const& e) {
+    return scaled::alpha(e);
+  }
+};
+
+// a sum or difference E of a scaled product X and a term Y, X being its
+// lhs when ProductLhs, with the signs they are taken with
+template<typename E, typename X, typename Y, typename T, bool ProductLhs,
+         int ProductSign, int TermSign>
+struct gemm_accumulation : std::true_type {
+  using scaled = scaled_product<X, T>;
+  using term = scaled_term<Y, T>;
+  static constexpr bool accumulates = true;
+
+  static X const& product_term(E const& e) {
+    return pick(e, std::integral_constant<bool, ProductLhs>());
+  }
+
+  static T alpha(E const& e) {
+    return T(ProductSign) * scaled::alpha(product_term(e));
+  }
+
+  static auto const& c(E const& e) {
+    return term::term(c_term(e));
+  }
+
+  static T beta(E const& e) {
+    return T(TermSign) * term::beta(c_term(e));
+  }
+
+private:
+  static Y const& c_term(E const& e) {
+    return pick(e, std::integral_constant<bool, !ProductLhs>());
+  }
+
+  static auto const& pick(E const& e, std::true_type) {
+    return e.lhs();
+  }
+
+  static auto const& pick(E const& e, std::false_type) {
+    return e.rhs();
+  }
+};
+
+// the product is the lhs when both operands are products
+template<typename E1, typename E2, typename T>
+struct gemm_expr<matrix_sum<E1, E2>, T, typename std::enable_if<
+                   scaled_product<E1, T>::value && has_value_type<E2, T>::value>::type>
+  : gemm_accumulation<matrix_sum<E1, E2>, E1, E2, T, true, 1, 1> {};
+
+template<typename E1, typename E2, typename T>
+struct gemm_expr<matrix_sum<E1, E2>, T, typename std::enable_if<
+                   !scaled_product<E1, T>::value && scaled_product<E2, T>::value &&
+                   has_value_type<E1, T>::value>::type>
+  : gemm_accumulation<matrix_sum<E1, E2>, E2, E1, T, false, 1, 1> {};
+
+template<typename E1, typename E2, typename T>
+struct gemm_expr<matrix_sub<E1, E2>, T, typename std::enable_if<
+                   scaled_product<E1, T>::value && has_value_type<E2, T>::value>::type>
+  : gemm_accumulation<matrix_sub<E1, E2>, E1, E2, T, true, 1, -1> {};
+
+template<typename E1, typename E2, typename T>
+struct gemm_expr<matrix_sub<E1, E2>, T, typename std::enable_if<
+                   !scaled_product<E1, T>::value && scaled_product<E2, T>::value &&
+                   has_value_type<E1, T>::value>::type>
+  : gemm_accumulation<matrix_sub<E1, E2>, E2, E1, T, false, -1, 1> {};
+
+// how the evaluator fills a matrix<T> with layout L from an expression E:
+// products of the right element type go straight to gemm when L is strided,
+// sparse operands and sums with one sparse operand through their nonzeros,
+// scaled products and their sums with anything else (see gemm_expr) into a
+// strided L through a single gemm call, linear expressions of the same
+// layout a packet at a time, strided linear ones into a strided L a packet
+// at a time along each line, transposes into a strided L through the
+// blocked transpose engine, everything else one element at a time
+struct product_tag {};
+struct sparse_tag {};
+struct sparse_sum_tag {};
+struct gemm_tag {};
+struct linear_tag {};
+struct strided_linear_tag {};
+struct transpose_tag {};
+struct element_tag {};
+
+template<typename E, typename T, typename L>
+using elementwise_tag =
+  std::conditional_t<!std::is_same<expr_value_t<E>, T>::value ||
+                     !std::is_same<typename E::layout, L>::value, element_tag,
+  std::conditional_t<E::is_linear, linear_tag,
+  std::conditional_t<E::is_strided_linear && L::strided, strided_linear_tag,
+                     element_tag> > >;
+
+template<typename E, typename T, typename L>
+struct eval_tag_of {
+  static constexpr bool same_type = std::is_same<expr_value_t<E>, T>::value;
+
+  using type =
+    std::conditional_t<is_matrix_product<E>::value && !is_inline_product<E>::value &&
+                       same_type && L::strided,
+                       product_tag,
+    std::conditional_t<sparse_traits<E>::is_sparse, sparse_tag,
+    std::conditional_t<sparse_sum<E>::value, sparse_sum_tag,
+    std::conditional_t<gemm_expr<E, T>::value && L::strided, gemm_tag,
+    std::conditional_t<std::is_same<elementwise_tag<E, T, L>, element_tag>::value &&
+                       is_transpose<E>::value && same_type && L::strided,
+                       transpose_tag, elementwise_tag<E, T, L> > > > > >;
+};
+
+template<typename E, typename T, typename L>
+using eval_tag = typename eval_tag_of<E, T, L>::type;
+
+// order to walk an expression in when it's written to a matrix of layout L:
+// L's own when the operands share it, otherwise tile by tile, which keeps
+// both the reads and the writes within a few cache lines whatever the
+// layouts involved
+template<typename E, typename L>
+using traversal_layout = typename std::conditional<
+  std::is_same<typename E::layout, L>::value, L, tiled<> >::type;
+
+// temporaries the library evaluates subexpressions into, see scratch_pool
+template<typename T>
+using scratch_matrix = matrix<T, arena_allocator<T> >;
+
+template<typename T>
+using scratch_handle = std::shared_ptr<scratch_matrix<T> const>;
+
+// a product operand the way gemm reads it: strided memory
+template<typename T>
+struct dense_operand {
+  T const* data;
+  size_t rows, cols;
+  std::ptrdiff_t row_stride, col_stride;
+};
+
+template<typename T, typename A, typename L>
+typename std::enable_if<L::strided, dense_operand<T> >::type
+as_dense(matrix<T, A, L> const& m, scratch_handle<T>& holder);
+
+template<typename T, typename V, typename L>
+typename std::enable_if<std::is_same<typename std::remove_const<V>::type, T>::value,
+                        dense_operand<T> >::type
+as_dense(matrix_view<V, L> const& view, scratch_handle<T>& holder);
+
+template<typename T, typename E>
+dense_operand<T> as_dense(matrix_transpose<E> const& t, scratch_handle<T>& holder);
+
+template<typename T, size_t R, size_t C>
+dense_operand<T> as_dense(fixed_matrix<T, R, C> const& m, scratch_handle<T>& holder);
+
+template<typename T, bool Column, typename A>
+dense_operand<T> as_dense(basic_vector<T, Column, A> const& v, scratch_handle<T>& holder);
+
+template<typename T, typename E>
+dense_operand<T> as_dense(matrix_expr<E> const& expr,
+                          scratch_handle<T>& holder);
+
+template<typename T>
+void multiply_dense(T* dst, std::ptrdiff_t rs_c, std::ptrdiff_t cs_c,
+                    dense_operand<T> const& lhs, dense_operand<T> const& rhs,
+                    T alpha = T(1), T beta = T());
+
+template<typename T, typename E1, typename E2>
+void multiply_into(T* dst, std::ptrdiff_t rs_c, std::ptrdiff_t cs_c,
+                   E1 const& lhs, E2 const& rhs);
+
+// dst = lhs * rhs for operands of types E1 and E2, see multiply_into.
+// sparse.hpp specializes it for sparse operands.
+template<typename E1, typename E2, typename enable = void>
+struct product_kernel;
+
+// whether a product operand reads memory in [first, last)
+template<typename E, typename T>
+bool shares_storage(E const&, T const* first, T const* last);
+
+template<typename T, typename A, typename L>
+bool shares_storage(matrix<T, A, L> const& operand, T const* first, T const* last);
+
+template<typename V, typename L>
+bool shares_storage(matrix_view<V, L> const& operand,
+                    typename std::remove_const<V>::type const* first,
+                    typename std::remove_const<V>::type const* last);
+
+template<typename E, typename T>
+bool shares_storage(matrix_transpose<E> const& operand, T const* first, T const* last);
+
+template<typename T, size_t R, size_t C>
+bool shares_storage(fixed_matrix<T, R, C> const& operand, T const* first, T const* last);
+
+template<typename T, bool Column, typename A>
+bool shares_storage(basic_vector<T, Column, A> const& operand, T const* first, T const* last);
+
+template<typename T>
+void copy_strided(size_t rows, size_t cols, dense_operand<T> const& src,
+                  T* dst, std::ptrdiff_t rs_d, std::ptrdiff_t cs_d);
+
+// one past the last element of strided memory
+template<typename T>
+T const* dense_end(dense_operand<T> const& op) {
+  if (op.rows == 0 || op.cols == 0)
+    return op.data;
+  return op.data + (op.rows - 1) * op.row_stride + (op.cols - 1) * op.col_stride + 1;
+}
+
+// whether writing expr into dst (strided, shaped like expr) element by
+// element would read memory of dst other than the element being written,
+// possibly after it has been written: a shifted block of the same matrix, a
+// transpose of it. operands laid out exactly like dst only read the element
+// being written; under a transpose or an inline product nothing is read in
+// place. other products are materialized by prepare() before dst is
+// touched. in_place is false below such nodes.
+template<typename E, typename T>
+bool overlaps_elsewhere(E const&, dense_operand<T> const& dst, bool in_place);
+
+template<typename T, typename A, typename L>
+bool overlaps_elsewhere(matrix<T, A, L> const& operand, dense_operand<T> const& dst,
+                        bool in_place);
+
+template<typename V, typename L>
+bool overlaps_elsewhere(matrix_view<V, L> const& operand,
+                        dense_operand<typename std::remove_const<V>::type> const& dst,
+                        bool in_place);
+
+template<typename T, size_t R, size_t C>
+bool overlaps_elsewhere(fixed_matrix<T, R, C> const& operand, dense_operand<T> const& dst,
+                        bool in_place);
+
+template<typename T, bool Column, typename A>
+bool overlaps_elsewhere(basic_vector<T, Column, A> const& operand,
+                        dense_operand<T> const& dst, bool in_place);
+
+template<typename E1, typename E2, typename T>
+bool overlaps_elsewhere(matrix_sum<E1, E2> const& sum, dense_operand<T> const& dst,
+                        bool in_place);
+
+template<typename E1, typename E2, typename T>
+bool overlaps_elsewhere(matrix_sub<E1, E2> const& sub, dense_operand<T> const& dst,
+                        bool in_place);
+
+template<typename E1, typename E2, typename T>
+bool overlaps_elsewhere(matrix_prod<E1, E2> const& prod, dense_operand<T> const& dst,
+                        bool in_place);
+
+template<typename E, typename T>
+bool overlaps_elsewhere(matrix_transpose<E> const& t, dense_operand<T> const& dst,
+                        bool in_place);
+
+// whether expr is the strided memory dst itself, element for element, so
+// evaluating it into dst would leave dst as it is
+template<typename E, typename T>
+bool same_elements(E const&, dense_operand<T> const& dst);
+
+template<typename T, typename A, typename L>
+bool same_elements(matrix<T, A, L> const& operand, dense_operand<T> const& dst);
+
+template<typename V, typename L>
+bool same_elements(matrix_view<V, L> const& operand,
+                   dense_operand<typename std::remove_const<V>::type> const& dst);
+
+template<typename T, size_t R, size_t C>
+bool same_elements(fixed_matrix<T, R, C> const& operand, dense_operand<T> const& dst);
+
+template<typename T, bool Column, typename A>
+bool same_elements(basic_vector<T, Column, A> const& operand, dense_operand<T> const& dst);
+
+// the product of a gemm_expr as gemm reads it
+template<typename T>
+struct gemm_operands {
+  scratch_handle<T> lhs_holder, rhs_holder;
+  dense_operand<T> lhs, rhs;
+};
+
+// operands that are expressions are materialized, so this comes before the
+// destination is written
+template<typename T, typename E>
+gemm_operands<T> gemm_operands_of(E const& expr);
+
+// whether the operands of a gemm_expr's product read memory in [first,
+// last), which gemm can't write while it reads them
+template<typename T, typename E>
+bool gemm_reads(E const& expr, T const* first, T const* last);
+
+// dst = op(dst, expr) over lines [first, last) of a rows x cols array of
+// strided layout L whose lines start stride elements apart: whole packets
+// along each line, then single elements for its tail. linear expressions are
+// read by flat index, which in L counts inner elements per line with no
+// gaps, strided linear ones by position, anything else element by element.
+template<typename L, typename T, typename E, typename Op>
+void assign_lines(T* dst, size_t stride, size_t rows, size_t cols,
+                  size_t first, size_t last, E const& expr, Op const& op, linear_tag) {
+  using traits = packet_traits<T>;
+  size_t const inner = L::inner(rows, cols);
+  for (size_t o = first; o < last; o++) {
+    T* const line = dst + o * stride;
+    size_t const base = o * inner;
+    size_t k = 0;
+    for (; k + traits::lanes <= inner; k += traits::lanes)
+      traits::store(line + k, op(traits::load(line + k), expr.packet(base + k)));
+    for (; k < inner; k++)
+      line[k] = op(line[k], expr.at(base + k));
+  }
+}
+
+template<typename L, typename T, typename E, typename Op>
+void assign_lines(T* dst, size_t stride, size_t rows, size_t cols,
+                  size_t first, size_t last, E const& expr, Op const& op,
+                  strided_linear_tag) {
+  using traits = packet_traits<T>;
+  size_t const inner = L::inner(rows, cols);
+  for (size_t o = first; o < last; o++) {
+    T* const line = dst + o * stride;
+    size_t k = 0;
+    for (; k + traits::lanes <= inner; k += traits::lanes)
+      traits::store(line + k, op(traits::load(line + k),
+                                 expr.packet(L::row_at(o, k), L::col_at(o, k))));
+    for (; k < inner; k++)
+      line[k] = op(line[k], expr.at(L::row_at(o, k), L::col_at(o, k)));
+  }
+}
+
+template<typename L, typename T, typename E, typename Op>
+void assign_lines(T* dst, size_t stride, size_t rows, size_t cols,
+                  size_t first, size_t last, E const& expr, Op const& op, element_tag) {
+  size_t const inner = L::inner(rows, cols);
+  for (size_t o = first; o < last; o++) {
+    T* const line = dst + o * stride;
+    for (size_t k = 0; k < inner; k++)
+      line[k] = static_cast<T>(op(line[k], expr.at(L::row_at(o, k), L::col_at(o, k))));
+  }
+}
+
+} // namespace detail
+
+// elements are stored in a std::vector<T, Alloc>, in the order Layout puts
+// them (row by row by default, see layout.hpp); see allocators.hpp for
+// aligned, arena and pooled storage
+template<typename T, typename Alloc, typename Layout>
+class matrix : public matrix_expr<matrix<T, Alloc, Layout> > {
+private:
+  using matrix_expr<matrix<T, Alloc, Layout> >::num_rows_;
+  using matrix_expr<matrix<T, Alloc, Layout> >::num_cols_;
+  // using 1D vector gives contiguous memory, with some overhead
+  std::vector<T, Alloc> matrix_;
+
+  template<typename> friend class scratch_pool;
+
+  // evaluates expr into this matrix, reusing the storage it already has
+  template<typename E>
+  void evaluate(matrix_expr<E> const& expr) {
+    evaluate(static_cast<E const&>(expr), detail::eval_tag<E, T, Layout>());
+  }
+
+  // only allocates when the new shape doesn't fit the current capacity
+  void reshape(size_t rows, size_t cols) {
+    num_rows_ = rows;
+    num_cols_ = cols;
+    matrix_.resize(Layout::size(rows, cols));
+  }
+
+  // gemm writes C while it still reads A and B, so a product reading this
+  // matrix's storage directly (c = c * b) is computed aside and swapped in.
+  // operands that are expressions are materialized first and can't alias.
+  template<typename E>
+  void evaluate(E const& prod, detail::product_tag) {
+    T const* const first = matrix_.data();
+    T const* const last = first + matrix_.size();
+    if (detail::shares_storage(prod.lhs(), first, last) ||
+        detail::shares_storage(prod.rhs(), first, last)) {
+      matrix result(matrix_.get_allocator());
+      result.evaluate(prod, detail::product_tag());
+      swap(result);
+      return;
+    }
+    reshape(prod.num_rows(), prod.num_cols());
+    detail::multiply_into(matrix_.data(),
+                          Layout::row_stride(num_rows_, num_cols_),
+                          Layout::col_stride(num_rows_, num_cols_),
+                          prod.lhs(), prod.rhs());
+  }
+
+  // alpha * op(A) * op(B) + beta * C (see detail::gemm_expr) in one gemm
+  // call, which scales the product and adds it to beta * C as it writes
+  // each tile. C is evaluated into this matrix first, unless it is this
+  // matrix already (c = 2 * (a * b) + c); the operands of the product are
+  // materialized before that, as C may overwrite what they read. operands
+  // reading this matrix's storage send it through a temporary, as for
+  // products.
+  template<typename E>
+  void evaluate(E const& expr, detail::gemm_tag) {
+    using match = detail::gemm_expr<E, T>;
+    T const* const first = matrix_.data();
+    T const* const last = first + matrix_.size();
+    if (detail::gemm_reads(expr, first, last)) {
+      matrix result(matrix_.get_allocator());
+      result.evaluate(expr, detail::gemm_tag());
+      swap(result);
+      return;
+    }
+    detail::gemm_operands<T> const ops = detail::gemm_operands_of<T>(expr);
+    T const beta = gemm_term(expr, std::integral_constant<bool, match::accumulates>());
+    detail::multiply_dense(matrix_.data(), Layout::row_stride(num_rows_, num_cols_),
+                           Layout::col_stride(num_rows_, num_cols_),
+                           ops.lhs, ops.rhs, match::alpha(expr), beta);
+  }
+
+  // puts C in place for a gemm_expr and returns beta; without a C, the
+  // product overwrites whatever is there
+  template<typename E>
+  T gemm_term(E const& expr, std::true_type) {
+    using match = detail::gemm_expr<E, T>;
+    if (!detail::same_elements(match::c(expr), as_operand()))
+      evaluate(match::c(expr));
+    return match::beta(expr);
+  }
+
+  template<typename E>
+  T gemm_term(E const& expr, std::false_type) {
+    reshape(expr.num_rows(), expr.num_cols());
+    return T();
+  }
+
+  // a transpose whose operand is, or is materialized into, strided memory is
+  // a copy between strided arrays, usually a transpose of the arrays. a is
+  // transposed in place for a = transpose(a); other operands reading this
+  // matrix's storage go through a temporary.
+  template<typename E>
+  void evaluate(E const& t, detail::transpose_tag) {
+    T const* const first = matrix_.data();
+    T const* const last = first + matrix_.size();
+    if (static_cast<void const*>(&t.operand()) == this) {
+      transpose_in_place();
+      return;
+    }
+    if (detail::shares_storage(t, first, last)) {
+      matrix result(matrix_.get_allocator());
+      result.evaluate(t, detail::transpose_tag());
+      swap(result);
+      return;
+    }
+    detail::scratch_handle<T> holder;
+    detail::dense_operand<T> const src = detail::as_dense<T>(t, holder);
+    reshape(t.num_rows(), t.num_cols());
+    detail::copy_strided(num_rows_, num_cols_, src, matrix_.data(),
+                         Layout::row_stride(num_rows_, num_cols_),
+                         Layout::col_stride(num_rows_, num_cols_));
+  }
+
+  void transpose_in_place(std::true_type) {
+    ::transpose_in_place(matrix_.data(), Layout::outer(num_rows_, num_cols_),
+                         Layout::inner(num_rows_, num_cols_));
+    std::swap(num_rows_, num_cols_);
+  }
+
+  void transpose_in_place(std::false_type) {
+    matrix result(transpose(*this), matrix_.get_allocator());
+    swap(result);
+  }
+
+  // sparse operands: zeros, then the nonzeros
+  template<typename E>
+  void evaluate(E const& expr, detail::sparse_tag) {
+    reshape(expr.num_rows(), expr.num_cols());
+    std::fill(matrix_.begin(), matrix_.end(), T());
+    scatter(expr, [](auto, auto rhs) { return rhs; });
+  }
+
+  // the dense operand may be this matrix itself (a = a + s), which is
+  // already in place
+  template<typename E>
+  void evaluate(E const& sum, detail::sparse_sum_tag) {
+    using operands = detail::sparse_sum<E>;
+    auto const& dense = operands::dense(sum);
+    if (static_cast<void const*>(&dense) != this)
+      evaluate(dense);
+    if (operands::negate_dense)
+      for (T& elem : matrix_)
+        elem = -elem;
+    if (operands::subtract_sparse)
+      scatter(operands::sparse(sum), [](auto lhs, auto rhs) { return lhs - rhs; });
+    else
+      scatter(operands::sparse(sum), [](auto lhs, auto rhs) { return lhs + rhs; });
+  }
+
+  // element = op(element, value) for each nonzero of a sparse expr, in
+  // parallel over the rows (columns) it groups them by. each element is
+  // stored once, so no two threads write the same one.
+  template<typename E, typename Op>
+  void scatter(E const& expr, Op const& op) {
+    using traits = detail::sparse_traits<E>;
+    size_t const outer = traits::outer(expr);
+    size_t const rows = num_rows_, cols = num_cols_;
+    detail::for_each_row_range(outer, traits::nonzeros(expr) / std::max<size_t>(outer, 1) + 1,
+                               [this, &expr, &op, rows, cols](size_t first, size_t last) {
+      T* const dst = matrix_.data();
+      traits::for_each_nonzero(expr, first, last, [&](size_t i, size_t j, auto value) {
+        T& elem = dst[Layout::index(i, j, rows, cols)];
+        elem = static_cast<T>(op(elem, value));
+      });
+    });
+  }
+
+  // large results are split into ranges of rows (columns, tiles) evaluated
+  // in parallel. products inside expr are materialized before the storage is
+  // touched, as they may read this matrix; element-wise nodes only read the
+  // element being written, unless they read this matrix elsewhere (a = a +
+  // transpose(a), a shifted block of a): then expr is evaluated aside.
+  template<typename E, typename Tag>
+  void evaluate(E const& expr, Tag) {
+    if (reads_elsewhere(expr)) {
+      matrix result(matrix_.get_allocator());
+      result.evaluate(expr, Tag());
+      swap(result);
+      return;
+    }
+    detail::prepared<E> const scope(expr);
+    reshape(expr.num_rows(), expr.num_cols());
+    assign(expr, [](auto, auto rhs) { return rhs; }, Tag());
+  }
+
+  // see detail::overlaps_elsewhere
+  template<typename E>
+  bool reads_elsewhere(E const& expr) const {
+    return reads_elsewhere(expr, std::integral_constant<bool, Layout::strided>());
+  }
+
+  template<typename E>
+  bool reads_elsewhere(E const& expr, std::true_type) const {
+    return detail::overlaps_elsewhere(expr, as_operand(), true);
+  }
+
+  // this matrix as strided memory, for strided layouts
+  detail::dense_operand<T> as_operand() const {
+    return {matrix_.data(), num_rows_, num_cols_, Layout::row_stride(num_rows_, num_cols_),
+            Layout::col_stride(num_rows_, num_cols_)};
+  }
+
+  // other layouts can only be read by this matrix itself, or a transpose
+  // of it, so the storage is checked as one flat range
+  template<typename E>
+  bool reads_elsewhere(E const& expr, std::false_type) const {
+    size_t const size = matrix_.size();
+    return detail::overlaps_elsewhere(
+      expr, detail::dense_operand<T>{matrix_.data(), 1, size, std::ptrdiff_t(size), 1}, true);
+  }
+
+  // storage = op(storage, expr) one element at a time, walking expr in an
+  // order that suits both its layout and this matrix's
+  template<typename E, typename Op>
+  void assign(E const& expr, Op const& op, detail::element_tag) {
+    using order = detail::traversal_layout<E, Layout>;
+    size_t const rows = num_rows_, cols = num_cols_;
+    detail::for_each_row_range(order::outer(rows, cols), order::inner(rows, cols),
+                               [this, &expr, &op, rows, cols](size_t first, size_t last) {
+      T* const dst = matrix_.data();
+      order::for_each(rows, cols, first, last, [&](size_t i, size_t j) {
+        T& elem = dst[Layout::index(i, j, rows, cols)];
+        elem = static_cast<T>(op(elem, expr.at(i,j)));
+      });
+    });
+  }
+
+  // same for linear expressions, which share this matrix's layout: flat
+  // ranges of the storage, whole packets and then single elements for the
+  // tail. padding of tiled layouts is computed along with the rest.
+  template<typename E, typename Op>
+  void assign(E const& expr, Op const& op, detail::linear_tag) {
+    detail::for_each_row_range(matrix_.size(), 1,
+                               [this, &expr, &op](size_t first, size_t last) {
+      using traits = packet_traits<T>;
+      T* const dst = matrix_.data();
+      size_t i = first;
+      for (; i + traits::lanes <= last; i += traits::lanes)
+        traits::store(dst + i, op(traits::load(dst + i), expr.packet(i)));
+      for (; i < last; i++)
+        dst[i] = op(dst[i], expr.at(i));
+    });
+  }
+
+  // strided linear expressions of this layout: line by line, packets along
+  // each line read by position
+  template<typename E, typename Op>
+  void assign(E const& expr, Op const& op, detail::strided_linear_tag) {
+    size_t const rows = num_rows_, cols = num_cols_;
+    size_t const inner = Layout::inner(rows, cols);
+    detail::for_each_row_range(Layout::outer(rows, cols), inner,
+                               [this, &expr, &op, rows, cols, inner](size_t first, size_t last) {
+      detail::assign_lines<Layout>(matrix_.data(), inner, rows, cols, first, last,
+                                   expr, op, detail::strided_linear_tag());
+    });
+  }
+
+  // compound assignment: this = op(this, expr) in a single pass over the
+  // storage. aliasing is mostly harmless here: element-wise nodes only read
+  // the element being written, and products were materialized by prepare()
+  // before anything is written. expressions reading this matrix elsewhere
+  // are evaluated aside first.
+  template<typename E, typename Op>
+  matrix& update(matrix_expr<E> const& expr, Op const& op) {
+    assert(expr.num_rows() == num_rows_ && expr.num_cols() == num_cols_);
+    E const& derived = static_cast<E const&>(expr);
+    if (reads_elsewhere(derived)) {
+      matrix const copy(derived, matrix_.get_allocator());
+      return update(copy, op);
+    }
+    detail::prepared<E> const scope(derived);
+    update(derived, op, std::integral_constant<bool, detail::sparse_traits<E>::is_sparse>());
+    return *this;
+  }
+
+  // sparse operands only touch the elements they store
+  template<typename E, typename Op>
+  void update(E const& expr, Op const& op, std::true_type) {
+    scatter(expr, op);
+  }
+
+  template<typename E, typename Op>
+  void update(E const& expr, Op const& op, std::false_type) {
+    assign(expr, op, detail::elementwise_tag<E, T, Layout>());
+  }
+
+  // this += sign * expr. scaled products (see detail::scaled_product) go to
+  // gemm with beta = 1, which adds them to this matrix as it writes each
+  // tile, with no temporary for the product. anything else, and products
+  // reading this matrix's storage (c += c * b), goes through update.
+  template<typename E, typename Op>
+  matrix& accumulate(matrix_expr<E> const& expr, T sign, Op const& op) {
+    return accumulate(static_cast<E const&>(expr), sign, op, std::integral_constant<
+                        bool, detail::scaled_product<E, T>::value && Layout::strided>());
+  }
+
+  template<typename E, typename Op>
+  matrix& accumulate(E const& expr, T sign, Op const& op, std::true_type) {
+    assert(expr.num_rows() == num_rows_ && expr.num_cols() == num_cols_);
+    if (detail::gemm_reads(expr, matrix_.data(), matrix_.data() + matrix_.size()))
+      return update(expr, op);
+    detail::gemm_operands<T> const ops = detail::gemm_operands_of<T>(expr);
+    detail::multiply_dense(matrix_.data(), Layout::row_stride(num_rows_, num_cols_),
+                           Layout::col_stride(num_rows_, num_cols_), ops.lhs, ops.rhs,
+                           sign * detail::gemm_expr<E, T>::alpha(expr), T(1));
+    return *this;
+  }
+
+  template<typename E, typename Op>
+  matrix& accumulate(E const& expr, T, Op const& op, std::false_type) {
+    return update(expr, op);
+  }
+
+  // this = this * rhs, row-major. when rhs is square and doesn't read this
+  // matrix, rows are multiplied a block at a time through a temporary of one
+  // block; otherwise (rhs aliases this, or the shape changes) the product
+  // needs a full temporary that replaces the storage.
+  template<typename E>
+  matrix& multiply_in_place(E const& expr, std::true_type) {
+    detail::scratch_handle<T> holder;
+    detail::dense_operand<T> const rhs = detail::as_dense<T>(expr, holder);
+    assert(num_cols_ == rhs.rows);
+    size_t const n = rhs.cols;
+    T const* const first = matrix_.data();
+    T const* const rhs_last = rhs.rows == 0 || n == 0 ? rhs.data :
+      rhs.data + (rhs.rows - 1) * rhs.row_stride + (n - 1) * rhs.col_stride + 1;
+    bool const aliased = rhs.data < first + matrix_.size() && first < rhs_last;
+
+    if (aliased || n != num_cols_) {
+      matrix result(matrix_.get_allocator());
+      result.reshape(num_rows_, n);
+      detail::multiply_dense<T>(result.data(), n, 1,
+                                {first, num_rows_, num_cols_,
+                                 std::ptrdiff_t(num_cols_), 1}, rhs);
+      swap(result);
+      return *this;
+    }
+
+    static thread_local std::vector<T, aligned_allocator<T> > block_buf;
+    size_t const block = std::min(num_rows_, std::max<size_t>(
+                                    gemm_blocking::l2 / 2 / sizeof(T) / std::max<size_t>(n, 1), 1));
+    T* const tmp = detail::gemm_buffer(block_buf, block * n);
+    for (size_t r = 0; r < num_rows_; r += block) {
+      size_t const rows = std::min(block, num_rows_ - r);
+      T* const dst = matrix_.data() + r * n;
+      gemm(rows, n, n, T(1), dst, n, 1, rhs.data, rhs.row_stride, rhs.col_stride,
+           T(), tmp, n, 1);
+      std::copy(tmp, tmp + rows * n, dst);
+    }
+    return *this;
+  }
+
+  // other layouts go through a full temporary
+  template<typename E>
+  matrix& multiply_in_place(E const& expr, std::false_type) {
+    matrix result(matrix_.get_allocator());
+    result = *this * expr;
+    swap(result);
+    return *this;
+  }
+  
+public:  
+  static constexpr bool is_linear = true;
+  static constexpr bool is_strided_linear = Layout::strided;
+  using layout = Layout;
+
+  // could use a variety of different constructors
+  // from 1D or 2D containers, etc., but these are sufficient for now 
+
+  matrix() = default;
+
+  explicit matrix(Alloc const& alloc) : matrix_(alloc) {}
+  
+  // takes over data, which holds the elements in Layout's order (row by row
+  // by default). pass an rvalue to hand the buffer over without copying it
+  matrix(size_t rows, size_t columns, std::vector<T, Alloc> data)
+    : matrix_(std::move(data)) {
+    assert(matrix_.size() == Layout::size(rows, columns));
+    num_rows_ = rows;
+    num_cols_ = columns;
+  }
+      
+  // the following initializes a matrix from a list like so:
+  // matrix m = { {1, 2, 3}, {4, 5, 6}, {7, 8, 9} };
+  matrix(const std::initializer_list<std::initializer_list<T>> list) {
+    size_t cur_row = 0;
+    size_t cur_col = 0;
+    num_rows_ = list.size();
+    num_cols_ = list.begin()->size();
+
+    matrix_.resize(Layout::size(num_rows_, num_cols_));
+    
+    for (const auto& row : list) {
+      cur_col = 0;
+      assert(row.size() == num_cols_);
+        
+      for (const auto& elem : row) {
+        this->at(cur_row, cur_col) = elem;
+        cur_col++;
+      }
+      cur_row++;
+    }
+  }
+
+  T at(size_t row, size_t col) const {
+    assert(col <= this->num_cols_);
+    assert(row <= this->num_rows_);
+    return static_cast<T>(matrix_[Layout::index(row, col, num_rows_, num_cols_)]);
+  }
+
+  T& at(size_t row, size_t col) {
+    assert(col <= num_cols_);
+    assert(row <= num_rows_); 
+    return static_cast<T&>(matrix_[Layout::index(row, col, num_rows_, num_cols_)]);
+  }
+
+  T at(size_t i) const {
+    return matrix_[i];
+  }
+
+  packet_t<T> packet(size_t i) const {
+    return packet_traits<T>::load(matrix_.data() + i);
+  }
+
+  packet_t<T> packet(size_t row, size_t col) const {
+    return packet_traits<T>::load(matrix_.data() +
+                                  Layout::index(row, col, num_rows_, num_cols_));
+  }
+
+  T const* data() const {
+    return matrix_.data();
+  }
+
+  T* data() {
+    return matrix_.data();
+  }
+
+  // see max(expr) in reduce.hpp
+  T max() const {
+    return ::max(*this);
+  }
+      
+  
+  // writes expr straight into the existing storage, which is only
+  // reallocated when the shape grows past its capacity
+  template<typename E>
+  matrix& operator=(matrix_expr<E> const& expr) {
+    evaluate(expr);
+    return *this;
+  }
+
+  // hands the elements back out as a vector, leaving an empty matrix
+  std::vector<T, Alloc> release() {
+    num_rows_ = num_cols_ = 0;
+    return std::move(matrix_);
+  }
+
+  // transposes this matrix within its own storage: blocks are swapped
+  // across the diagonal when it is square, cycles followed otherwise
+  void transpose_in_place() {
+    transpose_in_place(std::integral_constant<bool, Layout::strided>());
+  }
+
+  void swap(matrix& other) {
+    std::swap(num_rows_, other.num_rows_);
+    std::swap(num_cols_, other.num_cols_);
+    matrix_.swap(other.matrix_);
+  }
+
+  // compound assignments update this matrix in place
+  template<typename E>
+  matrix& operator+=(matrix_expr<E> const& expr) {
+    return accumulate(expr, T(1), [](auto lhs, auto rhs) { return lhs + rhs; });
+  }
+
+  template<typename E>
+  matrix& operator-=(matrix_expr<E> const& expr) {
+    return accumulate(expr, T(-1), [](auto lhs, auto rhs) { return lhs - rhs; });
+  }
+
+  template<typename S>
+  typename std::enable_if<detail::is_scalar_operand<S>::value, matrix&>::type
+  operator*=(S const& scalar) {
+    return update(*this * scalar, [](auto, auto rhs) { return rhs; });
+  }
+
+  // matrix operands are materialized first if they are expressions, so only
+  // rhs reading this matrix's storage forces a full temporary
+  template<typename E>
+  matrix& operator*=(matrix_expr<E> const& expr) {
+    return multiply_in_place(static_cast<E const&>(expr),
+                             std::is_same<Layout, row_major>());
+  }
+
+  // ctor from any matrix_expr, forces evaluation.
+  // products of matrices are evaluated by the blocked gemm engine (or
+  // Strassen-Winograd, see multiply_into), linear expressions of this element
+  // type and layout a packet at a time, and anything else element by element.
+  template<typename E>
+  matrix(matrix_expr<E> const& expr) {   
+    evaluate(expr);
+  }
+
+  // same, with storage from alloc
+  template<typename E>
+  matrix(matrix_expr<E> const& expr, Alloc const& alloc) : matrix_(alloc) {
+    evaluate(expr);
+  }
+};
+
+// non-owning rows x cols matrix over memory someone else manages: an ingest
+// buffer, or part of a matrix (see block(), row(), col() and the slices
+// below). Layout, row_major or col_major, says which dimension is
+// contiguous; its lines (rows, or columns) start stride elements apart. it
+// takes part in expressions like a matrix: products read it in place through
+// gemm, element-wise expressions a packet at a time along each line. unless
+// T is const, expressions can be assigned to it, which writes them through to
+// the viewed memory. the memory must outlive the view.
+template<typename T, typename Layout>
+class matrix_view : public matrix_expr<matrix_view<T, Layout> > {
+  static_assert(Layout::strided, "views need a strided layout");
+  using value_type = typename std::remove_const<T>::type;
+  using matrix_expr<matrix_view<T, Layout> >::num_rows_;
+  using matrix_expr<matrix_view<T, Layout> >::num_cols_;
+  T* data_;
+  size_t stride_;
+
+  detail::dense_operand<value_type> as_operand() const {
+    return {data_, num_rows_, num_cols_, row_stride(), col_stride()};
+  }
+
+  // element = op(element, expr) through to the viewed memory. expressions
+  // that read it elsewhere than at the element being written (a shifted
+  // block of the same matrix, a transpose of the view) are evaluated aside
+  // first.
+  template<typename E, typename Op, typename Tag>
+  matrix_view& assign(E const& expr, Op const& op, Tag) {
+    static_assert(!std::is_const<T>::value, "assigning to a view of const elements");
+    assert(expr.num_rows() == num_rows_ && expr.num_cols() == num_cols_);
+    if (detail::overlaps_elsewhere(expr, as_operand(), true)) {
+      using copy_type = matrix<value_type, aligned_allocator<value_type>, Layout>;
+      copy_type const copy(expr);
+      return assign(copy, op, detail::elementwise_tag<copy_type, value_type, Layout>());
+    }
+    evaluate(expr, op, Tag());
+    return *this;
+  }
+
+  // products go straight to gemm with this view's strides, through a
+  // temporary when an operand reads the viewed memory
+  template<typename E, typename Op>
+  void evaluate(E const& prod, Op const&, detail::product_tag) {
+    value_type const* const first = data_;
+    value_type const* const last = detail::dense_end(as_operand());
+    if (detail::shares_storage(prod.lhs(), first, last) ||
+        detail::shares_storage(prod.rhs(), first, last)) {
+      detail::scratch_handle<value_type> const result =
+        scratch_pool<value_type>::local().evaluate(prod);
+      detail::copy_strided<value_type>(num_rows_, num_cols_,
+                                       {result->data(), num_rows_, num_cols_,
+                                        std::ptrdiff_t(num_cols_), 1},
+                                       data_, row_stride(), col_stride());
+      return;
+    }
+    detail::multiply_into(data_, row_stride(), col_stride(), prod.lhs(), prod.rhs());
+  }
+
+  // alpha * op(A) * op(B) + beta * C in one gemm call, as for matrix
+  template<typename E, typename Op>
+  void evaluate(E const& expr, Op const&, detail::gemm_tag) {
+    using match = detail::gemm_expr<E, value_type>;
+    if (detail::gemm_reads(expr, static_cast<value_type const*>(data_),
+                           detail::dense_end(as_operand()))) {
+      detail::scratch_handle<value_type> const result =
+        scratch_pool<value_type>::local().evaluate(expr);
+      detail::copy_strided<value_type>(num_rows_, num_cols_,
+                                       {result->data(), num_rows_, num_cols_,
+                                        std::ptrdiff_t(num_cols_), 1},
+                                       data_, row_stride(), col_stride());
+      return;
+    }
+    detail::gemm_operands<value_type> const ops =
+      detail::gemm_operands_of<value_type>(expr);
+    value_type const beta =
+      gemm_term(expr, std::integral_constant<bool, match::accumulates>());
+    detail::multiply_dense(data_, row_stride(), col_stride(), ops.lhs, ops.rhs,
+                           match::alpha(expr), beta);
+  }
+
+  template<typename E>
+  value_type gemm_term(E const& expr, std::true_type) {
+    using match = detail::gemm_expr<E, value_type>;
+    if (!detail::same_elements(match::c(expr), as_operand()))
+      *this = match::c(expr);
+    return match::beta(expr);
+  }
+
+  template<typename E>
+  value_type gemm_term(E const&, std::false_type) {
+    return value_type();
+  }
+
+  // element += sign * expr, scaled products through gemm with beta = 1 (see
+  // matrix::accumulate)
+  template<typename E, typename Op>
+  matrix_view& accumulate(E const& expr, value_type sign, Op const& op, std::true_type) {
+    static_assert(!std::is_const<T>::value, "assigning to a view of const elements");
+    assert(expr.num_rows() == num_rows_ && expr.num_cols() == num_cols_);
+    if (detail::gemm_reads(expr, static_cast<value_type const*>(data_),
+                           detail::dense_end(as_operand())))
+      return accumulate(expr, sign, op, std::false_type());
+    detail::gemm_operands<value_type> const ops =
+      detail::gemm_operands_of<value_type>(expr);
+    detail::multiply_dense(data_, row_stride(), col_stride(), ops.lhs, ops.rhs,
+                           sign * detail::gemm_expr<E, value_type>::alpha(expr),
+                           value_type(1));
+    return *this;
+  }
+
+  template<typename E, typename Op>
+  matrix_view& accumulate(E const& expr, value_type, Op const& op, std::false_type) {
+    return assign(expr, op, detail::elementwise_tag<E, value_type, Layout>());
+  }
+
+  // a transpose is a copy between strided arrays, usually a transpose of the
+  // arrays (see matrix)
+  template<typename E, typename Op>
+  void evaluate(E const& t, Op const&, detail::transpose_tag) {
+    detail::scratch_handle<value_type> holder;
+    detail::copy_strided(num_rows_, num_cols_, detail::as_dense<value_type>(t, holder),
+                         data_, row_stride(), col_stride());
+  }
+
+  // anything else line by line, in parallel for large views: a packet at a
+  // time for linear and strided linear expressions of this layout, element
+  // by element otherwise
+  template<typename E, typename Op, typename Tag>
+  void evaluate(E const& expr, Op const& op, Tag) {
+    using tag = std::conditional_t<std::is_same<Tag, detail::linear_tag>::value ||
+                                   std::is_same<Tag, detail::strided_linear_tag>::value,
+                                   Tag, detail::element_tag>;
+    detail::prepared<E> const scope(expr);
+    size_t const rows = num_rows_, cols = num_cols_;
+    detail::for_each_row_range(Layout::outer(rows, cols), Layout::inner(rows, cols),
+                               [this, &expr, &op, rows, cols](size_t first, size_t last) {
+      detail::assign_lines<Layout>(data_, stride_, rows, cols, first, last,
+                                   expr, op, tag());
+    });
+  }
+
+public:
+  static constexpr bool is_strided_linear = true;
+  using layout = Layout;
+
+  matrix_view(T* data, size_t rows, size_t cols)
+    : matrix_view(data, rows, cols, Layout::inner(rows, cols)) {}
+
+  matrix_view(T* data, size_t rows, size_t cols, size_t stride)
+    : data_(data), stride_(stride) {
+    assert(stride >= Layout::inner(rows, cols) || Layout::outer(rows, cols) <= 1);
+    num_rows_ = rows;
+    num_cols_ = cols;
+  }
+
+  matrix_view(matrix_view const&) = default;
+
+  // a view of T is also a read-only view of T const
+  template<typename U, typename = typename std::enable_if<
+                         std::is_same<T, U const>::value && !std::is_same<T, U>::value>::type>
+  matrix_view(matrix_view<U, Layout> const& other)
+    : matrix_view(other.data(), other.num_rows(), other.num_cols(), other.stride()) {}
+
+  value_type at(size_t row, size_t col) const {
+    assert(row < num_rows_ && col < num_cols_);
+    return data_[row * row_stride() + col * col_stride()];
+  }
+
+  T& at(size_t row, size_t col) {
+    assert(row < num_rows_ && col < num_cols_);
+    return data_[row * row_stride() + col * col_stride()];
+  }
+
+  packet_t<value_type> packet(size_t row, size_t col) const {
+    return packet_traits<value_type>::load(data_ + row * row_stride() + col * col_stride());
+  }
+
+  T* data() const {
+    return data_;
+  }
+
+  // distance between the starts of consecutive lines
+  size_t stride() const {
+    return stride_;
+  }
+
+  std::ptrdiff_t row_stride() const {
+    return std::is_same<Layout, row_major>::value ? stride_ : 1;
+  }
+
+  std::ptrdiff_t col_stride() const {
+    return std::is_same<Layout, row_major>::value ? 1 : stride_;
+  }
+
+  // the rows x cols elements from (row, col) on
+  matrix_view block(size_t row, size_t col, size_t rows, size_t cols) const {
+    assert(row + rows <= num_rows_ && col + cols <= num_cols_);
+    return matrix_view(data_ + row * row_stride() + col * col_stride(), rows, cols, stride_);
+  }
+
+  matrix_view row(size_t i) const {
+    return block(i, 0, 1, num_cols_);
+  }
+
+  matrix_view col(size_t j) const {
+    return block(0, j, num_rows_, 1);
+  }
+
+  // count rows from first on, step rows apart. only the lines of a view can
+  // be spaced out like this, which leaves each of them contiguous: rows of
+  // a row-major view, columns of a column-major one (col_slice).
+  matrix_view row_slice(size_t first, size_t count, size_t step = 1) const {
+    static_assert(std::is_same<Layout, row_major>::value,
+                  "rows of a column-major view aren't contiguous");
+    assert(count == 0 || first + (count - 1) * step < num_rows_);
+    return matrix_view(data_ + first * stride_, count, num_cols_, stride_ * step);
+  }
+
+  matrix_view col_slice(size_t first, size_t count, size_t step = 1) const {
+    static_assert(std::is_same<Layout, col_major>::value,
+                  "columns of a row-major view aren't contiguous");
+    assert(count == 0 || first + (count - 1) * step < num_cols_);
+    return matrix_view(data_ + first * stride_, num_rows_, count, stride_ * step);
+  }
+
+  // writes expr through to the viewed elements, block(a, 0, 0, 2, 2) = b * c
+  template<typename E>
+  matrix_view& operator=(matrix_expr<E> const& expr) {
+    return assign(static_cast<E const&>(expr), [](auto, auto rhs) { return rhs; },
+                  detail::eval_tag<E, value_type, Layout>());
+  }
+
+  // assigning a view copies the elements, like any other expression; it
+  // doesn't rebind the view
+  matrix_view& operator=(matrix_view const& other) {
+    return *this = static_cast<matrix_expr<matrix_view> const&>(other);
+  }
+
+  template<typename E>
+  matrix_view& operator+=(matrix_expr<E> const& expr) {
+    return accumulate(static_cast<E const&>(expr), value_type(1),
+                      [](auto lhs, auto rhs) { return lhs + rhs; },
+                      std::integral_constant<
+                        bool, detail::scaled_product<E, value_type>::value>());
+  }
+
+  template<typename E>
+  matrix_view& operator-=(matrix_expr<E> const& expr) {
+    return accumulate(static_cast<E const&>(expr), value_type(-1),
+                      [](auto lhs, auto rhs) { return lhs - rhs; },
+                      std::integral_constant<
+                        bool, detail::scaled_product<E, value_type>::value>());
+  }
+
+  template<typename S>
+  typename std::enable_if<detail::is_scalar_operand<S>::value, matrix_view&>::type
+  operator*=(S const& scalar) {
+    auto const scaled = *this * scalar;
+    return assign(scaled, [](auto, auto rhs) { return rhs; },
+                  detail::elementwise_tag<decltype(scaled), value_type, Layout>());
+  }
+};
+
+// the whole of a matrix as a view, which parts of it are taken from:
+//   block(a, 0, 0, 2, 2) = b * c;
+//   row(a, 3) += row(a, 0) * 2.0;
+//   d = transpose(col(a, 1)) * block(a, 0, 2, n, 4);
+// views of const matrices are read-only. temporaries have none, their views
+// would dangle.
+template<typename T, typename A, typename L>
+matrix_view<T, L> view(matrix<T, A, L>& m) {
+  return {m.data(), m.num_rows(), m.num_cols()};
+}
+
+template<typename T, typename A, typename L>
+matrix_view<T const, L> view(matrix<T, A, L> const& m) {
+  return {m.data(), m.num_rows(), m.num_cols()};
+}
+
+template<typename T, typename A, typename L>
+void view(matrix<T, A, L>&&) = delete;
+
+template<typename T, typename L>
+matrix_view<T, L> view(matrix_view<T, L> const& v) {
+  return v;
+}
+
+template<typename M>
+auto block(M&& m, size_t row, size_t col, size_t rows, size_t cols) {
+  return view(std::forward<M>(m)).block(row, col, rows, cols);
+}
+
+template<typename M>
+auto row(M&& m, size_t i) {
+  return view(std::forward<M>(m)).row(i);
+}
+
+template<typename M>
+auto col(M&& m, size_t j) {
+  return view(std::forward<M>(m)).col(j);
+}
+
+template<typename M>
+auto row_slice(M&& m, size_t first, size_t count, size_t step = 1) {
+  return view(std::forward<M>(m)).row_slice(first, count, step);
+}
+
+template<typename M>
+auto col_slice(M&& m, size_t first, size_t count, size_t step = 1) {
+  return view(std::forward<M>(m)).col_slice(first, count, step);
+}
+
+// dst = expr for a dst already shaped like expr: never allocates, apart from
+// the temporary a product needs when dst is one of its own operands
+template<typename T, typename A, typename L, typename E>
+matrix<T, A, L>& eval_into(matrix<T, A, L>& dst, matrix_expr<E> const& expr) {
+  assert(dst.num_rows() == expr.num_rows() && dst.num_cols() == expr.num_cols());
+  return dst = expr;
+}
+
+// temporaries for materialized subexpressions and partial reductions, one
+// pool per thread and element type. their storage is bumped from an arena of
+// the pool's own (see allocators.hpp), which is reset once none of them is
+// alive any more: each evaluation reuses the blocks the previous one used
+// rather than going to the allocator, and no temporary outlives the
+// evaluation that made it to hold on to its storage. they are handed out
+// through shared pointers that own the pool, so they may outlive the thread
+// that made them and be dropped on any thread; only the pool's own thread
+// allocates from the arena or resets it.
+template<typename T>
+class scratch_pool : public std::enable_shared_from_this<scratch_pool<T> > {
+  using matrix_type = detail::scratch_matrix<T>;
+
+  arena arena_;
+  // temporaries not dropped yet, on whatever thread
+  std::atomic<size_t> live_{0};
+
+public:
+  static scratch_pool& local() {
+    thread_local std::shared_ptr<scratch_pool> const pool = std::make_shared<scratch_pool>();
+    return *pool;
+  }
+
+  // a rows x cols temporary for the caller to fill
+  std::shared_ptr<matrix_type> acquire(size_t rows, size_t cols) {
+    if (live_.load(std::memory_order_acquire) == 0)
+      arena_.reset();
+    std::unique_ptr<matrix_type> m(new matrix_type(arena_allocator<T>(arena_)));
+    m->reshape(rows, cols);
+    std::shared_ptr<scratch_pool> const pool = this->shared_from_this();
+    live_++;
+    return std::shared_ptr<matrix_type>(m.release(), [pool](matrix_type* p) {
+      delete p;
+      pool->live_.fetch_sub(1, std::memory_order_release);
+    });
+  }
+
+  template<typename E>
+  detail::scratch_handle<T> evaluate(matrix_expr<E> const& expr) {
+    std::shared_ptr<matrix_type> const m = acquire(0, 0);
+    m->evaluate(expr);
+    return m;
+  }
+
+  // bytes the arena holds, in use or not
+  size_t capacity() const {
+    return arena_.capacity();
+  }
+};
+
+namespace detail {
+
+// operand of a product as strided memory of element type T: matrices with a
+// strided layout and views of that type are read in place, anything else is
+// evaluated into a row-major temporary from the scratch pool kept alive by
+// holder
+template<typename T, typename A, typename L>
+typename std::enable_if<L::strided, dense_operand<T> >::type
+as_dense(matrix<T, A, L> const& m, scratch_handle<T>&) {
+  return {m.data(), m.num_rows(), m.num_cols(),
+          L::row_stride(m.num_rows(), m.num_cols()),
+          L::col_stride(m.num_rows(), m.num_cols())};
+}
+
+template<typename T, typename V, typename L>
+typename std::enable_if<std::is_same<typename std::remove_const<V>::type, T>::value,
+                        dense_operand<T> >::type
+as_dense(matrix_view<V, L> const& view, scratch_handle<T>&) {
+  return {view.data(), view.num_rows(), view.num_cols(),
+          view.row_stride(), view.col_stride()};
+}
+
+// a transpose is its operand read with the strides swapped, so a product
+// with transposed operands never moves an element
+template<typename T, typename E>
+dense_operand<T> as_dense(matrix_transpose<E> const& t, scratch_handle<T>& holder) {
+  dense_operand<T> const op = as_dense<T>(t.operand(), holder);
+  return {op.data, op.cols, op.rows, op.col_stride, op.row_stride};
+}
+
+template<typename T, typename E>
+dense_operand<T> as_dense(matrix_expr<E> const& expr,
+                          scratch_handle<T>& holder) {
+  holder = scratch_pool<T>::local().evaluate(expr);
+  return as_dense<T>(*holder, holder);
+}
 
-public:
-  size_t num_rows() const {
-    return num_rows_;
+// C = alpha * lhs * rhs + beta * C with C at dst with strides rs_c and
+// cs_c, through gemm or, for large square row-major products once enabled
+// (and without scaling or accumulation), Strassen-Winograd. products with a
+// vector, a single column of rhs or row of lhs, go to gemv. a column-major C
+// is computed as C' = rhs' * lhs', which writes it row by row. C is not read
+// when beta is zero.
+template<typename T>
+void multiply_dense(T* dst, std::ptrdiff_t rs_c, std::ptrdiff_t cs_c,
+                    dense_operand<T> const& lhs, dense_operand<T> const& rhs,
+                    T alpha, T beta) {
+  if (rhs.cols == 1) {
+    gemv(lhs.rows, lhs.cols, alpha, lhs.data, lhs.row_stride, lhs.col_stride,
+         rhs.data, rhs.row_stride, beta, dst, rs_c);
+    return;
+  }
+  if (lhs.rows == 1) {
+    gemv(rhs.cols, rhs.rows, alpha, rhs.data, rhs.col_stride, rhs.row_stride,
+         lhs.data, lhs.col_stride, beta, dst, cs_c);
+    return;
   }
 
-  size_t num_cols() const {
-    return num_cols_;
+  if (cs_c != 1 && rs_c == 1) {
+    multiply_dense<T>(dst, cs_c, rs_c,
+                      {rhs.data, rhs.cols, rhs.rows, rhs.col_stride, rhs.row_stride},
+                      {lhs.data, lhs.cols, lhs.rows, lhs.col_stride, lhs.row_stride},
+                      alpha, beta);
+    return;
   }
 
-  // at() will be called on each individual part of expr, to evaluate.
-  // this parent at() calls derived at()
-  auto at(size_t row, size_t col) const{ 
-    return static_cast<E const&>(*this).at(row,col);
+  if (alpha == T(1) && beta == T() &&
+      lhs.rows == rhs.cols && lhs.cols == lhs.rows &&
+      lhs.rows >= strassen_settings().min_size &&
+      lhs.col_stride == 1 && rhs.col_stride == 1 && cs_c == 1) {
+    strassen_gemm(lhs.rows, lhs.data, size_t(lhs.row_stride),
+                  rhs.data, size_t(rhs.row_stride), dst, size_t(rs_c));
+    return;
   }
-  
-  friend std::ostream& operator<<(std::ostream& stream, const matrix_expr<E> & expr)  {
-    if (expr.num_rows() == 0)
-      return stream;
 
-    for (size_t i = 0; i < expr.num_rows(); i++) {
-      for (size_t j = 0; j < expr.num_cols(); j++) {
-        stream << expr.at(i,j) << ' '; 
+  gemm(lhs.rows, rhs.cols, lhs.cols, alpha,
+       lhs.data, lhs.row_stride, lhs.col_stride,
+       rhs.data, rhs.row_stride, rhs.col_stride,
+       beta, dst, rs_c, cs_c);
+}
+
+// C (rows x cols, rs_c, unit column stride) = lhs * rhs for an inner
+// dimension K known at compile time, and the width N too when it is, e.g. a
+// tall N x 4 operand times a 4 x 4 transform (see fixed.hpp). gemm would pack
+// both operands and pad K and N up to its micro-tile; here each row of C is
+// one pass over the K rows of rhs, with K unrolled and no tail when N is
+// known. rhs has unit column stride. parallel over rows.
+template<size_t K, size_t N, typename T>
+void multiply_narrow(T* dst, std::ptrdiff_t rs_c, dense_operand<T> const& lhs,
+                     dense_operand<T> const& rhs) {
+  assert(lhs.cols == K && rhs.col_stride == 1);
+  size_t const cols = N == dynamic_extent ? rhs.cols : N;
+  for_each_row_range(lhs.rows, cols * K, [&](size_t first, size_t last) {
+    for (size_t i = first; i < last; i++) {
+      T a[K];
+#pragma GCC unroll 16
+      for (size_t k = 0; k < K; k++)
+        a[k] = lhs.data[i * lhs.row_stride + k * lhs.col_stride];
+      T* const c = dst + i * rs_c;
+      for (size_t j = 0; j < cols; j++) {
+        T sum = T();
+#pragma GCC unroll 16
+        for (size_t k = 0; k < K; k++)
+          sum += a[k] * rhs.data[k * rhs.row_stride + j];
+        c[j] = sum;
       }
-      stream << '\n';
     }
-    return stream;
-  }
-};
+  });
+}
 
-template<typename T>
-class matrix : public matrix_expr<matrix<T> > {
-private:
-  using matrix_expr<matrix<T> >::num_rows_;
-  using matrix_expr<matrix<T> >::num_cols_;
-  // using 1D vector gives contiguous memory, with some overhead
-  std::vector<T> matrix_;
-  
-public:  
-  // could use a variety of different constructors
-  // from 1D or 2D containers, etc., but these are sufficient for now 
+// operands that are expressions themselves, products included, are
+// materialized first, so nested products cost one gemm each instead of a dot
+// product per read. shallow inner dimensions known at compile time go
+// through multiply_narrow instead of gemm.
+template<typename E1, typename E2, typename enable>
+struct product_kernel {
+  static constexpr size_t depth = E1::static_cols;
+  using narrow = std::integral_constant<bool, depth != dynamic_extent &&
+                                              depth <= max_narrow_depth>;
 
-  matrix<T>() = default;
-  
-  matrix<T>(size_t rows, size_t columns, std::vector<T> data) : matrix_(data) {
-    num_rows_ = rows;
-    num_cols_ = columns;
+  template<typename T>
+  static void multiply(T* dst, std::ptrdiff_t rs_c, std::ptrdiff_t cs_c,
+                       E1 const& lhs, E2 const& rhs) {
+    scratch_handle<T> lhs_holder, rhs_holder;
+    multiply(dst, rs_c, cs_c, as_dense<T>(lhs, lhs_holder),
+             as_dense<T>(rhs, rhs_holder), narrow());
   }
-      
-  // the following initializes a matrix from a list like so:
-  // matrix m = { {1, 2, 3}, {4, 5, 6}, {7, 8, 9} };
-  matrix<T>(const std::initializer_list<std::initializer_list<T>> list) {
-    size_t cur_row = 0;
-    size_t cur_col = 0;
-    num_rows_ = list.size();
-    num_cols_ = list.begin()->size();
 
-    matrix_.resize(num_rows_* num_cols_);
-    
-    for (const auto& row : list) {
-      cur_col = 0;
-      assert(row.size() == num_cols_);
-        
-      for (const auto& elem : row) {
-        this->at(cur_row, cur_col) = elem;
-        cur_col++;
-      }
-      cur_row++;
-    }
+  template<typename T>
+  static void multiply(T* dst, std::ptrdiff_t rs_c, std::ptrdiff_t cs_c,
+                       dense_operand<T> const& lhs, dense_operand<T> const& rhs,
+                       std::true_type) {
+    if (cs_c == 1 && rhs.col_stride == 1)
+      multiply_narrow<depth, E2::static_cols>(dst, rs_c, lhs, rhs);
+    else
+      multiply_dense(dst, rs_c, cs_c, lhs, rhs);
   }
 
-  T at(size_t row, size_t col) const {
-    assert(col <= this->num_cols_);
-    assert(row <= this->num_rows_);
-    return static_cast<T>(matrix_[row * num_cols_ + col]);
+  template<typename T>
+  static void multiply(T* dst, std::ptrdiff_t rs_c, std::ptrdiff_t cs_c,
+                       dense_operand<T> const& lhs, dense_operand<T> const& rhs,
+                       std::false_type) {
+    multiply_dense(dst, rs_c, cs_c, lhs, rhs);
   }
+};
 
-  T& at(size_t row, size_t col) {
-    assert(col <= num_cols_);
-    assert(row <= num_rows_); 
-    return static_cast<T&>(matrix_[row * num_cols_ + col]);
-  }
+template<typename T, typename E1, typename E2>
+void multiply_into(T* dst, std::ptrdiff_t rs_c, std::ptrdiff_t cs_c,
+                   E1 const& lhs, E2 const& rhs) {
+  product_kernel<E1, E2>::multiply(dst, rs_c, cs_c, lhs, rhs);
+}
 
-  T max() { // uses generic lambda
-    T max_val = matrix_[0];
-    for_each(matrix_.begin(),matrix_.end(), [&max_val](auto cur_val) {
-        max_val = max_val > cur_val ? max_val : cur_val;
-      });
-    return max_val;
+template<typename T, typename E>
+gemm_operands<T> gemm_operands_of(E const& expr) {
+  using scaled = typename gemm_expr<E, T>::scaled;
+  auto const& prod = scaled::product(gemm_expr<E, T>::product_term(expr));
+  gemm_operands<T> ops;
+  dense_operand<T> const a = as_dense<T>(prod.lhs(), ops.lhs_holder);
+  dense_operand<T> const b = as_dense<T>(prod.rhs(), ops.rhs_holder);
+  if (scaled::transposed) {
+    ops.lhs = {b.data, b.cols, b.rows, b.col_stride, b.row_stride};
+    ops.rhs = {a.data, a.cols, a.rows, a.col_stride, a.row_stride};
+  } else {
+    ops.lhs = a;
+    ops.rhs = b;
   }
-      
-  
-  // ctor from any matrix_expr, forces evaluation
-  template<typename E>
-  matrix<T>(matrix_expr<E> const& expr) {   
-    num_rows_ = expr.num_rows();
-    num_cols_ = expr.num_cols();
-    matrix_.resize(num_rows_ * num_cols_);
-    
-    for (size_t i = 0; i < num_rows_; i++) 
-      for (size_t j = 0; j < num_cols_; j++)
-        matrix_[i * num_cols_ + j] = static_cast<T>(expr.at(i,j));
+  return ops;
+}
+
+template<typename T, typename E>
+bool gemm_reads(E const& expr, T const* first, T const* last) {
+  auto const& prod = gemm_expr<E, T>::scaled::product(gemm_expr<E, T>::product_term(expr));
+  return shares_storage(prod.lhs(), first, last) || shares_storage(prod.rhs(), first, last);
+}
+
+template<typename E, typename T>
+bool shares_storage(E const&, T const*, T const*) {
+  return false;
+}
+
+template<typename T, typename A, typename L>
+bool shares_storage(matrix<T, A, L> const& operand, T const* first, T const* last) {
+  T const* const data = operand.data();
+  return data < last && first < data + L::size(operand.num_rows(), operand.num_cols());
+}
+
+template<typename V, typename L>
+bool shares_storage(matrix_view<V, L> const& operand,
+                    typename std::remove_const<V>::type const* first,
+                    typename std::remove_const<V>::type const* last) {
+  scratch_handle<typename std::remove_const<V>::type> none;
+  auto const op = as_dense(operand, none);
+  return op.data < last && first < dense_end(op);
+}
+
+template<typename E, typename T>
+bool shares_storage(matrix_transpose<E> const& operand, T const* first, T const* last) {
+  return shares_storage(operand.operand(), first, last);
+}
+
+template<typename T>
+bool same_elements(dense_operand<T> const& src, dense_operand<T> const& dst) {
+  return src.data == dst.data && src.rows == dst.rows && src.cols == dst.cols &&
+         (src.row_stride == dst.row_stride || src.rows <= 1) &&
+         (src.col_stride == dst.col_stride || src.cols <= 1);
+}
+
+template<typename E, typename T>
+bool same_elements(E const&, dense_operand<T> const&) {
+  return false;
+}
+
+template<typename T, typename A, typename L>
+bool same_elements(matrix<T, A, L> const& operand, dense_operand<T> const& dst,
+                   std::true_type) {
+  scratch_handle<T> none;
+  return same_elements(as_dense(operand, none), dst);
+}
+
+template<typename T, typename A, typename L>
+bool same_elements(matrix<T, A, L> const&, dense_operand<T> const&, std::false_type) {
+  return false;
+}
+
+template<typename T, typename A, typename L>
+bool same_elements(matrix<T, A, L> const& operand, dense_operand<T> const& dst) {
+  return same_elements(operand, dst, std::integral_constant<bool, L::strided>());
+}
+
+template<typename V, typename L>
+bool same_elements(matrix_view<V, L> const& operand,
+                   dense_operand<typename std::remove_const<V>::type> const& dst) {
+  scratch_handle<typename std::remove_const<V>::type> none;
+  return same_elements(as_dense(operand, none), dst);
+}
+
+// leaves read dst in place only when they are dst, element for element
+template<typename T>
+bool overlaps_elsewhere(dense_operand<T> const& src, dense_operand<T> const& dst,
+                        bool in_place) {
+  if (in_place && same_elements(src, dst))
+    return false;
+  return src.data < dense_end(dst) && dst.data < dense_end(src);
+}
+
+template<typename E, typename T>
+bool overlaps_elsewhere(E const&, dense_operand<T> const&, bool) {
+  return false;
+}
+
+template<typename T, typename A, typename L>
+bool overlaps_elsewhere(matrix<T, A, L> const& operand, dense_operand<T> const& dst,
+                        bool in_place, std::true_type) {
+  size_t const rows = operand.num_rows(), cols = operand.num_cols();
+  return overlaps_elsewhere(dense_operand<T>{operand.data(), rows, cols,
+                                             L::row_stride(rows, cols),
+                                             L::col_stride(rows, cols)},
+                            dst, in_place);
+}
+
+// tiled matrices aren't strided: read in place, one is only read at the
+// element being written when it is dst, any other overlap counts
+template<typename T, typename A, typename L>
+bool overlaps_elsewhere(matrix<T, A, L> const& operand, dense_operand<T> const& dst,
+                        bool in_place, std::false_type) {
+  T const* const data = operand.data();
+  if (in_place && data == dst.data)
+    return false;
+  return data < dense_end(dst) &&
+         dst.data < data + L::size(operand.num_rows(), operand.num_cols());
+}
+
+template<typename T, typename A, typename L>
+bool overlaps_elsewhere(matrix<T, A, L> const& operand, dense_operand<T> const& dst,
+                        bool in_place) {
+  return overlaps_elsewhere(operand, dst, in_place,
+                            std::integral_constant<bool, L::strided>());
+}
+
+template<typename V, typename L>
+bool overlaps_elsewhere(matrix_view<V, L> const& operand,
+                        dense_operand<typename std::remove_const<V>::type> const& dst,
+                        bool in_place) {
+  scratch_handle<typename std::remove_const<V>::type> none;
+  return overlaps_elsewhere(as_dense(operand, none), dst, in_place);
+}
+
+template<typename E1, typename E2, typename T>
+bool overlaps_elsewhere(matrix_sum<E1, E2> const& sum, dense_operand<T> const& dst,
+                        bool in_place) {
+  return overlaps_elsewhere(sum.lhs(), dst, in_place) ||
+         overlaps_elsewhere(sum.rhs(), dst, in_place);
+}
+
+template<typename E1, typename E2, typename T>
+bool overlaps_elsewhere(matrix_sub<E1, E2> const& sub, dense_operand<T> const& dst,
+                        bool in_place) {
+  return overlaps_elsewhere(sub.lhs(), dst, in_place) ||
+         overlaps_elsewhere(sub.rhs(), dst, in_place);
+}
+
+template<typename E1, typename E2, typename T>
+bool overlaps_elsewhere(matrix_prod<E1, E2> const& prod, dense_operand<T> const& dst,
+                        bool in_place, std::integral_constant<int, 0>) { // scalar * matrix
+  return overlaps_elsewhere(prod.rhs(), dst, in_place);
+}
+
+template<typename E1, typename E2, typename T>
+bool overlaps_elsewhere(matrix_prod<E1, E2> const& prod, dense_operand<T> const& dst,
+                        bool in_place, std::integral_constant<int, 1>) { // matrix * scalar
+  return overlaps_elsewhere(prod.lhs(), dst, in_place);
+}
+
+template<typename E1, typename E2, typename T>
+bool overlaps_elsewhere(matrix_prod<E1, E2> const& prod, dense_operand<T> const& dst,
+                        bool, std::integral_constant<int, 2>) { // inline product
+  return overlaps_elsewhere(prod.lhs(), dst, false) ||
+         overlaps_elsewhere(prod.rhs(), dst, false);
+}
+
+template<typename E1, typename E2, typename T>
+bool overlaps_elsewhere(matrix_prod<E1, E2> const&, dense_operand<T> const&,
+                        bool, std::integral_constant<int, 3>) { // materialized
+  return false;
+}
+
+template<typename E1, typename E2, typename T>
+bool overlaps_elsewhere(matrix_prod<E1, E2> const& prod, dense_operand<T> const& dst,
+                        bool in_place) {
+  using kind = std::integral_constant<int,
+    is_scalar_operand<E1>::value ? 0 : is_scalar_operand<E2>::value ? 1 :
+    is_inline_product<matrix_prod<E1, E2> >::value ? 2 : 3>;
+  return overlaps_elsewhere(prod, dst, in_place, kind());
+}
+
+template<typename E, typename T>
+bool overlaps_elsewhere(matrix_transpose<E> const& t, dense_operand<T> const& dst,
+                        bool) {
+  return overlaps_elsewhere(t.operand(), dst, false);
+}
+
+// dst (strides rs_d, cs_d) = src, rows x cols. when one side is row-major
+// and the other column-major this is a transpose of the underlying arrays
+// and goes to the blocked engine; matching orders copy contiguous runs.
+template<typename T>
+void copy_strided(size_t rows, size_t cols, dense_operand<T> const& src,
+                  T* dst, std::ptrdiff_t rs_d, std::ptrdiff_t cs_d) {
+  if (src.col_stride == 1 && cs_d == 1) {
+    for (size_t i = 0; i < rows; i++)
+      std::copy(src.data + i * src.row_stride, src.data + i * src.row_stride + cols,
+                dst + i * rs_d);
+  } else if (src.row_stride == 1 && rs_d == 1) {
+    for (size_t j = 0; j < cols; j++)
+      std::copy(src.data + j * src.col_stride, src.data + j * src.col_stride + rows,
+                dst + j * cs_d);
+  } else if (src.col_stride == 1 && rs_d == 1) {
+    transpose_copy(rows, cols, src.data, size_t(src.row_stride), dst, size_t(cs_d));
+  } else if (src.row_stride == 1 && cs_d == 1) {
+    transpose_copy(cols, rows, src.data, size_t(src.col_stride), dst, size_t(rs_d));
+  } else {
+    for (size_t i = 0; i < rows; i++)
+      for (size_t j = 0; j < cols; j++)
+        dst[i * rs_d + j * cs_d] = src.data[i * src.row_stride + j * src.col_stride];
   }
-};
+}
+
+} // namespace detail
 
 // addition expression
 template<typename E1, typename E2>
@@ -124,26 +2068,65 @@ class matrix_sum : public matrix_expr<matrix_sum<E1, E2> > {
   using matrix_expr<matrix_sum<E1, E2> >::num_cols_;
   
 public:
-  matrix_sum(E1 const& u, E2 const& v) : lhs_(u), rhs_(v) {
+  constexpr matrix_sum(E1 const& u, E2 const& v) : lhs_(u), rhs_(v) {
+    static_assert(detail::extents_agree(E1::static_rows, E2::static_rows) &&
+                  detail::extents_agree(E1::static_cols, E2::static_cols),
+                  "operands of different sizes");
     assert((lhs_.num_rows() == rhs_.num_rows()) &&
            (lhs_.num_cols() == rhs_.num_cols()));
     num_rows_ = lhs_.num_rows();
     num_cols_ = lhs_.num_cols();
   }
 
-  auto at(size_t row, size_t col) const {
+  constexpr E1 const& lhs() const {
+    return lhs_;
+  }
+
+  constexpr E2 const& rhs() const {
+    return rhs_;
+  }
+
+  using layout = detail::common_layout<typename E1::layout, typename E2::layout>;
+  static constexpr size_t static_rows = detail::common_extent(E1::static_rows, E2::static_rows);
+  static constexpr size_t static_cols = detail::common_extent(E1::static_cols, E2::static_cols);
+  static constexpr bool is_linear = E1::is_linear && E2::is_linear &&
+    std::is_same<expr_value_t<E1>, expr_value_t<E2> >::value &&
+    !std::is_same<layout, mixed_layout>::value;
+  static constexpr bool is_strided_linear = E1::is_strided_linear && E2::is_strided_linear &&
+    std::is_same<expr_value_t<E1>, expr_value_t<E2> >::value &&
+    !std::is_same<layout, mixed_layout>::value;
+
+  constexpr auto at(size_t row, size_t col) const {
     return lhs_.at(row, col) + rhs_.at(row,col);
   }
+
+  constexpr void prepare() const {
+    lhs_.prepare();
+    rhs_.prepare();
+  }
+
+  constexpr void unprepare() const {
+    lhs_.unprepare();
+    rhs_.unprepare();
+  }
+
+  auto at(size_t i) const {
+    return lhs_.at(i) + rhs_.at(i);
+  }
+
+  auto packet(size_t i) const {
+    return lhs_.packet(i) + rhs_.packet(i);
+  }
+
+  auto packet(size_t row, size_t col) const {
+    return lhs_.packet(row, col) + rhs_.packet(row, col);
+  }
 };
     
 
 template<typename E1, typename E2>
-matrix_sum<E1,E2> operator+(E1 const& lhs, E2 const& rhs) {
-  return matrix_sum<E1,E2>(lhs,rhs);
-}
-
-template<typename E1, typename E2>
-matrix_sum<E1,E2> operator+=(E1 const& lhs, E2 const& rhs) {
+constexpr detail::enable_if_exprs<E1, E2, matrix_sum<E1,E2> >
+operator+(E1 const& lhs, E2 const& rhs) {
   return matrix_sum<E1,E2>(lhs,rhs);
 }
 
@@ -156,61 +2139,277 @@ class matrix_sub : public matrix_expr<matrix_sub<E1, E2> > {
   using matrix_expr<matrix_sub<E1, E2> >::num_cols_;
   
 public:
-  matrix_sub(E1 const& u, E2 const& v) : lhs_(u), rhs_(v) {
+  constexpr matrix_sub(E1 const& u, E2 const& v) : lhs_(u), rhs_(v) {
+    static_assert(detail::extents_agree(E1::static_rows, E2::static_rows) &&
+                  detail::extents_agree(E1::static_cols, E2::static_cols),
+                  "operands of different sizes");
     assert((lhs_.num_rows() == rhs_.num_rows()) &&
            (lhs_.num_cols() == rhs_.num_cols()));
     num_rows_ = lhs_.num_rows();
     num_cols_ = lhs_.num_cols();
   }
 
-  auto at(size_t row, size_t col) const {
+  constexpr E1 const& lhs() const {
+    return lhs_;
+  }
+
+  constexpr E2 const& rhs() const {
+    return rhs_;
+  }
+
+  using layout = detail::common_layout<typename E1::layout, typename E2::layout>;
+  static constexpr size_t static_rows = detail::common_extent(E1::static_rows, E2::static_rows);
+  static constexpr size_t static_cols = detail::common_extent(E1::static_cols, E2::static_cols);
+  static constexpr bool is_linear = E1::is_linear && E2::is_linear &&
+    std::is_same<expr_value_t<E1>, expr_value_t<E2> >::value &&
+    !std::is_same<layout, mixed_layout>::value;
+  static constexpr bool is_strided_linear = E1::is_strided_linear && E2::is_strided_linear &&
+    std::is_same<expr_value_t<E1>, expr_value_t<E2> >::value &&
+    !std::is_same<layout, mixed_layout>::value;
+
+  constexpr auto at(size_t row, size_t col) const {
     return lhs_.at(row, col) - rhs_.at(row,col);
   }
+
+  constexpr void prepare() const {
+    lhs_.prepare();
+    rhs_.prepare();
+  }
+
+  constexpr void unprepare() const {
+    lhs_.unprepare();
+    rhs_.unprepare();
+  }
+
+  auto at(size_t i) const {
+    return lhs_.at(i) - rhs_.at(i);
+  }
+
+  auto packet(size_t i) const {
+    return lhs_.packet(i) - rhs_.packet(i);
+  }
+
+  auto packet(size_t row, size_t col) const {
+    return lhs_.packet(row, col) - rhs_.packet(row, col);
+  }
 };
     
 
 template<typename E1, typename E2>
-matrix_sub<E1,E2> operator-(E1 const& lhs, E2 const& rhs) {
+constexpr detail::enable_if_exprs<E1, E2, matrix_sub<E1,E2> >
+operator-(E1 const& lhs, E2 const& rhs) {
   return matrix_sub<E1,E2>(lhs,rhs);
 }
 
-template<typename E1, typename E2>
-matrix_sub<E1,E2> operator-=(E1 const& lhs, E2 const& rhs) {
-  return matrix_sub<E1,E2>(lhs,rhs);
+// transpose expression. it costs nothing when it feeds a product, where gemm
+// reads the operand with its strides swapped, or when it's written to a
+// matrix of the opposite layout, which is a flat copy. otherwise it is
+// materialized by the blocked transpose engine (see transpose.hpp).
+template<typename E>
+class matrix_transpose : public matrix_expr<matrix_transpose<E> > {
+  E const& operand_;
+  using matrix_expr<matrix_transpose<E> >::num_rows_;
+  using matrix_expr<matrix_transpose<E> >::num_cols_;
+
+public:
+  constexpr explicit matrix_transpose(E const& operand) : operand_(operand) {
+    num_rows_ = operand_.num_cols();
+    num_cols_ = operand_.num_rows();
+  }
+
+  // the flat index of an element is the same in the operand's storage
+  using layout = typename detail::transposed_layout<typename E::layout>::type;
+  static constexpr size_t static_rows = E::static_cols;
+  static constexpr size_t static_cols = E::static_rows;
+  static constexpr bool is_linear = E::is_linear &&
+    !std::is_same<layout, mixed_layout>::value;
+  // a line of the transpose is a line of the operand
+  static constexpr bool is_strided_linear = E::is_strided_linear &&
+    !std::is_same<layout, mixed_layout>::value;
+
+  constexpr auto at(size_t row, size_t col) const {
+    return operand_.at(col, row);
+  }
+
+  constexpr void prepare() const {
+    operand_.prepare();
+  }
+
+  constexpr void unprepare() const {
+    operand_.unprepare();
+  }
+
+  auto at(size_t i) const {
+    return operand_.at(i);
+  }
+
+  auto packet(size_t i) const {
+    return operand_.packet(i);
+  }
+
+  auto packet(size_t row, size_t col) const {
+    return operand_.packet(col, row);
+  }
+
+  constexpr E const& operand() const {
+    return operand_;
+  }
+};
+
+template<typename E>
+constexpr matrix_transpose<E> transpose(matrix_expr<E> const& expr) {
+  return matrix_transpose<E>(static_cast<E const&>(expr));
 }
 
 // multiplication expression
-// uses extremely inefficient algorithm
+// at() computes one dot product per element, which is extremely inefficient;
+// it is kept as the reference path. a product of two matrices that is
+// evaluated into a matrix goes through the blocked gemm engine instead, and a
+// product inside a larger expression -- (a * b) + c, (a * b) * d -- is
+// materialized by gemm into a scratch temporary when the evaluator calls
+// prepare(), so every later read is a plain load.
 //
 // uses template specializations to handle the differences between
 // matrix * matrix multiplication and matrix * scalar multiplication.
 //
 // doesn't handle 1x1 matrices as scalar -- use a scalar type instead
-template<typename E1, typename E2, typename enable = void>
+template<typename E1, typename E2, typename enable>
 class matrix_prod : public matrix_expr<matrix_prod<E1, E2> > {
+  using value_type = typename std::decay<
+    decltype(std::declval<expr_value_t<E1> >() *
+             std::declval<expr_value_t<E2> >())>::type;
+
   E1 const& lhs_;
   E2 const& rhs_;
   size_t const shared_dim;
+  // set by prepare(), dropped by the matching unprepare(). an operand
+  // evaluated aside while an enclosing evaluation still reads the result
+  // prepares this node again, so only the outermost unprepare() drops it.
+  mutable detail::scratch_handle<value_type> result_;
+  mutable size_t preparations_ = 0;
   using matrix_expr<matrix_prod<E1, E2> >::num_rows_;
   using matrix_expr<matrix_prod<E1, E2> >::num_cols_;
 
 public:
+  // linear once prepared, by reading the materialized (row-major) result
+  static constexpr bool is_linear = true;
+  static constexpr bool is_strided_linear = true;
+  using layout = row_major;
+  static constexpr size_t static_rows = E1::static_rows;
+  static constexpr size_t static_cols = E2::static_cols;
+
   matrix_prod(E1 const& lhs, E2 const& rhs) : lhs_(lhs), rhs_(rhs),
                                               shared_dim(lhs.num_cols()) {
+    static_assert(detail::extents_agree(E1::static_cols, E2::static_rows),
+                  "inner dimensions of a product differ");
     assert(lhs_.num_cols() == rhs_.num_rows());
     num_rows_ = lhs_.num_rows();
     num_cols_ = rhs_.num_cols();
   }
+
+  // a copy starts unprepared, whatever the state of the original
+  matrix_prod(matrix_prod const& other) : matrix_prod(other.lhs_, other.rhs_) {}
+
+  constexpr E1 const& lhs() const {
+    return lhs_;
+  }
+
+  constexpr E2 const& rhs() const {
+    return rhs_;
+  }
   
-  auto at(size_t row, size_t col) const {
-    auto dot_product = 0;
+  void prepare() const {
+    if (preparations_ == 0)
+      result_ = scratch_pool<value_type>::local().evaluate(*this);
+    preparations_++;
+  }
+
+  void unprepare() const {
+    if (preparations_ != 0 && --preparations_ == 0)
+      result_.reset();
+  }
+
+  value_type at(size_t row, size_t col) const {
+    if (result_)
+      return result_->at(row, col);
+
+    value_type dot_product{};
     for (size_t i = 0; i < shared_dim; i++) {
       dot_product += lhs_.at(row, i) * rhs_.at(i, col);
     }
     return dot_product;
   }
+
+  // flat access is only available after prepare()
+  value_type at(size_t i) const {
+    return result_->at(i);
+  }
+
+  packet_t<value_type> packet(size_t i) const {
+    return result_->packet(i);
+  }
+
+  packet_t<value_type> packet(size_t row, size_t col) const {
+    return result_->packet(row, col);
+  }
+};
+
+// specialization for inline products (see detail::is_inline_product): each
+// element is a dot product of a length known at compile time, computed where
+// it is read. there is nothing to materialize, so no scratch matrix to hold,
+// and fixed size products can be evaluated in constant expressions.
+template<typename E1, typename E2>
+class matrix_prod<E1, E2, typename std::enable_if<
+                            detail::is_inline_product<matrix_prod<E1, E2> >::value>::type>
+  : public matrix_expr<matrix_prod<E1, E2> > {
+  using value_type = typename std::decay<
+    decltype(std::declval<expr_value_t<E1> >() *
+             std::declval<expr_value_t<E2> >())>::type;
+
+  E1 const& lhs_;
+  E2 const& rhs_;
+  using matrix_expr<matrix_prod<E1, E2> >::num_rows_;
+  using matrix_expr<matrix_prod<E1, E2> >::num_cols_;
+
+public:
+  using layout = row_major;
+  static constexpr size_t static_rows = E1::static_rows;
+  static constexpr size_t static_cols = E2::static_cols;
+
+  constexpr matrix_prod(E1 const& lhs, E2 const& rhs) : lhs_(lhs), rhs_(rhs) {
+    static_assert(E1::static_cols == E2::static_rows,
+                  "inner dimensions of a product differ");
+    num_rows_ = static_rows;
+    num_cols_ = static_cols;
+  }
+
+  constexpr E1 const& lhs() const {
+    return lhs_;
+  }
+
+  constexpr E2 const& rhs() const {
+    return rhs_;
+  }
+
+  constexpr void prepare() const {
+    lhs_.prepare();
+    rhs_.prepare();
+  }
+
+  constexpr void unprepare() const {
+    lhs_.unprepare();
+    rhs_.unprepare();
+  }
+
+  constexpr value_type at(size_t row, size_t col) const {
+    value_type dot_product{};
+#pragma GCC unroll 16
+    for (size_t i = 0; i < E1::static_cols; i++)
+      dot_product += lhs_.at(row, i) * rhs_.at(i, col);
+    return dot_product;
+  }
 };
-  
+
 template<typename E1, typename E2> // specialization when lhs is scalar
 class matrix_prod<E1, E2, typename std::enable_if<std::is_scalar<E1>::value ||
                                                   boost::is_complex<E1>::value
@@ -222,14 +2421,54 @@ class matrix_prod<E1, E2, typename std::enable_if<std::is_scalar<E1>::value ||
   using matrix_expr<matrix_prod<E1, E2> >::num_cols_;
 
 public:
-  explicit matrix_prod(E1 const& lhs, E2 const& rhs) : lhs_(lhs), rhs_(rhs) {
+  constexpr explicit matrix_prod(E1 const& lhs, E2 const& rhs) : lhs_(lhs), rhs_(rhs) {
     num_rows_ = rhs_.num_rows();
     num_cols_ = rhs_.num_cols();
   }
 
-  auto at(size_t row, size_t col) const {
+  // linear when scaling doesn't change the element type, so a packet of the
+  // matrix operand can be scaled by a broadcast of the scalar
+  using layout = typename E2::layout;
+  static constexpr size_t static_rows = E2::static_rows;
+  static constexpr size_t static_cols = E2::static_cols;
+  static constexpr bool is_linear = E2::is_linear &&
+    std::is_same<decltype(std::declval<E1>() * std::declval<expr_value_t<E2> >()),
+                 expr_value_t<E2> >::value;
+  static constexpr bool is_strided_linear = E2::is_strided_linear &&
+    std::is_same<decltype(std::declval<E1>() * std::declval<expr_value_t<E2> >()),
+                 expr_value_t<E2> >::value;
+
+  constexpr E1 const& lhs() const {
+    return lhs_;
+  }
+
+  constexpr E2 const& rhs() const {
+    return rhs_;
+  }
+
+  constexpr auto at(size_t row, size_t col) const {
     return lhs_ * rhs_.at(row,col);
   }
+
+  constexpr void prepare() const {
+    rhs_.prepare();
+  }
+
+  constexpr void unprepare() const {
+    rhs_.unprepare();
+  }
+
+  auto at(size_t i) const {
+    return lhs_ * rhs_.at(i);
+  }
+
+  auto packet(size_t i) const {
+    return packet_traits<expr_value_t<E2> >::set1(lhs_) * rhs_.packet(i);
+  }
+
+  auto packet(size_t row, size_t col) const {
+    return packet_traits<expr_value_t<E2> >::set1(lhs_) * rhs_.packet(row, col);
+  }
 };
 
 template<typename E1, typename E2> // specialization when rhs is scalar
@@ -243,24 +2482,60 @@ class matrix_prod<E1, E2, typename std::enable_if<std::is_scalar<E2>::value ||
   using matrix_expr<matrix_prod<E1, E2> >::num_cols_;
 
 public:
-  explicit matrix_prod(E1 const& lhs, E2 const& rhs) : lhs_(lhs), rhs_(rhs) {
+  constexpr explicit matrix_prod(E1 const& lhs, E2 const& rhs) : lhs_(lhs), rhs_(rhs) {
     num_rows_ = lhs_.num_rows();
     num_cols_ = lhs_.num_cols();
   }
 
-  auto at(size_t row, size_t col) const {
+  using layout = typename E1::layout;
+  static constexpr size_t static_rows = E1::static_rows;
+  static constexpr size_t static_cols = E1::static_cols;
+  static constexpr bool is_linear = E1::is_linear &&
+    std::is_same<decltype(std::declval<E2>() * std::declval<expr_value_t<E1> >()),
+                 expr_value_t<E1> >::value;
+  static constexpr bool is_strided_linear = E1::is_strided_linear &&
+    std::is_same<decltype(std::declval<E2>() * std::declval<expr_value_t<E1> >()),
+                 expr_value_t<E1> >::value;
+
+  constexpr E1 const& lhs() const {
+    return lhs_;
+  }
+
+  constexpr E2 const& rhs() const {
+    return rhs_;
+  }
+
+  constexpr auto at(size_t row, size_t col) const {
     return rhs_ * lhs_.at(row,col);
   }
+
+  constexpr void prepare() const {
+    lhs_.prepare();
+  }
+
+  constexpr void unprepare() const {
+    lhs_.unprepare();
+  }
+
+  auto at(size_t i) const {
+    return rhs_ * lhs_.at(i);
+  }
+
+  auto packet(size_t i) const {
+    return packet_traits<expr_value_t<E1> >::set1(rhs_) * lhs_.packet(i);
+  }
+
+  auto packet(size_t row, size_t col) const {
+    return packet_traits<expr_value_t<E1> >::set1(rhs_) * lhs_.packet(row, col);
+  }
 };
 
 template<typename E1, typename E2>
-matrix_prod<E1,E2> operator*(E1 const& lhs, E2 const& rhs) {
+constexpr detail::enable_if_product<E1, E2, matrix_prod<E1,E2> >
+operator*(E1 const& lhs, E2 const& rhs) {
   return matrix_prod<E1,E2>(lhs,rhs);
 }
 
-template<typename E1, typename E2>
-matrix_prod<E1,E2> operator*=(E1 const& lhs, E2 const& rhs) {
-  return matrix_prod<E1,E2>(lhs,rhs);
-}
+#include "reduce.hpp"
 
 #endif
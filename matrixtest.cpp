@@ -20,8 +20,8 @@ int main()
   generate(va.begin(), va.end(), [&n, SIZE]() { return n = n - 3; });
   generate(vb.begin(), vb.end(), [&n, SIZE]() { return n = n + 11; });
 
-  matrix<int> a (SIZE, SIZE, va);
-  matrix<int> b (SIZE, SIZE, vb);
+  matrix<int> a (SIZE, SIZE, std::move(va));
+  matrix<int> b (SIZE, SIZE, std::move(vb));
 
   matrix<int> c;
   int scalar = 123;
@@ -0,0 +1,65 @@
+#ifndef PACKET
+#define PACKET
+
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+
+// SIMD packets for the element-wise evaluation path.
+//
+// a packet holds lanes consecutive elements of one type. for arithmetic types
+// it is a GCC / Clang vector extension as wide as the widest vector unit the
+// translation unit is compiled for (-mavx512f, -mavx, ...), so + - * on
+// packets compile to single vector instructions; anything else is a packet of
+// one. unlike the gemm kernels there is no runtime dispatch: element-wise
+// expressions are bandwidth bound, and the width only needs to match what the
+// rest of the program was compiled for.
+
+#if defined(__AVX512F__)
+#define MATRIX_PACKET_BYTES 64
+#elif defined(__AVX__)
+#define MATRIX_PACKET_BYTES 32
+#else
+#define MATRIX_PACKET_BYTES 16
+#endif
+
+template<typename T, typename enable = void>
+struct packet_traits {
+  using type = T;
+  static constexpr size_t lanes = 1;
+
+  static type load(T const* p) { return *p; }
+  static void store(T* p, type x) { *p = x; }
+  static type set1(T x) { return x; }
+};
+
+#if defined(__GNUC__) || defined(__clang__)
+template<typename T>
+struct packet_traits<T, typename std::enable_if<std::is_arithmetic<T>::value &&
+                                                !std::is_same<T, bool>::value
+                                                >::type> {
+  typedef T type __attribute__((vector_size(MATRIX_PACKET_BYTES)));
+  static constexpr size_t lanes = MATRIX_PACKET_BYTES / sizeof(T);
+
+  // memcpy keeps loads and stores unaligned and free of aliasing issues; it
+  // compiles to a single vector move
+  static type load(T const* p) {
+    type x;
+    std::memcpy(&x, p, sizeof(x));
+    return x;
+  }
+
+  static void store(T* p, type x) {
+    std::memcpy(p, &x, sizeof(x));
+  }
+
+  static type set1(T x) {
+    return type{} + x;
+  }
+};
+#endif
+
+template<typename T>
+using packet_t = typename packet_traits<T>::type;
+
+#endif
@@ -0,0 +1,647 @@
+#ifndef REDUCE
+#define REDUCE
+
+#include <cmath>
+#include <cstring>
+#include <complex>
+#include <limits>
+#include <utility>
+#include "matrix.hpp"
+
+// reductions of an expression to a scalar: sum, min, max, argmin, argmax,
+// norms and dot products.
+//
+// the expression is read the way the evaluator would write it, and never
+// materialized: sum(a - b) is a single pass over a and b. products inside it
+// are materialized first, as for evaluation. above parallel_eval_threshold()
+// the rows (columns, for column-major operands) are split over the thread
+// pool, and each range is folded into four packet accumulators, so that
+// consecutive packets don't wait on each other:
+//   linear expressions of a strided layout   by flat index
+//   strided linear ones (views, blocks)      a packet at a time along lines
+//   anything else                            element by element
+// partial results are combined in order, but the grouping differs from a
+// serial left to right sum, so floating point sums may differ from one in
+// the last bits.
+//
+// rowwise(a) and colwise(a) reduce each row or column instead, into a
+// column or row vector expression: rowwise(a).sum() is rows x 1,
+// colwise(a - b).max() is 1 x cols. they are lazy like products, and
+// computed in one pass over a when the evaluator prepares them. a result
+// per line of a's storage (rows, for row-major a) folds each line like the
+// full reductions; a result across lines accumulates whole lines into a row
+// of partial results, a packet at a time, rather than striding down them.
+
+namespace detail {
+
+struct identity_map {
+  template<typename V>
+  V operator()(V x) const {
+    return x;
+  }
+};
+
+// abs and squared abs of elements and packets alike. complex elements map to
+// their real magnitude, and are never read in packets
+struct abs_map {
+  template<typename V>
+  V operator()(V x) const {
+    return x < V() ? -x : x;
+  }
+
+  template<typename T>
+  T operator()(std::complex<T> x) const {
+    return std::abs(x);
+  }
+};
+
+struct abs2_map {
+  template<typename V>
+  V operator()(V x) const {
+    return x * x;
+  }
+
+  template<typename T>
+  T operator()(std::complex<T> x) const {
+    return std::norm(x);
+  }
+};
+
+struct plus_op {
+  template<typename V>
+  V operator()(V lhs, V rhs) const {
+    return lhs + rhs;
+  }
+};
+
+struct min_op {
+  template<typename V>
+  V operator()(V lhs, V rhs) const {
+    return rhs < lhs ? rhs : lhs;
+  }
+};
+
+struct max_op {
+  template<typename V>
+  V operator()(V lhs, V rhs) const {
+    return lhs < rhs ? rhs : lhs;
+  }
+};
+
+// identities of min and max
+template<typename T>
+T largest() {
+  return std::numeric_limits<T>::has_infinity ? std::numeric_limits<T>::infinity()
+                                              : std::numeric_limits<T>::max();
+}
+
+template<typename T>
+T smallest() {
+  return std::numeric_limits<T>::has_infinity ? -std::numeric_limits<T>::infinity()
+                                              : std::numeric_limits<T>::lowest();
+}
+
+// the reductions: an identity, a map of the elements and an associative op
+// they are folded with, and a last step given the number of elements
+// folded. Map and Op take elements and packets alike.
+template<typename Map, typename Op>
+struct fold_reduction {
+  using map = Map;
+  using op = Op;
+
+  template<typename T>
+  using result = typename std::decay<decltype(Map()(std::declval<T>()))>::type;
+
+  template<typename R>
+  static R identity() {
+    return R();
+  }
+
+  template<typename R>
+  static R finish(R value, size_t) {
+    return value;
+  }
+};
+
+struct sum_reduction : fold_reduction<identity_map, plus_op> {};
+
+struct mean_reduction : fold_reduction<identity_map, plus_op> {
+  template<typename R>
+  static R finish(R value, size_t n) {
+    return n == 0 ? value : value / static_cast<R>(n);
+  }
+};
+
+struct min_reduction : fold_reduction<identity_map, min_op> {
+  template<typename R>
+  static R identity() {
+    return largest<R>();
+  }
+};
+
+struct max_reduction : fold_reduction<identity_map, max_op> {
+  template<typename R>
+  static R identity() {
+    return smallest<R>();
+  }
+};
+
+struct squared_norm_reduction : fold_reduction<abs2_map, plus_op> {};
+
+// squared abs of elements as a floating point type: integers are squared and
+// summed as double, so that their norm isn't truncated to an integer
+struct floating_abs2_map {
+  template<typename V>
+  auto operator()(V x) const {
+    using F = std::conditional_t<std::is_integral<V>::value, double, V>;
+    return abs2_map()(static_cast<F>(x));
+  }
+};
+
+struct norm_reduction : fold_reduction<floating_abs2_map, plus_op> {
+  template<typename R>
+  static R finish(R value, size_t) {
+    using std::sqrt;
+    return sqrt(value);
+  }
+};
+
+struct norm_l1_reduction : fold_reduction<abs_map, plus_op> {};
+
+// absolute values are never negative, so zero is the identity of their max
+struct norm_inf_reduction : fold_reduction<abs_map, max_op> {};
+
+template<typename Reduction, typename E>
+using reduction_t = typename Reduction::template result<expr_value_t<E> >;
+
+// how a reduction to R reads E: in packets when mapping elements keeps their
+// type and E can be read in packets, in a strided layout
+template<typename E, typename R>
+using reduce_tag =
+  std::conditional_t<!std::is_same<expr_value_t<E>, R>::value || !E::layout::strided,
+                     element_tag,
+  std::conditional_t<E::is_linear, linear_tag,
+  std::conditional_t<E::is_strided_linear, strided_linear_tag, element_tag> > >;
+
+// order lines of E are folded in: its own when strided, tile by tile
+// otherwise
+template<typename E>
+using reduce_order = std::conditional_t<E::layout::strided, typename E::layout, tiled<> >;
+
+// op over map(load(i)) for i in [first, last), four packets at a time, and
+// then over the elements of the tail, at(i)
+template<typename T, typename Map, typename Op, typename Load, typename At>
+T fold_packets(size_t first, size_t last, T identity, Map const& map, Op const& op,
+               Load const& load, At const& at) {
+  using traits = packet_traits<T>;
+  constexpr size_t L = traits::lanes;
+  packet_t<T> a0 = traits::set1(identity), a1 = a0, a2 = a0, a3 = a0;
+  size_t i = first;
+  for (; i + 4 * L <= last; i += 4 * L) {
+    a0 = op(a0, map(load(i)));
+    a1 = op(a1, map(load(i + L)));
+    a2 = op(a2, map(load(i + 2 * L)));
+    a3 = op(a3, map(load(i + 3 * L)));
+  }
+  for (; i + L <= last; i += L)
+    a0 = op(a0, map(load(i)));
+  packet_t<T> const folded = op(op(a0, a1), op(a2, a3));
+  T lanes[L];
+  std::memcpy(lanes, &folded, sizeof(folded));
+  T acc = identity;
+  for (size_t l = 0; l < L; l++)
+    acc = op(acc, lanes[l]);
+  for (; i < last; i++)
+    acc = op(acc, map(at(i)));
+  return acc;
+}
+
+// op over map(element) for lines [first, last) of expr in Order
+template<typename Order, typename E, typename R, typename Map, typename Op>
+R fold_lines(E const& expr, size_t first, size_t last, R identity, Map const& map,
+             Op const& op, linear_tag) {
+  size_t const inner = Order::inner(expr.num_rows(), expr.num_cols());
+  return fold_packets<R>(first * inner, last * inner, identity, map, op,
+                         [&expr](size_t i) { return expr.packet(i); },
+                         [&expr](size_t i) { return expr.at(i); });
+}
+
+template<typename Order, typename E, typename R, typename Map, typename Op>
+R fold_lines(E const& expr, size_t first, size_t last, R identity, Map const& map,
+             Op const& op, strided_linear_tag) {
+  size_t const inner = Order::inner(expr.num_rows(), expr.num_cols());
+  R acc = identity;
+  for (size_t o = first; o < last; o++)
+    acc = op(acc, fold_packets<R>(size_t(0), inner, identity, map, op,
+      [&expr, o](size_t k) { return expr.packet(Order::row_at(o, k), Order::col_at(o, k)); },
+      [&expr, o](size_t k) { return expr.at(Order::row_at(o, k), Order::col_at(o, k)); }));
+  return acc;
+}
+
+template<typename Order, typename E, typename R, typename Map, typename Op>
+R fold_lines(E const& expr, size_t first, size_t last, R identity, Map const& map,
+             Op const& op, element_tag) {
+  R acc = identity;
+  Order::for_each(expr.num_rows(), expr.num_cols(), first, last,
+                  [&](size_t i, size_t j) { acc = op(acc, map(expr.at(i, j))); });
+  return acc;
+}
+
+// op over map(element) for all elements of expr, identity when it has none
+template<typename E, typename R, typename Map, typename Op>
+R reduce(E const& expr, R identity, Map const& map, Op const& op) {
+  using order = reduce_order<E>;
+  prepared<E> const scope(expr);
+  size_t const rows = expr.num_rows(), cols = expr.num_cols();
+  if (rows == 0 || cols == 0)
+    return identity;
+  return reduce_row_range(order::outer(rows, cols), order::inner(rows, cols), identity,
+                          [&](size_t first, size_t last) {
+    return fold_lines<order>(expr, first, last, identity, map, op, reduce_tag<E, R>());
+  }, op);
+}
+
+template<typename Reduction, typename E>
+reduction_t<Reduction, E> reduce(E const& expr) {
+  using R = reduction_t<Reduction, E>;
+  R const value = reduce(expr, Reduction::template identity<R>(),
+                         typename Reduction::map(), typename Reduction::op());
+  return Reduction::finish(value, expr.num_rows() * expr.num_cols());
+}
+
+// position of the first element equal to value, in expr's storage order
+// (row by row unless it is column-major); (npos, npos) if none is
+template<typename E, typename T>
+std::pair<size_t, size_t> find_first(E const& expr, T const& value) {
+  using order = std::conditional_t<E::layout::strided, typename E::layout, row_major>;
+  size_t const npos = size_t(-1);
+  size_t const rows = expr.num_rows(), cols = expr.num_cols();
+  size_t const outer = order::outer(rows, cols), inner = order::inner(rows, cols);
+  prepared<E> const scope(expr);
+  size_t const found = reduce_row_range(outer, inner, npos,
+                                        [&](size_t first, size_t last) {
+    for (size_t o = first; o < last; o++)
+      for (size_t k = 0; k < inner; k++)
+        if (expr.at(order::row_at(o, k), order::col_at(o, k)) == value)
+          return o * inner + k;
+    return npos;
+  }, [](size_t lhs, size_t rhs) { return std::min(lhs, rhs); });
+  if (found == npos)
+    return {npos, npos};
+  return {order::row_at(found / inner, found % inner),
+          order::col_at(found / inner, found % inner)};
+}
+
+// lhs * rhs element by element, the terms of a dot product
+template<typename E1, typename E2>
+class elementwise_product : public matrix_expr<elementwise_product<E1, E2> > {
+  E1 const& lhs_;
+  E2 const& rhs_;
+  using matrix_expr<elementwise_product<E1, E2> >::num_rows_;
+  using matrix_expr<elementwise_product<E1, E2> >::num_cols_;
+
+public:
+  elementwise_product(E1 const& lhs, E2 const& rhs) : lhs_(lhs), rhs_(rhs) {
+    static_assert(extents_agree(E1::static_rows, E2::static_rows) &&
+                  extents_agree(E1::static_cols, E2::static_cols),
+                  "operands of different sizes");
+    assert(lhs_.num_rows() == rhs_.num_rows() && lhs_.num_cols() == rhs_.num_cols());
+    num_rows_ = lhs_.num_rows();
+    num_cols_ = lhs_.num_cols();
+  }
+
+  using layout = common_layout<typename E1::layout, typename E2::layout>;
+  static constexpr bool is_linear = E1::is_linear && E2::is_linear &&
+    std::is_same<expr_value_t<E1>, expr_value_t<E2> >::value &&
+    !std::is_same<layout, mixed_layout>::value;
+  static constexpr bool is_strided_linear = E1::is_strided_linear && E2::is_strided_linear &&
+    std::is_same<expr_value_t<E1>, expr_value_t<E2> >::value &&
+    !std::is_same<layout, mixed_layout>::value;
+
+  auto at(size_t row, size_t col) const {
+    return lhs_.at(row, col) * rhs_.at(row, col);
+  }
+
+  void prepare() const {
+    lhs_.prepare();
+    rhs_.prepare();
+  }
+
+  void unprepare() const {
+    lhs_.unprepare();
+    rhs_.unprepare();
+  }
+
+  auto at(size_t i) const {
+    return lhs_.at(i) * rhs_.at(i);
+  }
+
+  auto packet(size_t i) const {
+    return lhs_.packet(i) * rhs_.packet(i);
+  }
+
+  auto packet(size_t row, size_t col) const {
+    return lhs_.packet(row, col) * rhs_.packet(row, col);
+  }
+};
+
+// acc[k] = op(acc[k], map(element k of line o)) for lines [first, last) of
+// expr in Order, a packet of acc at a time
+template<typename Order, typename R, typename E, typename Map, typename Op>
+void accumulate_lines(R* acc, E const& expr, size_t first, size_t last,
+                      Map const& map, Op const& op, linear_tag) {
+  using traits = packet_traits<R>;
+  size_t const inner = Order::inner(expr.num_rows(), expr.num_cols());
+  for (size_t o = first; o < last; o++) {
+    size_t const base = o * inner;
+    size_t k = 0;
+    for (; k + traits::lanes <= inner; k += traits::lanes)
+      traits::store(acc + k, op(traits::load(acc + k), map(expr.packet(base + k))));
+    for (; k < inner; k++)
+      acc[k] = op(acc[k], map(expr.at(base + k)));
+  }
+}
+
+template<typename Order, typename R, typename E, typename Map, typename Op>
+void accumulate_lines(R* acc, E const& expr, size_t first, size_t last,
+                      Map const& map, Op const& op, strided_linear_tag) {
+  using traits = packet_traits<R>;
+  size_t const inner = Order::inner(expr.num_rows(), expr.num_cols());
+  for (size_t o = first; o < last; o++) {
+    size_t k = 0;
+    for (; k + traits::lanes <= inner; k += traits::lanes)
+      traits::store(acc + k, op(traits::load(acc + k),
+                                map(expr.packet(Order::row_at(o, k), Order::col_at(o, k)))));
+    for (; k < inner; k++)
+      acc[k] = op(acc[k], map(expr.at(Order::row_at(o, k), Order::col_at(o, k))));
+  }
+}
+
+template<typename Order, typename R, typename E, typename Map, typename Op>
+void accumulate_lines(R* acc, E const& expr, size_t first, size_t last,
+                      Map const& map, Op const& op, element_tag) {
+  size_t const inner = Order::inner(expr.num_rows(), expr.num_cols());
+  for (size_t o = first; o < last; o++)
+    for (size_t k = 0; k < inner; k++)
+      acc[k] = op(acc[k], map(expr.at(Order::row_at(o, k), Order::col_at(o, k))));
+}
+
+// lines partial reductions walk: expr's own, when it is strided, rows
+// otherwise
+template<typename E>
+using partial_order = std::conditional_t<E::layout::strided, typename E::layout, row_major>;
+
+// one result per line: each line folded on its own, in parallel over lines
+template<typename Reduction, typename Order, typename E, typename R>
+void reduce_lines(E const& expr, R* dst, std::true_type) {
+  typename Reduction::map const map;
+  typename Reduction::op const op;
+  R const identity = Reduction::template identity<R>();
+  size_t const rows = expr.num_rows(), cols = expr.num_cols();
+  size_t const inner = Order::inner(rows, cols);
+  for_each_row_range(Order::outer(rows, cols), inner, [&](size_t first, size_t last) {
+    for (size_t o = first; o < last; o++)
+      dst[o] = Reduction::finish(fold_lines<Order>(expr, o, o + 1, identity, map, op,
+                                                   reduce_tag<E, R>()), inner);
+  });
+}
+
+// one result per position along the lines: ranges of lines accumulated in
+// parallel into rows of partial results, which are then combined
+template<typename Reduction, typename Order, typename E, typename R>
+void reduce_lines(E const& expr, R* dst, std::false_type) {
+  using partial = std::vector<R, aligned_allocator<R> >;
+  typename Reduction::map const map;
+  typename Reduction::op const op;
+  R const identity = Reduction::template identity<R>();
+  size_t const rows = expr.num_rows(), cols = expr.num_cols();
+  size_t const outer = Order::outer(rows, cols), inner = Order::inner(rows, cols);
+  partial const acc = reduce_row_range(outer, inner, partial(inner, identity),
+                                       [&](size_t first, size_t last) {
+    partial part(inner, identity);
+    accumulate_lines<Order>(part.data(), expr, first, last, map, op, reduce_tag<E, R>());
+    return part;
+  }, [&op](partial lhs, partial const& rhs) {
+    for (size_t k = 0; k < lhs.size(); k++)
+      lhs[k] = op(lhs[k], rhs[k]);
+    return lhs;
+  });
+  for (size_t k = 0; k < inner; k++)
+    dst[k] = Reduction::finish(acc[k], outer);
+}
+
+// dst = the reduction of each row (Rowwise) or column of expr
+template<typename Reduction, bool Rowwise, typename E, typename R>
+void reduce_partial(E const& expr, R* dst) {
+  using order = partial_order<E>;
+  prepared<E> const scope(expr);
+  reduce_lines<Reduction, order>(
+    expr, dst, std::integral_constant<bool, Rowwise == std::is_same<order, row_major>::value>());
+}
+
+} // namespace detail
+
+template<typename E>
+expr_value_t<E> sum(matrix_expr<E> const& expr) {
+  return detail::reduce<detail::sum_reduction>(static_cast<E const&>(expr));
+}
+
+template<typename E>
+expr_value_t<E> mean(matrix_expr<E> const& expr) {
+  return detail::reduce<detail::mean_reduction>(static_cast<E const&>(expr));
+}
+
+// smallest and largest elements. empty expressions have none and give the
+// identity of the fold: +infinity and -infinity (the largest and lowest
+// values of types without infinities)
+template<typename E>
+expr_value_t<E> min(matrix_expr<E> const& expr) {
+  return detail::reduce<detail::min_reduction>(static_cast<E const&>(expr));
+}
+
+template<typename E>
+expr_value_t<E> max(matrix_expr<E> const& expr) {
+  return detail::reduce<detail::max_reduction>(static_cast<E const&>(expr));
+}
+
+// (row, col) of the smallest and largest elements, the first of them in
+// storage order on ties. a second pass finds where the value found by the
+// first one is, so an expression is read twice, though products in it are
+// materialized once. must not be empty
+template<typename E>
+std::pair<size_t, size_t> argmin(matrix_expr<E> const& expr) {
+  assert(expr.num_rows() != 0 && expr.num_cols() != 0);
+  detail::prepared<E> const scope(static_cast<E const&>(expr));
+  return detail::find_first(static_cast<E const&>(expr), min(expr));
+}
+
+template<typename E>
+std::pair<size_t, size_t> argmax(matrix_expr<E> const& expr) {
+  assert(expr.num_rows() != 0 && expr.num_cols() != 0);
+  detail::prepared<E> const scope(static_cast<E const&>(expr));
+  return detail::find_first(static_cast<E const&>(expr), max(expr));
+}
+
+// norms of all elements taken together, as one vector: the Frobenius norm
+// of a matrix, and its squared value, the sum and the largest of absolute
+// values. the norm of integer elements is a double
+template<typename E>
+detail::reduction_t<detail::squared_norm_reduction, E>
+squared_norm(matrix_expr<E> const& expr) {
+  return detail::reduce<detail::squared_norm_reduction>(static_cast<E const&>(expr));
+}
+
+template<typename E>
+detail::reduction_t<detail::norm_reduction, E> norm(matrix_expr<E> const& expr) {
+  return detail::reduce<detail::norm_reduction>(static_cast<E const&>(expr));
+}
+
+template<typename E>
+detail::reduction_t<detail::norm_l1_reduction, E> norm_l1(matrix_expr<E> const& expr) {
+  return detail::reduce<detail::norm_l1_reduction>(static_cast<E const&>(expr));
+}
+
+template<typename E>
+detail::reduction_t<detail::norm_inf_reduction, E> norm_inf(matrix_expr<E> const& expr) {
+  return detail::reduce<detail::norm_inf_reduction>(static_cast<E const&>(expr));
+}
+
+// sum of the products of corresponding elements of two expressions of the
+// same shape, in one pass over both; complex elements are not conjugated
+template<typename E1, typename E2>
+auto dot(matrix_expr<E1> const& lhs, matrix_expr<E2> const& rhs) {
+  detail::elementwise_product<E1, E2> const terms(static_cast<E1 const&>(lhs),
+                                                  static_cast<E2 const&>(rhs));
+  return sum(terms);
+}
+
+// reduction of each row (Rowwise) or column of an expression, a column or
+// row vector. computed by prepare() like a product, and read from the
+// result until the evaluation unprepares it; outside an evaluation each
+// element folds its row or column where it is read.
+template<typename E, bool Rowwise, typename Reduction>
+class partial_reduction : public matrix_expr<partial_reduction<E, Rowwise, Reduction> > {
+  using value_type = detail::reduction_t<Reduction, E>;
+
+  E const& operand_;
+  // set by prepare(), dropped by the matching unprepare(), as for products
+  mutable std::shared_ptr<detail::scratch_matrix<value_type> > result_;
+  mutable size_t preparations_ = 0;
+  using matrix_expr<partial_reduction<E, Rowwise, Reduction> >::num_rows_;
+  using matrix_expr<partial_reduction<E, Rowwise, Reduction> >::num_cols_;
+
+public:
+  // one row or one column, so row-major is also its flat order
+  static constexpr bool is_linear = true;
+  static constexpr bool is_strided_linear = true;
+  using layout = row_major;
+  static constexpr size_t static_rows = Rowwise ? E::static_rows : 1;
+  static constexpr size_t static_cols = Rowwise ? 1 : E::static_cols;
+
+  explicit partial_reduction(E const& operand) : operand_(operand) {
+    num_rows_ = Rowwise ? operand_.num_rows() : 1;
+    num_cols_ = Rowwise ? 1 : operand_.num_cols();
+  }
+
+  // a copy starts unprepared, whatever the state of the original
+  partial_reduction(partial_reduction const& other) : partial_reduction(other.operand_) {}
+
+  void prepare() const {
+    if (preparations_ == 0) {
+      result_ = scratch_pool<value_type>::local().acquire(num_rows_, num_cols_);
+      detail::reduce_partial<Reduction, Rowwise>(operand_, result_->data());
+    }
+    preparations_++;
+  }
+
+  void unprepare() const {
+    if (preparations_ != 0 && --preparations_ == 0)
+      result_.reset();
+  }
+
+  value_type at(size_t row, size_t col) const {
+    if (preparations_ != 0)
+      return result_->at(row + col);
+
+    typename Reduction::map const map;
+    typename Reduction::op const op;
+    size_t const n = Rowwise ? operand_.num_cols() : operand_.num_rows();
+    value_type acc = Reduction::template identity<value_type>();
+    for (size_t k = 0; k < n; k++)
+      acc = op(acc, map(Rowwise ? operand_.at(row, k) : operand_.at(k, col)));
+    return Reduction::finish(acc, n);
+  }
+
+  // flat access is only available after prepare()
+  value_type at(size_t i) const {
+    return result_->at(i);
+  }
+
+  packet_t<value_type> packet(size_t i) const {
+    return result_->packet(i);
+  }
+
+  packet_t<value_type> packet(size_t row, size_t col) const {
+    return result_->packet(row + col);
+  }
+};
+
+// the partial reductions of an expression along one direction, see
+// rowwise() and colwise()
+template<typename E, bool Rowwise>
+class partial_reductions {
+  E const& operand_;
+
+  template<typename Reduction>
+  using node = partial_reduction<E, Rowwise, Reduction>;
+
+public:
+  explicit partial_reductions(E const& operand) : operand_(operand) {}
+
+  node<detail::sum_reduction> sum() const {
+    return node<detail::sum_reduction>(operand_);
+  }
+
+  node<detail::mean_reduction> mean() const {
+    return node<detail::mean_reduction>(operand_);
+  }
+
+  node<detail::min_reduction> min() const {
+    return node<detail::min_reduction>(operand_);
+  }
+
+  node<detail::max_reduction> max() const {
+    return node<detail::max_reduction>(operand_);
+  }
+
+  node<detail::squared_norm_reduction> squared_norm() const {
+    return node<detail::squared_norm_reduction>(operand_);
+  }
+
+  node<detail::norm_reduction> norm() const {
+    return node<detail::norm_reduction>(operand_);
+  }
+
+  node<detail::norm_l1_reduction> norm_l1() const {
+    return node<detail::norm_l1_reduction>(operand_);
+  }
+
+  node<detail::norm_inf_reduction> norm_inf() const {
+    return node<detail::norm_inf_reduction>(operand_);
+  }
+};
+
+// rowwise(a).sum() holds the sum of each row of a, colwise(a).max() the
+// largest element of each column, and so on for the reductions above. like
+// any expression they refer to a, which must outlive them
+template<typename E>
+partial_reductions<E, true> rowwise(matrix_expr<E> const& expr) {
+  return partial_reductions<E, true>(static_cast<E const&>(expr));
+}
+
+template<typename E>
+partial_reductions<E, false> colwise(matrix_expr<E> const& expr) {
+  return partial_reductions<E, false>(static_cast<E const&>(expr));
+}
+
+#endif
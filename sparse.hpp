@@ -0,0 +1,1007 @@
+#ifndef SPARSE
+#define SPARSE
+
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <cassert>
+#include "matrix.hpp"
+
+// compressed sparse matrices, for operands too sparse to store densely.
+//
+// csr_matrix keeps the nonzeros of each row together, sorted by column;
+// csc_matrix the nonzeros of each column, sorted by row. both are matrix
+// expressions: at() finds an element by binary search, but the evaluator
+// never walks them that way. written to a matrix, or added to or subtracted
+// from one, only their nonzeros are visited, and products with dense
+// operands run as sparse kernels over the nonzeros:
+//   csr * dense   each row of the result sums the rows of the dense operand
+//                 picked by the row's nonzeros (SpMV for a single column).
+//                 parallel over rows.
+//   csc * dense   each nonzero scatters a scaled row of the dense operand
+//                 into the result, parallel over columns of the result.
+//   dense * csr   each element of a dense row scatters a scaled row of the
+//                 sparse operand, parallel over rows.
+//   dense * csc   each element of the result is a gather dot product over a
+//                 column's nonzeros, parallel over rows.
+// csr is the better format for SpMV; csc for x' * A.
+//
+// the product of two sparse operands assigned to a csr_matrix or csc_matrix
+// stays sparse: spgemm() computes it row by row, sizing the result in a
+// symbolic pass before the numeric one. assigned to a dense matrix, each
+// row of it sums scaled sparse rows directly.
+//
+// bsr_matrix<T, B> stores nonzero B x B blocks densely, for matrices sparse
+// at the level of blocks (pruned weights, with B = 4, 8 or 16). its
+// products with dense operands run the gemm microkernel on each block, see
+// bsr_multiply(); otherwise it goes wherever csr_matrix does.
+
+namespace detail {
+
+// nonzeros grouped by an outer dimension, rows for csr and columns for csc:
+// those of outer index o are [ptr[o], ptr[o + 1]) of idx, which holds their
+// inner index in ascending order, and of values
+template<typename T>
+struct compressed {
+  std::vector<size_t> ptr;
+  std::vector<size_t> idx;
+  std::vector<T> values;
+
+  explicit compressed(size_t outer = 0) : ptr(outer + 1) {}
+
+  compressed(std::vector<size_t> p, std::vector<size_t> i, std::vector<T> v)
+    : ptr(std::move(p)), idx(std::move(i)), values(std::move(v)) {
+    assert(!ptr.empty() && ptr.front() == 0);
+    assert(ptr.back() == idx.size() && idx.size() == values.size());
+  }
+
+  size_t outer() const {
+    return ptr.size() - 1;
+  }
+
+  T find(size_t o, size_t i) const {
+    auto const first = idx.begin() + ptr[o];
+    auto const last = idx.begin() + ptr[o + 1];
+    auto const it = std::lower_bound(first, last, i);
+    return it != last && *it == i ? values[it - idx.begin()] : T();
+  }
+
+  // keeps the elements get(o, i) of an outer x inner matrix that aren't zero:
+  // counts them per outer index, then fills each one's range, both passes in
+  // parallel
+  template<typename Get>
+  void compress(size_t outer, size_t inner, Get const& get) {
+    ptr.assign(outer + 1, 0);
+    for_each_row_range(outer, inner, [this, inner, &get](size_t first, size_t last) {
+      for (size_t o = first; o < last; o++)
+        for (size_t i = 0; i < inner; i++)
+          if (static_cast<T>(get(o, i)) != T())
+            ptr[o + 1]++;
+    });
+    std::partial_sum(ptr.begin(), ptr.end(), ptr.begin());
+    idx.resize(ptr.back());
+    values.resize(ptr.back());
+    for_each_row_range(outer, inner, [this, inner, &get](size_t first, size_t last) {
+      for (size_t o = first; o < last; o++) {
+        size_t p = ptr[o];
+        for (size_t i = 0; i < inner; i++) {
+          T const value = static_cast<T>(get(o, i));
+          if (value != T()) {
+            idx[p] = i;
+            values[p++] = value;
+          }
+        }
+      }
+    });
+  }
+
+  // the same nonzeros grouped by inner index instead (csr <-> csc), by a
+  // counting sort. walking outer indices in order leaves each group sorted.
+  compressed regrouped(size_t inner) const {
+    compressed result(inner);
+    for (size_t i : idx)
+      result.ptr[i + 1]++;
+    std::partial_sum(result.ptr.begin(), result.ptr.end(), result.ptr.begin());
+    result.idx.resize(idx.size());
+    result.values.resize(values.size());
+    std::vector<size_t> next(result.ptr.begin(), result.ptr.end() - 1);
+    for (size_t o = 0; o < outer(); o++)
+      for (size_t p = ptr[o]; p < ptr[o + 1]; p++) {
+        size_t const q = next[idx[p]]++;
+        result.idx[q] = o;
+        result.values[q] = values[p];
+      }
+    return result;
+  }
+};
+
+// weight of one outer index of a sparse kernel for for_each_row_range, which
+// splits work by rows x cols
+inline size_t sparse_work(size_t nonzeros, size_t outer, size_t n) {
+  return (nonzeros / std::max<size_t>(outer, 1) + 1) * std::max<size_t>(n, 1);
+}
+
+// sums the products landing in one row of a sparse product, for spgemm.
+// rows expected to fill a fair fraction of the columns use a dense array
+// with a stamp per column telling which row last touched it, so nothing is
+// cleared between rows; sparser rows use an open addressing table sized for
+// the row, which stays in L1 however wide the result is. one per thread.
+template<typename T>
+class row_accumulator {
+  static constexpr size_t empty = size_t(-1);
+
+  std::vector<T> dense_;
+  std::vector<size_t> stamp_;
+  size_t row_ = 0;  // stamp of the current row, never reused
+  std::vector<size_t> keys_;
+  std::vector<T> slots_;
+  size_t mask_ = 0;
+  bool use_dense_ = false;
+  std::vector<size_t> cols_;  // columns touched so far in the current row
+
+  size_t find(size_t col) const {
+    size_t h = (col * 0x9E3779B97F4A7C15ull) & mask_;
+    while (keys_[h] != col && keys_[h] != empty)
+      h = (h + 1) & mask_;
+    return h;
+  }
+
+public:
+  static row_accumulator& local() {
+    thread_local row_accumulator acc;
+    return acc;
+  }
+
+  // starts a row of a result with cols columns, which at most products
+  // land in
+  void begin(size_t cols, size_t products) {
+    cols_.clear();
+    use_dense_ = products * 8 > cols;
+    if (use_dense_) {
+      if (dense_.size() < cols) {
+        dense_.resize(cols);
+        stamp_.resize(cols);
+      }
+      row_++;
+    } else {
+      size_t size = 16;
+      while (size < 2 * products)
+        size *= 2;
+      keys_.assign(size, empty);
+      slots_.resize(size);
+      mask_ = size - 1;
+    }
+  }
+
+  // the sum for col, zero when col is new to the row
+  T& operator[](size_t col) {
+    if (use_dense_) {
+      if (stamp_[col] != row_) {
+        stamp_[col] = row_;
+        dense_[col] = T();
+        cols_.push_back(col);
+      }
+      return dense_[col];
+    }
+    size_t const h = find(col);
+    if (keys_[h] == empty) {
+      keys_[h] = col;
+      slots_[h] = T();
+      cols_.push_back(col);
+    }
+    return slots_[h];
+  }
+
+  size_t size() const {
+    return cols_.size();
+  }
+
+  // writes the row out, by ascending column
+  void extract(size_t* idx, T* values) {
+    std::sort(cols_.begin(), cols_.end());
+    for (size_t k = 0; k < cols_.size(); k++) {
+      idx[k] = cols_[k];
+      values[k] = use_dense_ ? dense_[cols_[k]] : slots_[find(cols_[k])];
+    }
+  }
+};
+
+template<typename T>
+constexpr size_t row_accumulator<T>::empty;
+
+// rows of the product of a (grouped by rows) and b (grouped by rows, cols
+// columns), also grouped by rows. the csc product is the same computation
+// on the transposes, b' * a'. entries that cancel to zero are kept.
+//
+// every row is computed twice: a symbolic pass counts its entries, which
+// gives each row its place in the result, then a numeric pass fills it in.
+// both are parallel over rows, with one accumulator per thread.
+template<typename T>
+compressed<T> spgemm(compressed<T> const& a, compressed<T> const& b, size_t cols) {
+  size_t const rows = a.outer();
+  compressed<T> c(rows);
+  // products per row, an upper bound on its entries
+  std::vector<size_t> products(rows);
+  size_t const work = sparse_work(a.values.size(), rows,
+                                  b.values.size() / std::max<size_t>(b.outer(), 1));
+
+  for_each_row_range(rows, work, [&](size_t first, size_t last) {
+    row_accumulator<T>& acc = row_accumulator<T>::local();
+    for (size_t i = first; i < last; i++) {
+      size_t n = 0;
+      for (size_t p = a.ptr[i]; p < a.ptr[i + 1]; p++)
+        n += b.ptr[a.idx[p] + 1] - b.ptr[a.idx[p]];
+      products[i] = n;
+      acc.begin(cols, n);
+      for (size_t p = a.ptr[i]; p < a.ptr[i + 1]; p++)
+        for (size_t q = b.ptr[a.idx[p]]; q < b.ptr[a.idx[p] + 1]; q++)
+          acc[b.idx[q]];
+      c.ptr[i + 1] = acc.size();
+    }
+  });
+
+  std::partial_sum(c.ptr.begin(), c.ptr.end(), c.ptr.begin());
+  c.idx.resize(c.ptr.back());
+  c.values.resize(c.ptr.back());
+
+  for_each_row_range(rows, work, [&](size_t first, size_t last) {
+    row_accumulator<T>& acc = row_accumulator<T>::local();
+    for (size_t i = first; i < last; i++) {
+      acc.begin(cols, products[i]);
+      for (size_t p = a.ptr[i]; p < a.ptr[i + 1]; p++) {
+        T const v = a.values[p];
+        for (size_t q = b.ptr[a.idx[p]]; q < b.ptr[a.idx[p] + 1]; q++)
+          acc[b.idx[q]] += v * b.values[q];
+      }
+      acc.extract(c.idx.data() + c.ptr[i], c.values.data() + c.ptr[i]);
+    }
+  });
+  return c;
+}
+
+} // namespace detail
+
+template<typename T> class csr_matrix;
+template<typename T> class csc_matrix;
+template<typename T, size_t B> class bsr_matrix;
+
+namespace detail {
+
+// sparse operands in one format, converting only those in the other
+template<typename T>
+csr_matrix<T> const& as_csr(csr_matrix<T> const& m);
+
+template<typename T>
+csr_matrix<T> as_csr(csc_matrix<T> const& m);
+
+template<typename T>
+csc_matrix<T> const& as_csc(csc_matrix<T> const& m);
+
+template<typename T>
+csc_matrix<T> as_csc(csr_matrix<T> const& m);
+
+template<typename T, size_t B>
+csr_matrix<T> as_csr(bsr_matrix<T, B> const& m);
+
+template<typename T, size_t B>
+csc_matrix<T> as_csc(bsr_matrix<T, B> const& m);
+
+template<typename E1, typename E2>
+using enable_if_sparse_pair = typename std::enable_if<
+  sparse_traits<E1>::is_sparse && sparse_traits<E2>::is_sparse>::type;
+
+} // namespace detail
+
+template<typename T>
+class csr_matrix : public matrix_expr<csr_matrix<T> > {
+  using matrix_expr<csr_matrix<T> >::num_rows_;
+  using matrix_expr<csr_matrix<T> >::num_cols_;
+  detail::compressed<T> data_;
+
+public:
+  // read row by row when walked element by element
+  using layout = row_major;
+
+  csr_matrix() : csr_matrix(0, 0) {}
+
+  // rows x cols, all zeros
+  csr_matrix(size_t rows, size_t cols) : data_(rows) {
+    num_rows_ = rows;
+    num_cols_ = cols;
+  }
+
+  // takes over the arrays: the nonzeros of row i are [row_ptr[i],
+  // row_ptr[i + 1]) of col_idx and values, with col_idx ascending within
+  // each row
+  csr_matrix(size_t rows, size_t cols, std::vector<size_t> row_ptr,
+             std::vector<size_t> col_idx, std::vector<T> values)
+    : data_(std::move(row_ptr), std::move(col_idx), std::move(values)) {
+    assert(data_.outer() == rows);
+    num_rows_ = rows;
+    num_cols_ = cols;
+  }
+
+  // keeps the nonzeros of a dense expression
+  template<typename E>
+  explicit csr_matrix(matrix_expr<E> const& expr) {
+    E const& e = static_cast<E const&>(expr);
+    detail::prepared<E> const scope(e);
+    num_rows_ = e.num_rows();
+    num_cols_ = e.num_cols();
+    data_.compress(num_rows_, num_cols_,
+                   [&e](size_t i, size_t j) { return e.at(i, j); });
+  }
+
+  explicit csr_matrix(csc_matrix<T> const& other) : data_(other.storage().regrouped(other.num_rows())) {
+    num_rows_ = other.num_rows();
+    num_cols_ = other.num_cols();
+  }
+
+  // a product of sparse operands, computed by spgemm
+  template<typename E1, typename E2, typename = detail::enable_if_sparse_pair<E1, E2> >
+  csr_matrix(matrix_prod<E1, E2> const& prod) {
+    auto const& a = detail::as_csr(prod.lhs());
+    auto const& b = detail::as_csr(prod.rhs());
+    static_assert(std::is_same<typename std::decay<decltype(a)>::type, csr_matrix>::value,
+                  "sparse products keep the element type");
+    data_ = detail::spgemm(a.storage(), b.storage(), b.num_cols());
+    num_rows_ = a.num_rows();
+    num_cols_ = b.num_cols();
+  }
+
+  T at(size_t row, size_t col) const {
+    assert(row < num_rows_ && col < num_cols_);
+    return data_.find(row, col);
+  }
+
+  size_t nonzeros() const {
+    return data_.values.size();
+  }
+
+  std::vector<size_t> const& row_ptr() const {
+    return data_.ptr;
+  }
+
+  std::vector<size_t> const& col_idx() const {
+    return data_.idx;
+  }
+
+  std::vector<T> const& values() const {
+    return data_.values;
+  }
+
+  // the nonzeros may be changed in place, the pattern may not
+  std::vector<T>& values() {
+    return data_.values;
+  }
+
+  detail::compressed<T> const& storage() const {
+    return data_;
+  }
+};
+
+template<typename T>
+class csc_matrix : public matrix_expr<csc_matrix<T> > {
+  using matrix_expr<csc_matrix<T> >::num_rows_;
+  using matrix_expr<csc_matrix<T> >::num_cols_;
+  detail::compressed<T> data_;
+
+public:
+  using layout = col_major;
+
+  csc_matrix() : csc_matrix(0, 0) {}
+
+  csc_matrix(size_t rows, size_t cols) : data_(cols) {
+    num_rows_ = rows;
+    num_cols_ = cols;
+  }
+
+  // the nonzeros of column j are [col_ptr[j], col_ptr[j + 1]) of row_idx
+  // and values, with row_idx ascending within each column
+  csc_matrix(size_t rows, size_t cols, std::vector<size_t> col_ptr,
+             std::vector<size_t> row_idx, std::vector<T> values)
+    : data_(std::move(col_ptr), std::move(row_idx), std::move(values)) {
+    assert(data_.outer() == cols);
+    num_rows_ = rows;
+    num_cols_ = cols;
+  }
+
+  template<typename E>
+  explicit csc_matrix(matrix_expr<E> const& expr) {
+    E const& e = static_cast<E const&>(expr);
+    detail::prepared<E> const scope(e);
+    num_rows_ = e.num_rows();
+    num_cols_ = e.num_cols();
+    data_.compress(num_cols_, num_rows_,
+                   [&e](size_t j, size_t i) { return e.at(i, j); });
+  }
+
+  explicit csc_matrix(csr_matrix<T> const& other) : data_(other.storage().regrouped(other.num_cols())) {
+    num_rows_ = other.num_rows();
+    num_cols_ = other.num_cols();
+  }
+
+  // stored by columns, a * b is the row storage of b' * a'
+  template<typename E1, typename E2, typename = detail::enable_if_sparse_pair<E1, E2> >
+  csc_matrix(matrix_prod<E1, E2> const& prod) {
+    auto const& a = detail::as_csc(prod.lhs());
+    auto const& b = detail::as_csc(prod.rhs());
+    static_assert(std::is_same<typename std::decay<decltype(a)>::type, csc_matrix>::value,
+                  "sparse products keep the element type");
+    data_ = detail::spgemm(b.storage(), a.storage(), a.num_rows());
+    num_rows_ = a.num_rows();
+    num_cols_ = b.num_cols();
+  }
+
+  T at(size_t row, size_t col) const {
+    assert(row < num_rows_ && col < num_cols_);
+    return data_.find(col, row);
+  }
+
+  size_t nonzeros() const {
+    return data_.values.size();
+  }
+
+  std::vector<size_t> const& col_ptr() const {
+    return data_.ptr;
+  }
+
+  std::vector<size_t> const& row_idx() const {
+    return data_.idx;
+  }
+
+  std::vector<T> const& values() const {
+    return data_.values;
+  }
+
+  std::vector<T>& values() {
+    return data_.values;
+  }
+
+  detail::compressed<T> const& storage() const {
+    return data_;
+  }
+};
+
+// rows x cols, both multiples of B, in B x B blocks of which only those
+// holding a nonzero are stored. the blocks of block row I are [block_ptr[I],
+// block_ptr[I + 1]) of block_col, holding their block column in ascending
+// order, and of the blocks, each B * B elements row by row in values.
+template<typename T, size_t B>
+class bsr_matrix : public matrix_expr<bsr_matrix<T, B> > {
+  static_assert(B > 0, "blocks can't be empty");
+  using matrix_expr<bsr_matrix<T, B> >::num_rows_;
+  using matrix_expr<bsr_matrix<T, B> >::num_cols_;
+  std::vector<size_t> block_ptr_;
+  std::vector<size_t> block_col_;
+  std::vector<T> values_;
+
+public:
+  static constexpr size_t block = B;
+  using layout = row_major;
+
+  bsr_matrix() : bsr_matrix(0, 0) {}
+
+  bsr_matrix(size_t rows, size_t cols) : block_ptr_(rows / B + 1) {
+    assert(rows % B == 0 && cols % B == 0);
+    num_rows_ = rows;
+    num_cols_ = cols;
+  }
+
+  bsr_matrix(size_t rows, size_t cols, std::vector<size_t> block_ptr,
+             std::vector<size_t> block_col, std::vector<T> values)
+    : block_ptr_(std::move(block_ptr)), block_col_(std::move(block_col)),
+      values_(std::move(values)) {
+    assert(rows % B == 0 && cols % B == 0);
+    assert(block_ptr_.size() == rows / B + 1 && block_ptr_.front() == 0);
+    assert(block_ptr_.back() == block_col_.size());
+    assert(values_.size() == block_col_.size() * B * B);
+    num_rows_ = rows;
+    num_cols_ = cols;
+  }
+
+  // keeps the blocks of a dense expression that hold a nonzero
+  template<typename E>
+  explicit bsr_matrix(matrix_expr<E> const& expr) {
+    E const& e = static_cast<E const&>(expr);
+    detail::prepared<E> const scope(e);
+    num_rows_ = e.num_rows();
+    num_cols_ = e.num_cols();
+    assert(num_rows_ % B == 0 && num_cols_ % B == 0);
+    size_t const rows = num_rows_ / B, cols = num_cols_ / B;
+    auto nonzero = [&e](size_t I, size_t J) {
+      for (size_t i = I * B; i < I * B + B; i++)
+        for (size_t j = J * B; j < J * B + B; j++)
+          if (static_cast<T>(e.at(i, j)) != T())
+            return true;
+      return false;
+    };
+
+    block_ptr_.assign(rows + 1, 0);
+    detail::for_each_row_range(rows, num_cols_ * B, [&](size_t first, size_t last) {
+      for (size_t I = first; I < last; I++)
+        for (size_t J = 0; J < cols; J++)
+          block_ptr_[I + 1] += nonzero(I, J);
+    });
+    std::partial_sum(block_ptr_.begin(), block_ptr_.end(), block_ptr_.begin());
+    block_col_.resize(block_ptr_.back());
+    values_.resize(block_ptr_.back() * B * B);
+    detail::for_each_row_range(rows, num_cols_ * B, [&](size_t first, size_t last) {
+      for (size_t I = first; I < last; I++) {
+        size_t q = block_ptr_[I];
+        for (size_t J = 0; J < cols; J++) {
+          if (!nonzero(I, J))
+            continue;
+          block_col_[q] = J;
+          T* const dst = values_.data() + q * B * B;
+          for (size_t i = 0; i < B; i++)
+            for (size_t j = 0; j < B; j++)
+              dst[i * B + j] = static_cast<T>(e.at(I * B + i, J * B + j));
+          q++;
+        }
+      }
+    });
+  }
+
+  T at(size_t row, size_t col) const {
+    assert(row < num_rows_ && col < num_cols_);
+    size_t const I = row / B;
+    auto const first = block_col_.begin() + block_ptr_[I];
+    auto const last = block_col_.begin() + block_ptr_[I + 1];
+    auto const it = std::lower_bound(first, last, col / B);
+    if (it == last || *it != col / B)
+      return T();
+    return values_[(it - block_col_.begin()) * B * B + (row % B) * B + col % B];
+  }
+
+  size_t block_rows() const {
+    return num_rows_ / B;
+  }
+
+  size_t block_cols() const {
+    return num_cols_ / B;
+  }
+
+  // stored blocks
+  size_t blocks() const {
+    return block_col_.size();
+  }
+
+  std::vector<size_t> const& block_ptr() const {
+    return block_ptr_;
+  }
+
+  std::vector<size_t> const& block_col() const {
+    return block_col_;
+  }
+
+  std::vector<T> const& values() const {
+    return values_;
+  }
+
+  std::vector<T>& values() {
+    return values_;
+  }
+};
+
+namespace detail {
+
+template<typename T>
+struct sparse_traits<csr_matrix<T> > {
+  static constexpr bool is_sparse = true;
+
+  static size_t outer(csr_matrix<T> const& m) {
+    return m.num_rows();
+  }
+
+  static size_t nonzeros(csr_matrix<T> const& m) {
+    return m.nonzeros();
+  }
+
+  template<typename F>
+  static void for_each_nonzero(csr_matrix<T> const& m, size_t first, size_t last,
+                               F const& f) {
+    compressed<T> const& s = m.storage();
+    for (size_t i = first; i < last; i++)
+      for (size_t p = s.ptr[i]; p < s.ptr[i + 1]; p++)
+        f(i, s.idx[p], s.values[p]);
+  }
+};
+
+template<typename T>
+struct sparse_traits<csc_matrix<T> > {
+  static constexpr bool is_sparse = true;
+
+  static size_t outer(csc_matrix<T> const& m) {
+    return m.num_cols();
+  }
+
+  static size_t nonzeros(csc_matrix<T> const& m) {
+    return m.nonzeros();
+  }
+
+  template<typename F>
+  static void for_each_nonzero(csc_matrix<T> const& m, size_t first, size_t last,
+                               F const& f) {
+    compressed<T> const& s = m.storage();
+    for (size_t j = first; j < last; j++)
+      for (size_t p = s.ptr[j]; p < s.ptr[j + 1]; p++)
+        f(s.idx[p], j, s.values[p]);
+  }
+};
+
+// every element of a stored block counts, zero or not
+template<typename T, size_t B>
+struct sparse_traits<bsr_matrix<T, B> > {
+  static constexpr bool is_sparse = true;
+
+  static size_t outer(bsr_matrix<T, B> const& m) {
+    return m.block_rows();
+  }
+
+  static size_t nonzeros(bsr_matrix<T, B> const& m) {
+    return m.values().size();
+  }
+
+  template<typename F>
+  static void for_each_nonzero(bsr_matrix<T, B> const& m, size_t first, size_t last,
+                               F const& f) {
+    for (size_t I = first; I < last; I++)
+      for (size_t q = m.block_ptr()[I]; q < m.block_ptr()[I + 1]; q++) {
+        T const* const block = m.values().data() + q * B * B;
+        for (size_t i = 0; i < B; i++)
+          for (size_t j = 0; j < B; j++)
+            f(I * B + i, m.block_col()[q] * B + j, block[i * B + j]);
+      }
+  }
+};
+
+template<typename E>
+using enable_if_dense = typename std::enable_if<!sparse_traits<E>::is_sparse>::type;
+
+// the kernels below take dst (rows x n) with strides rs_c and cs_c, and the
+// dense operand as strided memory (materialized if it's an expression). the
+// unit stride branches are the row-major case, which the compiler vectorizes.
+
+template<typename T, typename E2>
+struct product_kernel<csr_matrix<T>, E2, enable_if_dense<E2> > {
+  template<typename U>
+  static void multiply(U* dst, std::ptrdiff_t rs_c, std::ptrdiff_t cs_c,
+                       csr_matrix<T> const& a, E2 const& rhs) {
+    scratch_handle<U> holder;
+    dense_operand<U> const b = as_dense<U>(rhs, holder);
+    compressed<T> const& s = a.storage();
+    size_t const n = b.cols;
+    for_each_row_range(a.num_rows(), sparse_work(a.nonzeros(), a.num_rows(), n),
+                       [&](size_t first, size_t last) {
+      for (size_t i = first; i < last; i++) {
+        U* const c = dst + i * rs_c;
+        if (cs_c == 1 && b.col_stride == 1) {
+          std::fill(c, c + n, U());
+          for (size_t p = s.ptr[i]; p < s.ptr[i + 1]; p++) {
+            U const v = static_cast<U>(s.values[p]);
+            U const* const row = b.data + s.idx[p] * b.row_stride;
+            for (size_t j = 0; j < n; j++)
+              c[j] += v * row[j];
+          }
+        } else {
+          // one gather dot product per element, e.g. a single column
+          for (size_t j = 0; j < n; j++) {
+            U const* const col = b.data + j * b.col_stride;
+            U sum = U();
+            for (size_t p = s.ptr[i]; p < s.ptr[i + 1]; p++)
+              sum += static_cast<U>(s.values[p]) * col[s.idx[p] * b.row_stride];
+            c[j * cs_c] = sum;
+          }
+        }
+      }
+    });
+  }
+};
+
+template<typename T, typename E2>
+struct product_kernel<csc_matrix<T>, E2, enable_if_dense<E2> > {
+  template<typename U>
+  static void multiply(U* dst, std::ptrdiff_t rs_c, std::ptrdiff_t cs_c,
+                       csc_matrix<T> const& a, E2 const& rhs) {
+    scratch_handle<U> holder;
+    dense_operand<U> const b = as_dense<U>(rhs, holder);
+    compressed<T> const& s = a.storage();
+    size_t const rows = a.num_rows();
+    size_t const n = b.cols;
+    // every nonzero may write any row of the result, so threads take
+    // columns of it instead
+    for_each_row_range(n, a.nonzeros() + rows, [&](size_t first, size_t last) {
+      for (size_t i = 0; i < rows; i++)
+        for (size_t j = first; j < last; j++)
+          dst[i * rs_c + j * cs_c] = U();
+      for (size_t k = 0; k < a.num_cols(); k++) {
+        U const* const row = b.data + k * b.row_stride;
+        for (size_t p = s.ptr[k]; p < s.ptr[k + 1]; p++) {
+          U const v = static_cast<U>(s.values[p]);
+          U* const c = dst + s.idx[p] * rs_c;
+          if (cs_c == 1 && b.col_stride == 1)
+            for (size_t j = first; j < last; j++)
+              c[j] += v * row[j];
+          else
+            for (size_t j = first; j < last; j++)
+              c[j * cs_c] += v * row[j * b.col_stride];
+        }
+      }
+    });
+  }
+};
+
+template<typename E1, typename T>
+struct product_kernel<E1, csr_matrix<T>, enable_if_dense<E1> > {
+  template<typename U>
+  static void multiply(U* dst, std::ptrdiff_t rs_c, std::ptrdiff_t cs_c,
+                       E1 const& lhs, csr_matrix<T> const& a) {
+    scratch_handle<U> holder;
+    dense_operand<U> const b = as_dense<U>(lhs, holder);
+    compressed<T> const& s = a.storage();
+    size_t const n = a.num_cols();
+    for_each_row_range(b.rows, a.nonzeros() + n, [&](size_t first, size_t last) {
+      for (size_t i = first; i < last; i++) {
+        U* const c = dst + i * rs_c;
+        for (size_t j = 0; j < n; j++)
+          c[j * cs_c] = U();
+        for (size_t k = 0; k < b.cols; k++) {
+          U const x = b.data[i * b.row_stride + k * b.col_stride];
+          for (size_t p = s.ptr[k]; p < s.ptr[k + 1]; p++)
+            c[s.idx[p] * cs_c] += x * static_cast<U>(s.values[p]);
+        }
+      }
+    });
+  }
+};
+
+template<typename E1, typename T>
+struct product_kernel<E1, csc_matrix<T>, enable_if_dense<E1> > {
+  template<typename U>
+  static void multiply(U* dst, std::ptrdiff_t rs_c, std::ptrdiff_t cs_c,
+                       E1 const& lhs, csc_matrix<T> const& a) {
+    scratch_handle<U> holder;
+    dense_operand<U> const b = as_dense<U>(lhs, holder);
+    compressed<T> const& s = a.storage();
+    size_t const n = a.num_cols();
+    for_each_row_range(b.rows, a.nonzeros() + n, [&](size_t first, size_t last) {
+      for (size_t i = first; i < last; i++) {
+        U const* const row = b.data + i * b.row_stride;
+        for (size_t j = 0; j < n; j++) {
+          U sum = U();
+          for (size_t p = s.ptr[j]; p < s.ptr[j + 1]; p++)
+            sum += row[s.idx[p] * b.col_stride] * static_cast<U>(s.values[p]);
+          dst[i * rs_c + j * cs_c] = sum;
+        }
+      }
+    });
+  }
+};
+
+template<typename T>
+csr_matrix<T> const& as_csr(csr_matrix<T> const& m) {
+  return m;
+}
+
+template<typename T>
+csr_matrix<T> as_csr(csc_matrix<T> const& m) {
+  return csr_matrix<T>(m);
+}
+
+template<typename T>
+csc_matrix<T> const& as_csc(csc_matrix<T> const& m) {
+  return m;
+}
+
+template<typename T>
+csc_matrix<T> as_csc(csr_matrix<T> const& m) {
+  return csc_matrix<T>(m);
+}
+
+template<typename T, size_t B>
+csr_matrix<T> as_csr(bsr_matrix<T, B> const& m) {
+  std::vector<size_t> ptr(m.num_rows() + 1), idx;
+  std::vector<T> values;
+  for (size_t i = 0; i < m.num_rows(); i++) {
+    size_t const I = i / B;
+    for (size_t q = m.block_ptr()[I]; q < m.block_ptr()[I + 1]; q++)
+      for (size_t j = 0; j < B; j++) {
+        T const value = m.values()[q * B * B + (i % B) * B + j];
+        if (value != T()) {
+          idx.push_back(m.block_col()[q] * B + j);
+          values.push_back(value);
+        }
+      }
+    ptr[i + 1] = idx.size();
+  }
+  return csr_matrix<T>(m.num_rows(), m.num_cols(), std::move(ptr),
+                       std::move(idx), std::move(values));
+}
+
+template<typename T, size_t B>
+csc_matrix<T> as_csc(bsr_matrix<T, B> const& m) {
+  return csc_matrix<T>(as_csr(m));
+}
+
+// dst (rows x x.cols, strides rs_c, cs_c) = a * x for a sparse matrix a of
+// B x B blocks: block row I holds the blocks [ptr[I], ptr[I + 1]) in block
+// columns idx, block q read from block(q) with strides brs and bcs (swapped
+// for a transposed matrix).
+//
+// x is packed once into slivers of nr columns and every block into slivers
+// of mr rows, the layouts the gemm microkernel reads. a block row of dst is
+// then a dense product of its blocks, side by side, with the rows of x they
+// pick, computed tile by tile by the microkernel. operands of only a few
+// columns, matrix-vector products included, would be mostly padding there
+// and go through a plain loop instead. parallel over block rows.
+template<size_t B, typename U, typename Blocks>
+void bsr_multiply(U* dst, std::ptrdiff_t rs_c, std::ptrdiff_t cs_c, size_t rows,
+                  std::vector<size_t> const& ptr, std::vector<size_t> const& idx,
+                  Blocks const& block, std::ptrdiff_t brs, std::ptrdiff_t bcs,
+                  dense_operand<U> const& x) {
+  size_t const n = x.cols;
+  size_t const block_rows = rows / B;
+  size_t const work = sparse_work(idx.size() * B * B, block_rows, n);
+  gemm_kernel<U> const kern = active_gemm_kernel<U>();
+  size_t const MR = kern.mr, NR = kern.nr;
+
+  if (2 * n < NR) {
+    for_each_row_range(block_rows, work, [&](size_t first, size_t last) {
+      for (size_t I = first; I < last; I++) {
+        U* const c = dst + I * B * rs_c;
+        for (size_t i = 0; i < B; i++)
+          for (size_t j = 0; j < n; j++)
+            c[i * rs_c + j * cs_c] = U();
+        for (size_t q = ptr[I]; q < ptr[I + 1]; q++) {
+          auto const a = block(q);
+          U const* const xb = x.data + idx[q] * B * x.row_stride;
+          for (size_t j = 0; j < n; j++)
+            for (size_t i = 0; i < B; i++) {
+              U sum = U();
+              for (size_t k = 0; k < B; k++)
+                sum += static_cast<U>(a[i * brs + k * bcs]) *
+                       xb[k * x.row_stride + j * x.col_stride];
+              c[i * rs_c + j * cs_c] += sum;
+            }
+        }
+      }
+    });
+    return;
+  }
+
+  size_t const k = x.rows;
+  size_t const slivers = (n + NR - 1) / NR;
+  size_t const a_size = (B + MR - 1) / MR * MR * B;
+  size_t const KC = std::max<size_t>(gemm_blocking::for_kernel(kern).kc / B, 1);
+  std::vector<U, aligned_allocator<U> > x_pack(slivers * NR * k);
+  std::vector<U, aligned_allocator<U> > a_pack(idx.size() * a_size);
+  for_each_row_range(slivers, NR * k, [&](size_t first, size_t last) {
+    pack_b(x_pack.data() + first * NR * k,
+           strided_operand<U>{x.data, x.row_stride, x.col_stride},
+           NR, 0, first * NR, k, std::min(n, last * NR) - first * NR);
+  });
+  // the slivers of a block row's blocks follow each other along k
+  for_each_row_range(block_rows, work, [&](size_t first, size_t last) {
+    for (size_t I = first; I < last; I++) {
+      size_t const blocks = ptr[I + 1] - ptr[I];
+      for (size_t q = ptr[I]; q < ptr[I + 1]; q++) {
+        auto const a = block(q);
+        auto const at = [&](size_t i, size_t j) {
+          return static_cast<U>(a[i * brs + j * bcs]);
+        };
+        for (size_t ir = 0; ir < B; ir += MR)
+          pack_a(a_pack.data() + ptr[I] * a_size + ir * B * blocks + (q - ptr[I]) * MR * B,
+                 at, MR, ir, 0, std::min(MR, B - ir), B);
+      }
+    }
+  });
+
+  // the rows of x a block row needs are gathered next to each other, so
+  // each tile takes one kernel call per KC blocks
+  for_each_row_range(block_rows, work, [&](size_t first, size_t last) {
+    static thread_local std::vector<U, aligned_allocator<U> > gather_buf;
+    for (size_t I = first; I < last; I++) {
+      U* const c = dst + I * B * rs_c;
+      size_t const blocks = ptr[I + 1] - ptr[I];
+      if (blocks == 0) {
+        for (size_t i = 0; i < B; i++)
+          for (size_t j = 0; j < n; j++)
+            c[i * rs_c + j * cs_c] = U();
+        continue;
+      }
+      U* const xg = gemm_buffer(gather_buf, blocks * B * NR);
+      U const* const ab = a_pack.data() + ptr[I] * a_size;
+      for (size_t s = 0; s < slivers; s++) {
+        U const* const xs = x_pack.data() + s * NR * k;
+        for (size_t q = ptr[I]; q < ptr[I + 1]; q++)
+          std::copy(xs + idx[q] * B * NR, xs + (idx[q] + 1) * B * NR,
+                    xg + (q - ptr[I]) * B * NR);
+        size_t const cols = std::min(NR, n - s * NR);
+        for (size_t ir = 0; ir < B; ir += MR)
+          for (size_t p = 0; p < blocks; p += KC)
+            kern.fn(std::min(KC, blocks - p) * B, U(1),
+                    ab + ir * B * blocks + p * MR * B, xg + p * B * NR,
+                    p == 0 ? U() : U(1), c + ir * rs_c + s * NR * cs_c, rs_c, cs_c,
+                    std::min(MR, B - ir), cols);
+      }
+    }
+  });
+}
+
+template<typename T, size_t B, typename E2>
+struct product_kernel<bsr_matrix<T, B>, E2, enable_if_dense<E2> > {
+  template<typename U>
+  static void multiply(U* dst, std::ptrdiff_t rs_c, std::ptrdiff_t cs_c,
+                       bsr_matrix<T, B> const& a, E2 const& rhs) {
+    scratch_handle<U> holder;
+    T const* const values = a.values().data();
+    bsr_multiply<B>(dst, rs_c, cs_c, a.num_rows(), a.block_ptr(), a.block_col(),
+                    [values](size_t q) { return values + q * B * B; }, B, 1,
+                    as_dense<U>(rhs, holder));
+  }
+};
+
+// x * a as (a' * x')': a' has the blocks of a transposed, grouped by block
+// column of a instead
+template<typename E1, typename T, size_t B>
+struct product_kernel<E1, bsr_matrix<T, B>, enable_if_dense<E1> > {
+  template<typename U>
+  static void multiply(U* dst, std::ptrdiff_t rs_c, std::ptrdiff_t cs_c,
+                       E1 const& lhs, bsr_matrix<T, B> const& a) {
+    scratch_handle<U> holder;
+    dense_operand<U> const x = as_dense<U>(lhs, holder);
+    std::vector<size_t> ids(a.blocks());
+    std::iota(ids.begin(), ids.end(), size_t(0));
+    compressed<size_t> const by_col =
+      compressed<size_t>(a.block_ptr(), a.block_col(), std::move(ids)).regrouped(a.block_cols());
+    T const* const values = a.values().data();
+    size_t const* const id = by_col.values.data();
+    bsr_multiply<B>(dst, cs_c, rs_c, a.num_cols(), by_col.ptr, by_col.idx,
+                    [values, id](size_t q) { return values + id[q] * B * B; }, 1, B,
+                    dense_operand<U>{x.data, x.cols, x.rows, x.col_stride, x.row_stride});
+  }
+};
+
+// dst (strides rs_c, cs_c) = a * b for a and b grouped by rows: each row of
+// dst sums the rows of b picked by a's row, scaled
+template<typename U, typename T>
+void multiply_sparse(U* dst, std::ptrdiff_t rs_c, std::ptrdiff_t cs_c,
+                     compressed<T> const& a, compressed<T> const& b, size_t cols) {
+  for_each_row_range(a.outer(), sparse_work(a.values.size(), a.outer(), cols),
+                     [&](size_t first, size_t last) {
+    for (size_t i = first; i < last; i++) {
+      U* const c = dst + i * rs_c;
+      for (size_t j = 0; j < cols; j++)
+        c[j * cs_c] = U();
+      for (size_t p = a.ptr[i]; p < a.ptr[i + 1]; p++) {
+        U const v = static_cast<U>(a.values[p]);
+        for (size_t q = b.ptr[a.idx[p]]; q < b.ptr[a.idx[p] + 1]; q++)
+          c[b.idx[q] * cs_c] += v * static_cast<U>(b.values[q]);
+      }
+    }
+  });
+}
+
+// sparse * sparse into a dense matrix, by rows, or for two csc operands by
+// columns, as dst' = b' * a'
+template<typename E1, typename E2>
+struct product_kernel<E1, E2, enable_if_sparse_pair<E1, E2> > {
+  template<typename U>
+  static void multiply(U* dst, std::ptrdiff_t rs_c, std::ptrdiff_t cs_c,
+                       E1 const& lhs, E2 const& rhs) {
+    auto const& a = as_csr(lhs);
+    auto const& b = as_csr(rhs);
+    multiply_sparse(dst, rs_c, cs_c, a.storage(), b.storage(), b.num_cols());
+  }
+
+  template<typename U, typename T>
+  static void multiply(U* dst, std::ptrdiff_t rs_c, std::ptrdiff_t cs_c,
+                       csc_matrix<T> const& a, csc_matrix<T> const& b) {
+    multiply_sparse(dst, cs_c, rs_c, b.storage(), a.storage(), a.num_rows());
+  }
+};
+
+} // namespace detail
+
+#endif
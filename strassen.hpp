@@ -0,0 +1,231 @@
+#ifndef STRASSEN
+#define STRASSEN
+
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include "gemm.hpp"
+#include "thread_pool.hpp"
+
+// Strassen-Winograd multiplication of square row-major matrices: 7 products
+// of half size and 15 additions per level instead of 8 products, recursing
+// until the blocked gemm takes over at the cutoff.
+//
+// it is opt-in, since it trades some accuracy for floating point types (the
+// error bound grows with the recursion depth) and needs extra memory. integer
+// products are exact as long as the intermediate sums don't overflow.
+//
+// the intermediate sums live in one workspace allocated up front and kept per
+// thread between calls:
+//   - below the top level each product runs the schedule of Douglas et al.,
+//     which needs only two temporaries of a quarter size, X and Y, and the
+//     four quadrants of C; that is ~2/3 n^2 over the whole recursion.
+//   - at the top level the seven products run in parallel on the thread pool,
+//     which needs every operand sum and three of the products in their own
+//     buffers: 11 (n/2)^2 plus a sequential workspace per product.
+// odd sizes are handled by peeling off the last row and column and fixing
+// them up with gemm.
+
+struct strassen_options {
+  // smallest dimension of a square product that takes the fast path. the
+  // default keeps it switched off
+  size_t min_size = SIZE_MAX;
+  // size at which the recursion stops and hands over to gemm
+  size_t cutoff = 512;
+};
+
+namespace detail {
+
+inline strassen_options& strassen_options_ref() {
+  static strassen_options options;
+  return options;
+}
+
+// z = x + y and z = x - y on h x h blocks with their own leading dimensions
+template<typename T>
+void block_add(size_t h, T const* x, size_t ldx, T const* y, size_t ldy,
+               T* z, size_t ldz) {
+  for (size_t i = 0; i < h; i++)
+    for (size_t j = 0; j < h; j++)
+      z[i * ldz + j] = x[i * ldx + j] + y[i * ldy + j];
+}
+
+template<typename T>
+void block_sub(size_t h, T const* x, size_t ldx, T const* y, size_t ldy,
+               T* z, size_t ldz) {
+  for (size_t i = 0; i < h; i++)
+    for (size_t j = 0; j < h; j++)
+      z[i * ldz + j] = x[i * ldx + j] - y[i * ldy + j];
+}
+
+inline size_t strassen_workspace(size_t n, size_t cutoff) {
+  if (n <= cutoff)
+    return 0;
+  size_t const h = n / 2;
+  return 2 * h * h + strassen_workspace(h, cutoff);
+}
+
+inline size_t strassen_parallel_workspace(size_t n, size_t cutoff) {
+  if (n <= cutoff)
+    return 0;
+  size_t const h = n / 2;
+  return 11 * h * h + 7 * strassen_workspace(h, cutoff);
+}
+
+// last row and column of an odd sized product, on top of the even core
+// C[0:e, 0:e] = A[0:e, 0:e] * B[0:e, 0:e] already in place
+template<typename T>
+void strassen_peel(size_t n, T const* a, size_t lda, T const* b, size_t ldb,
+                   T* c, size_t ldc) {
+  size_t const e = n - 1;
+  gemm<T>(e, e, 1, T(1), a + e, lda, 1, b + e * ldb, ldb, 1, T(1), c, ldc, 1);
+  gemm<T>(e, 1, n, T(1), a, lda, 1, b + e, ldb, 1, T(), c + e, ldc, 1);
+  gemm<T>(1, n, n, T(1), a + e * lda, lda, 1, b, ldb, 1, T(), c + e * ldc, ldc, 1);
+}
+
+template<typename T>
+void strassen_recursive(size_t n, T const* a, size_t lda, T const* b,
+                        size_t ldb, T* c, size_t ldc, T* work, size_t cutoff) {
+  if (n <= cutoff) {
+    gemm<T>(n, n, n, T(1), a, lda, 1, b, ldb, 1, T(), c, ldc, 1);
+    return;
+  }
+
+  size_t const h = n / 2;
+  T const* a11 = a;           T const* a12 = a + h;
+  T const* a21 = a + h * lda; T const* a22 = a21 + h;
+  T const* b11 = b;           T const* b12 = b + h;
+  T const* b21 = b + h * ldb; T const* b22 = b21 + h;
+  T* c11 = c;                 T* c12 = c + h;
+  T* c21 = c + h * ldc;       T* c22 = c21 + h;
+  T* x = work;
+  T* y = work + h * h;
+  T* next = work + 2 * h * h;
+
+  block_sub(h, a11, lda, a21, lda, x, h);                      // S3
+  block_sub(h, b22, ldb, b12, ldb, y, h);                      // T3
+  strassen_recursive(h, x, h, y, h, c21, ldc, next, cutoff);   // P7
+  block_add(h, a21, lda, a22, lda, x, h);                      // S1
+  block_sub(h, b12, ldb, b11, ldb, y, h);                      // T1
+  strassen_recursive(h, x, h, y, h, c22, ldc, next, cutoff);   // P5
+  block_sub(h, x, h, a11, lda, x, h);                          // S2
+  block_sub(h, b22, ldb, y, h, y, h);                          // T2
+  strassen_recursive(h, x, h, y, h, c12, ldc, next, cutoff);   // P6
+  block_sub(h, a12, lda, x, h, x, h);                          // S4
+  strassen_recursive(h, x, h, b22, ldb, c11, ldc, next, cutoff); // P3
+  strassen_recursive(h, a11, lda, b11, ldb, x, h, next, cutoff); // P1
+  block_add(h, x, h, c12, ldc, c12, ldc);                      // U2 = P1 + P6
+  block_add(h, c12, ldc, c21, ldc, c21, ldc);                  // U3 = U2 + P7
+  block_add(h, c12, ldc, c22, ldc, c12, ldc);                  // U4 = U2 + P5
+  block_add(h, c21, ldc, c22, ldc, c22, ldc);                  // U7 = U3 + P5
+  block_add(h, c12, ldc, c11, ldc, c12, ldc);                  // U5 = U4 + P3
+  block_sub(h, y, h, b21, ldb, y, h);                          // T4
+  strassen_recursive(h, a22, lda, y, h, c11, ldc, next, cutoff); // P4
+  block_sub(h, c21, ldc, c11, ldc, c21, ldc);                  // U6 = U3 - P4
+  strassen_recursive(h, a12, lda, b21, ldb, c11, ldc, next, cutoff); // P2
+  block_add(h, x, h, c11, ldc, c11, ldc);                      // U1 = P1 + P2
+
+  if (n & 1)
+    strassen_peel(n, a, lda, b, ldb, c, ldc);
+}
+
+// top level: all operand sums first, then the seven products in parallel,
+// each recursing sequentially in its own slice of the workspace
+template<typename T>
+void strassen_parallel(size_t n, T const* a, size_t lda, T const* b, size_t ldb,
+                       T* c, size_t ldc, T* work, size_t cutoff,
+                       thread_pool& pool) {
+  size_t const h = n / 2, hh = h * h;
+  T const* a11 = a;           T const* a12 = a + h;
+  T const* a21 = a + h * lda; T const* a22 = a21 + h;
+  T const* b11 = b;           T const* b12 = b + h;
+  T const* b21 = b + h * ldb; T const* b22 = b21 + h;
+  T* c11 = c;                 T* c12 = c + h;
+  T* c21 = c + h * ldc;       T* c22 = c21 + h;
+  T* s1 = work;          T* s2 = work + hh;     T* s3 = work + 2 * hh;
+  T* s4 = work + 3 * hh; T* t1 = work + 4 * hh; T* t2 = work + 5 * hh;
+  T* t3 = work + 6 * hh; T* t4 = work + 7 * hh;
+  T* p1 = work + 8 * hh; T* p6 = work + 9 * hh; T* p7 = work + 10 * hh;
+  T* branch_work = work + 11 * hh;
+  size_t const branch_size = strassen_workspace(h, cutoff);
+
+  block_add(h, a21, lda, a22, lda, s1, h);
+  block_sub(h, s1, h, a11, lda, s2, h);
+  block_sub(h, a11, lda, a21, lda, s3, h);
+  block_sub(h, a12, lda, s2, h, s4, h);
+  block_sub(h, b12, ldb, b11, ldb, t1, h);
+  block_sub(h, b22, ldb, t1, h, t2, h);
+  block_sub(h, b22, ldb, b12, ldb, t3, h);
+  block_sub(h, t2, h, b21, ldb, t4, h);
+
+  struct product {
+    T const* lhs; size_t ld_lhs;
+    T const* rhs; size_t ld_rhs;
+    T* dst; size_t ld_dst;
+  };
+  product const products[7] = {
+    {a11, lda, b11, ldb, p1, h},   // P1
+    {a12, lda, b21, ldb, c11, ldc}, // P2
+    {s4, h, b22, ldb, c12, ldc},   // P3
+    {a22, lda, t4, h, c21, ldc},   // P4
+    {s1, h, t1, h, c22, ldc},      // P5
+    {s2, h, t2, h, p6, h},         // P6
+    {s3, h, t3, h, p7, h},         // P7
+  };
+  pool.parallel_for(7, 1, [&](size_t first, size_t last) {
+    for (size_t i = first; i < last; i++)
+      strassen_recursive(h, products[i].lhs, products[i].ld_lhs,
+                         products[i].rhs, products[i].ld_rhs,
+                         products[i].dst, products[i].ld_dst,
+                         branch_work + i * branch_size, cutoff);
+  });
+
+  block_add(h, p1, h, c11, ldc, c11, ldc);   // U1 = P1 + P2
+  block_add(h, p1, h, p6, h, p6, h);         // U2 = P1 + P6
+  block_add(h, p6, h, p7, h, p7, h);         // U3 = U2 + P7
+  block_add(h, c12, ldc, p6, h, c12, ldc);   // P3 + U2
+  block_add(h, c12, ldc, c22, ldc, c12, ldc); // U5 = U4 + P3
+  block_sub(h, p7, h, c21, ldc, c21, ldc);   // U6 = U3 - P4
+  block_add(h, p7, h, c22, ldc, c22, ldc);   // U7 = U3 + P5
+
+  if (n & 1)
+    strassen_peel(n, a, lda, b, ldb, c, ldc);
+}
+
+} // namespace detail
+
+inline strassen_options strassen_settings() {
+  return detail::strassen_options_ref();
+}
+
+// e.g. set_strassen_options({2048, 512}) multiplies square matrices of 2048
+// and up with Strassen-Winograd, recursing down to blocks of 512
+inline void set_strassen_options(strassen_options const& options) {
+  detail::strassen_options_ref() = options;
+}
+
+// C (n x n) = A (n x n) * B (n x n), all row-major with leading dimensions
+template<typename T>
+void strassen_gemm(size_t n, T const* a, size_t lda, T const* b, size_t ldb,
+                   T* c, size_t ldc) {
+  size_t const cutoff = std::max<size_t>(strassen_settings().cutoff, 1);
+  if (n <= cutoff) {
+    gemm<T>(n, n, n, T(1), a, lda, 1, b, ldb, 1, T(), c, ldc, 1);
+    return;
+  }
+
+  std::shared_ptr<thread_pool> const pool = default_thread_pool_ptr();
+  bool const parallel = pool->size() > 1;
+  size_t const size = parallel ? detail::strassen_parallel_workspace(n, cutoff)
+                               : detail::strassen_workspace(n, cutoff);
+  static thread_local std::vector<T, aligned_allocator<T> > workspace;
+  T* const work = detail::gemm_buffer(workspace, size);
+
+  if (parallel)
+    detail::strassen_parallel(n, a, lda, b, ldb, c, ldc, work, cutoff, *pool);
+  else
+    detail::strassen_recursive(n, a, lda, b, ldb, c, ldc, work, cutoff);
+}
+
+#endif
@@ -0,0 +1,135 @@
+#include "test.hpp"
+#include "matrix.hpp"
+#include <cstdint>
+#include <vector>
+
+// storage from each allocator of allocators.hpp, evaluated against naive
+// loops: aligned to a cache line, reused after an arena reset or from a
+// buffer pool's cache, and the scratch pool's arena, which stops growing
+// once an evaluation has been through it and is never reset under a
+// temporary still alive.
+
+using naive = matrix<double>;
+
+naive filled(size_t rows, size_t cols, size_t seed) {
+  naive m(rows, cols, std::vector<double>(rows * cols));
+  for (size_t i = 0; i < rows; i++)
+    for (size_t j = 0; j < cols; j++)
+      m.at(i, j) = double(int((i * 7 + j * 3 + seed * 5) % 9) - 4);
+  return m;
+}
+
+naive product(naive const& a, naive const& b) {
+  naive r(a.num_rows(), b.num_cols(), std::vector<double>(a.num_rows() * b.num_cols()));
+  for (size_t i = 0; i < a.num_rows(); i++)
+    for (size_t j = 0; j < b.num_cols(); j++)
+      for (size_t p = 0; p < a.num_cols(); p++)
+        r.at(i, j) += a.at(i, p) * b.at(p, j);
+  return r;
+}
+
+naive plus(naive x, naive const& y) {
+  for (size_t i = 0; i < x.num_rows(); i++)
+    for (size_t j = 0; j < x.num_cols(); j++)
+      x.at(i, j) += y.at(i, j);
+  return x;
+}
+
+template<typename X, typename Y>
+bool same(X const& x, Y const& y) {
+  if (x.num_rows() != y.num_rows() || x.num_cols() != y.num_cols())
+    return false;
+  for (size_t i = 0; i < x.num_rows(); i++)
+    for (size_t j = 0; j < x.num_cols(); j++)
+      if (x.at(i, j) != y.at(i, j))
+        return false;
+  return true;
+}
+
+bool aligned(void const* p) {
+  return reinterpret_cast<uintptr_t>(p) % detail::cache_line == 0;
+}
+
+template<typename Alloc>
+void check_storage(Alloc const& alloc) {
+  naive const a = filled(37, 29, 1), b = filled(29, 41, 2), c = filled(37, 41, 3);
+  matrix<double, Alloc> m(alloc);
+  m = a * b + c;
+  CHECK(aligned(m.data()));
+  CHECK(same(m, plus(product(a, b), c)));
+}
+
+void check_arena() {
+  arena pool(1024);
+  std::vector<void*> first;
+  for (size_t bytes : {8, 100, 1000, 5000, 64})
+    first.push_back(pool.allocate(bytes));
+  for (void* p : first)
+    CHECK(aligned(p));
+  size_t const capacity = pool.capacity();
+  // the same requests after a reset land where they did before
+  pool.reset();
+  size_t k = 0;
+  for (size_t bytes : {8, 100, 1000, 5000, 64})
+    CHECK(pool.allocate(bytes) == first[k++]);
+  CHECK(pool.capacity() == capacity);
+}
+
+void check_buffer_pool() {
+  buffer_pool pool;
+  void* const p = pool.allocate(4096);
+  pool.deallocate(p, 4096);
+  CHECK(pool.cached_bytes() == 4096);
+  CHECK(pool.allocate(4096) == p);
+  CHECK(pool.cached_bytes() == 0);
+  pool.deallocate(p, 4096);
+  pool.trim();
+  CHECK(pool.cached_bytes() == 0);
+}
+
+// the product feeding another product is materialized into a scratch
+// temporary, as are the sum and the row sums of a partial reduction
+void check_scratch() {
+  naive const a = filled(130, 70, 1), b = filled(70, 90, 2), c = filled(130, 90, 3);
+  naive const d = filled(90, 90, 4);
+  naive const abc = plus(product(a, b), c), abd = product(product(a, b), d);
+  scratch_pool<double>& pool = scratch_pool<double>::local();
+  size_t capacity = 0;
+  for (int round = 0; round < 5; round++) {
+    naive m;
+    m = (a * b) * d;
+    CHECK(same(m, abd));
+    naive const sums = rowwise(a * b + c).sum();
+    for (size_t i = 0; i < abc.num_rows(); i++) {
+      double s = 0;
+      for (size_t j = 0; j < abc.num_cols(); j++)
+        s += abc.at(i, j);
+      CHECK(sums.at(i, 0) == s);
+    }
+    // the first round sized the arena
+    if (round == 0)
+      capacity = pool.capacity();
+    CHECK(capacity > 0 && pool.capacity() == capacity);
+  }
+
+  // a temporary kept across evaluations keeps its elements
+  detail::scratch_handle<double> const kept = pool.evaluate(a * b + c);
+  for (int round = 0; round < 4; round++) {
+    naive const m = (a * b) * d;
+    CHECK(same(m, abd));
+    CHECK(same(*kept, abc));
+  }
+}
+
+int main() {
+  set_default_thread_pool_size(4);
+  check_storage(aligned_allocator<double>());
+  arena local(size_t(1) << 12);
+  check_storage(arena_allocator<double>(local));
+  buffer_pool shared;
+  check_storage(pool_allocator<double>(shared));
+  check_arena();
+  check_buffer_pool();
+  check_scratch();
+  return test_result();
+}
@@ -0,0 +1,112 @@
+#include "test.hpp"
+#include "assembly.hpp"
+#include <algorithm>
+#include <map>
+#include <random>
+#include <vector>
+
+// assembly from triplets with many repeated (row, col) pairs in random
+// order, against sums kept in a std::map: duplicates are summed, new values
+// assembled through a kept pattern land in the right slots, and the same
+// triplets shuffled give the same csr arrays. sizes go past
+// max_row_buckets rows so rows share buckets, and everything runs once on
+// the calling thread and once split over a pool of four. values are small
+// integers, so sums don't depend on their order.
+
+using sums = std::map<std::pair<size_t, size_t>, double>;
+
+std::vector<triplet<double> > random_triplets(size_t rows, size_t cols, size_t n,
+                                              std::mt19937& gen) {
+  std::vector<triplet<double> > t;
+  if (rows == 0 || cols == 0)
+    return t;
+  // few distinct positions, so most of them repeat
+  size_t const distinct = std::max<size_t>(n / 4, 1);
+  std::vector<std::pair<size_t, size_t> > positions(distinct);
+  for (auto& p : positions)
+    p = {gen() % rows, gen() % cols};
+  for (size_t k = 0; k < n; k++) {
+    auto const& p = positions[gen() % distinct];
+    t.push_back({p.first, p.second, double(int(gen() % 9) - 4)});
+  }
+  return t;
+}
+
+sums sum(std::vector<triplet<double> > const& t) {
+  sums s;
+  for (auto const& x : t)
+    s[{x.row, x.col}] += x.value;
+  return s;
+}
+
+bool matches(csr_matrix<double> const& m, sums const& s) {
+  if (m.nonzeros() != s.size())
+    return false;
+  auto it = s.begin();
+  for (size_t i = 0; i < m.num_rows(); i++)
+    for (size_t p = m.row_ptr()[i]; p < m.row_ptr()[i + 1]; p++, it++)
+      if (it->first != std::make_pair(i, m.col_idx()[p]) || it->second != m.values()[p])
+        return false;
+  return true;
+}
+
+template<typename M>
+bool matches_dense(M const& m, sums const& s) {
+  for (size_t i = 0; i < m.num_rows(); i++)
+    for (size_t j = 0; j < m.num_cols(); j++) {
+      auto const it = s.find({i, j});
+      if (m.at(i, j) != (it == s.end() ? 0 : it->second))
+        return false;
+    }
+  return true;
+}
+
+void check_assembly(size_t rows, size_t cols, size_t n, unsigned seed) {
+  std::mt19937 gen(seed);
+  std::vector<triplet<double> > t = random_triplets(rows, cols, n, gen);
+  sums const expected = sum(t);
+
+  csr_matrix<double> m = assemble_csr(rows, cols, t);
+  CHECK(m.num_rows() == rows && m.num_cols() == cols);
+  CHECK(matches(m, expected));
+
+  // new values for the same positions, into the same matrix, twice
+  assembly_pattern const pattern(rows, cols, t);
+  CHECK(pattern.nonzeros() == expected.size());
+  for (int round = 0; round < 2; round++) {
+    for (auto& x : t)
+      x.value = double(int(gen() % 9) - 4);
+    pattern.assemble(t, m);
+    CHECK(matches(m, sum(t)));
+  }
+  CHECK(matches(pattern.assemble(t), sum(t)));
+
+  // the order of the triplets doesn't matter
+  std::vector<triplet<double> > shuffled = t;
+  std::shuffle(shuffled.begin(), shuffled.end(), gen);
+  csr_matrix<double> const a = assemble_csr(rows, cols, t);
+  csr_matrix<double> const b = assemble_csr(rows, cols, shuffled);
+  CHECK(a.row_ptr() == b.row_ptr());
+  CHECK(a.col_idx() == b.col_idx());
+  CHECK(a.values() == b.values());
+
+  if (rows * cols > (size_t(1) << 22))
+    return;
+  CHECK(matches_dense(assemble_dense(rows, cols, shuffled), sum(t)));
+  CHECK(matches_dense(assemble_dense<double, std::allocator<double>, col_major>(
+                        rows, cols, shuffled), sum(t)));
+}
+
+int main() {
+  set_default_thread_pool_size(4);
+  for (size_t threshold : {SIZE_MAX, size_t(1)}) {
+    set_parallel_eval_threshold(threshold);
+    check_assembly(0, 0, 0, 1);
+    check_assembly(1, 1, 10, 2);
+    check_assembly(7, 5, 100, 3);
+    check_assembly(100, 80, 2000, 4);
+    check_assembly(10000, 300, 50000, 5);
+    check_assembly(50000, 50000, 200000, 6);
+  }
+  return test_result();
+}
@@ -0,0 +1,168 @@
+#include "test.hpp"
+#include "matrix.hpp"
+#include <vector>
+
+// expressions assigned into a matrix that already has storage, against
+// naive loops: element-wise, transposed and product right-hand sides are
+// written straight into it, so its storage stays where it was while the
+// shape fits, through operator= and eval_into alike. the right-hand side
+// reading the destination (c = c + a, c = c * b, c = transpose(c) * a)
+// still sees its old elements. destinations are row- and column-major, at
+// sizes past the gemm micro-tile and parallel_eval_threshold().
+
+template<typename L>
+using dense = matrix<double, std::allocator<double>, L>;
+using naive = matrix<double>;
+
+template<typename L>
+dense<L> filled(size_t rows, size_t cols, size_t seed) {
+  dense<L> m(naive(rows, cols, std::vector<double>(rows * cols)));
+  for (size_t i = 0; i < rows; i++)
+    for (size_t j = 0; j < cols; j++)
+      m.at(i, j) = double(int((i * 7 + j * 3 + seed * 5) % 9) - 4);
+  return m;
+}
+
+// x and y element by element, scaled: alpha * x + beta * y
+template<typename X, typename Y>
+naive combine(double alpha, X const& x, double beta, Y const& y) {
+  naive r(x.num_rows(), x.num_cols(), std::vector<double>(x.num_rows() * x.num_cols()));
+  for (size_t i = 0; i < x.num_rows(); i++)
+    for (size_t j = 0; j < x.num_cols(); j++)
+      r.at(i, j) = alpha * x.at(i, j) + beta * y.at(i, j);
+  return r;
+}
+
+template<typename X, typename Y>
+naive product(X const& x, Y const& y) {
+  naive r(x.num_rows(), y.num_cols(), std::vector<double>(x.num_rows() * y.num_cols()));
+  for (size_t i = 0; i < x.num_rows(); i++)
+    for (size_t j = 0; j < y.num_cols(); j++)
+      for (size_t p = 0; p < x.num_cols(); p++)
+        r.at(i, j) += x.at(i, p) * y.at(p, j);
+  return r;
+}
+
+template<typename X>
+naive transposed(X const& x) {
+  naive r(x.num_cols(), x.num_rows(), std::vector<double>(x.num_rows() * x.num_cols()));
+  for (size_t i = 0; i < x.num_rows(); i++)
+    for (size_t j = 0; j < x.num_cols(); j++)
+      r.at(j, i) = x.at(i, j);
+  return r;
+}
+
+template<typename X, typename Y>
+bool same(X const& x, Y const& y) {
+  if (x.num_rows() != y.num_rows() || x.num_cols() != y.num_cols())
+    return false;
+  for (size_t i = 0; i < x.num_rows(); i++)
+    for (size_t j = 0; j < x.num_cols(); j++)
+      if (x.at(i, j) != y.at(i, j))
+        return false;
+  return true;
+}
+
+template<typename L>
+void check_storage(size_t n) {
+  dense<L> const a = filled<L>(n, n, 1), b = filled<L>(n, n, 2), c0 = filled<L>(n, n, 3);
+
+  dense<L> c = c0;
+  double const* const storage = c.data();
+  c = a + b * 2.0;
+  CHECK(same(c, combine(1, a, 2, b)));
+  c = transpose(a);
+  CHECK(same(c, transposed(a)));
+  c = a * b;
+  CHECK(same(c, product(a, b)));
+  c = a * b - c0;
+  CHECK(same(c, combine(1, product(a, b), -1, c0)));
+  eval_into(c, a - b);
+  CHECK(same(c, combine(1, a, -1, b)));
+  eval_into(c, transpose(b) * a);
+  CHECK(same(c, product(transposed(b), a)));
+  CHECK(c.data() == storage);
+
+  // a smaller shape fits the storage there is
+  if (n > 1) {
+    c = block(a, 0, 0, n - 1, n / 2) + block(b, 1, 1, n - 1, n / 2);
+    naive expected(n - 1, n / 2, std::vector<double>((n - 1) * (n / 2)));
+    for (size_t i = 0; i + 1 < n; i++)
+      for (size_t j = 0; j < n / 2; j++)
+        expected.at(i, j) = a.at(i, j) + b.at(i + 1, j + 1);
+    CHECK(same(c, expected));
+    CHECK(c.data() == storage);
+  }
+
+  // a larger one doesn't, but the elements are all there
+  dense<L> const big = filled<L>(n + 5, n + 3, 4);
+  c = big * 3.0;
+  CHECK(same(c, combine(3, big, 0, big)));
+}
+
+// right-hand sides that read the destination
+template<typename L>
+void check_aliased(size_t n) {
+  dense<L> const a = filled<L>(n, n, 1), b = filled<L>(n, n, 2), c0 = filled<L>(n, n, 3);
+
+  dense<L> c = c0;
+  c = c + a;
+  CHECK(same(c, combine(1, c0, 1, a)));
+  c = c0;
+  c = a - c * 2.0;
+  CHECK(same(c, combine(1, a, -2, c0)));
+  c = c0;
+  c = transpose(c) - c;
+  CHECK(same(c, combine(1, transposed(c0), -1, c0)));
+  c = c0;
+  c = c * b;
+  CHECK(same(c, product(c0, b)));
+  c = c0;
+  c = b * c;
+  CHECK(same(c, product(b, c0)));
+  c = c0;
+  c = c * c;
+  CHECK(same(c, product(c0, c0)));
+  c = c0;
+  c = transpose(c) * a;
+  CHECK(same(c, product(transposed(c0), a)));
+  c = c0;
+  eval_into(c, a * transpose(c));
+  CHECK(same(c, product(a, transposed(c0))));
+  c = c0;
+  c = (c + a) * (b - c);
+  CHECK(same(c, product(combine(1, c0, 1, a), combine(1, b, -1, c0))));
+}
+
+// the elements handed back out leave an empty matrix, which can be
+// assigned to again
+template<typename L>
+void check_release() {
+  dense<L> const a = filled<L>(4, 3, 1);
+  dense<L> c = a;
+  double const* const storage = c.data();
+  std::vector<double> const v = c.release();
+  CHECK(c.num_rows() == 0 && c.num_cols() == 0);
+  CHECK(v.size() == 12 && v.data() == storage);
+  for (size_t i = 0; i < 4; i++)
+    for (size_t j = 0; j < 3; j++)
+      CHECK(v[L::index(i, j, 4, 3)] == a.at(i, j));
+  c = a * 2.0;
+  CHECK(same(c, combine(2, a, 0, a)));
+}
+
+int main() {
+  set_default_thread_pool_size(4);
+  size_t const default_threshold = parallel_eval_threshold();
+  for (size_t n : {1, 3, 17, 64, 130, 301})
+    for (size_t threshold : {size_t(1), default_threshold}) {
+      set_parallel_eval_threshold(threshold);
+      check_storage<row_major>(n);
+      check_storage<col_major>(n);
+      check_aliased<row_major>(n);
+      check_aliased<col_major>(n);
+    }
+  check_release<row_major>();
+  check_release<col_major>();
+  return test_result();
+}
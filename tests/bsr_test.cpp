@@ -0,0 +1,101 @@
+#include "test.hpp"
+#include "sparse.hpp"
+#include <random>
+#include <vector>
+
+// products of bsr_matrix<T, 4> with dense operands on either side, against
+// the same products of the dense matrix it was made from. the block pattern
+// is random, with empty block rows and columns, and the dense operands are
+// wide enough for the microkernel path as well as a few columns or rows
+// narrow for the plain loop. elements are small integers, so the results
+// are exact.
+
+template<typename T>
+using dense = matrix<T>;
+
+template<typename T>
+using dense_cm = matrix<T, std::allocator<T>, col_major>;
+
+// rows x cols of 4 x 4 blocks, each stored with probability density and
+// holding a few zeros of its own
+template<typename T>
+dense<T> block_sparse(size_t rows, size_t cols, double density, unsigned seed) {
+  std::mt19937 gen(seed);
+  std::uniform_real_distribution<double> pick(0, 1);
+  std::vector<T> v(rows * cols);
+  for (size_t I = 0; I < rows / 4; I++)
+    for (size_t J = 0; J < cols / 4; J++)
+      if (pick(gen) < density)
+        for (size_t i = I * 4; i < I * 4 + 4; i++)
+          for (size_t j = J * 4; j < J * 4 + 4; j++)
+            v[i * cols + j] = T(int(gen() % 7) - 3);
+  return dense<T>(rows, cols, std::move(v));
+}
+
+template<typename T>
+dense<T> filled(size_t rows, size_t cols, int seed) {
+  std::vector<T> v(rows * cols);
+  for (size_t i = 0; i < v.size(); i++)
+    v[i] = T(int((i * 7 + seed * 13) % 9) - 4);
+  return dense<T>(rows, cols, std::move(v));
+}
+
+template<typename E1, typename E2>
+bool same(matrix_expr<E1> const& x, matrix_expr<E2> const& y) {
+  E1 const& a = static_cast<E1 const&>(x);
+  E2 const& b = static_cast<E2 const&>(y);
+  if (a.num_rows() != b.num_rows() || a.num_cols() != b.num_cols())
+    return false;
+  for (size_t i = 0; i < a.num_rows(); i++)
+    for (size_t j = 0; j < a.num_cols(); j++)
+      if (a.at(i, j) != b.at(i, j))
+        return false;
+  return true;
+}
+
+template<typename T>
+void check_bsr(size_t rows, size_t cols, size_t n, double density, unsigned seed) {
+  dense<T> const d = block_sparse<T>(rows, cols, density, seed);
+  bsr_matrix<T, 4> const s(d);
+  CHECK(same(s, d));
+
+  dense<T> const x = filled<T>(cols, n, 1);
+  dense_cm<T> const x_cm(x);
+  dense<T> const dx = d * x;
+  dense<T> const sx = s * x;
+  CHECK(same(sx, dx));
+  dense<T> const sx_cm = s * x_cm;
+  CHECK(same(sx_cm, dx));
+  dense_cm<T> const cm_sx = s * x;
+  CHECK(same(cm_sx, dx));
+
+  dense<T> const y = filled<T>(n, rows, 2);
+  dense_cm<T> const y_cm(y);
+  dense<T> const yd = y * d;
+  dense<T> const ys = y * s;
+  CHECK(same(ys, yd));
+  dense<T> const ys_cm = y_cm * s;
+  CHECK(same(ys_cm, yd));
+  dense_cm<T> const cm_ys = y * s;
+  CHECK(same(cm_ys, yd));
+}
+
+template<typename T>
+void check_type() {
+  for (size_t n : {1, 3, 8, 37, 130}) {
+    check_bsr<T>(64, 96, n, 0.3, unsigned(n));
+    check_bsr<T>(4, 4, n, 1, unsigned(n) + 1);
+    check_bsr<T>(200, 120, n, 0.05, unsigned(n) + 2);
+  }
+  check_bsr<T>(32, 48, 16, 0, 3);
+}
+
+int main() {
+  set_default_thread_pool_size(4);
+  for (size_t threshold : {SIZE_MAX, size_t(1)}) {
+    set_parallel_eval_threshold(threshold);
+    check_type<double>();
+    check_type<float>();
+  }
+  return test_result();
+}
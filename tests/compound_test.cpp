@@ -0,0 +1,161 @@
+#include "test.hpp"
+#include "matrix.hpp"
+#include <vector>
+
+// +=, -= and *= updating a matrix in place, against naive loops, with the
+// right-hand side reading the destination: at the element being written
+// (c += c, c -= 2 * c), elsewhere (c -= transpose(c), a shifted block of c)
+// and as a factor (c *= c, c *= transpose(c)). destinations are row- and
+// column-major, at sizes past the gemm micro-tile and
+// parallel_eval_threshold(). elements are small integers, so the products
+// are exact.
+
+template<typename L>
+using dense = matrix<double, std::allocator<double>, L>;
+using naive = matrix<double>;
+
+template<typename L>
+dense<L> filled(size_t rows, size_t cols, size_t seed) {
+  dense<L> m(naive(rows, cols, std::vector<double>(rows * cols)));
+  for (size_t i = 0; i < rows; i++)
+    for (size_t j = 0; j < cols; j++)
+      m.at(i, j) = double(int((i * 7 + j * 3 + seed * 5) % 9) - 4);
+  return m;
+}
+
+// x and y element by element, scaled: alpha * x + beta * y
+template<typename X, typename Y>
+naive combine(double alpha, X const& x, double beta, Y const& y) {
+  naive r(x.num_rows(), x.num_cols(), std::vector<double>(x.num_rows() * x.num_cols()));
+  for (size_t i = 0; i < x.num_rows(); i++)
+    for (size_t j = 0; j < x.num_cols(); j++)
+      r.at(i, j) = alpha * x.at(i, j) + beta * y.at(i, j);
+  return r;
+}
+
+template<typename X, typename Y>
+naive product(X const& x, Y const& y) {
+  naive r(x.num_rows(), y.num_cols(), std::vector<double>(x.num_rows() * y.num_cols()));
+  for (size_t i = 0; i < x.num_rows(); i++)
+    for (size_t j = 0; j < y.num_cols(); j++)
+      for (size_t p = 0; p < x.num_cols(); p++)
+        r.at(i, j) += x.at(i, p) * y.at(p, j);
+  return r;
+}
+
+template<typename X>
+naive transposed(X const& x) {
+  naive r(x.num_cols(), x.num_rows(), std::vector<double>(x.num_rows() * x.num_cols()));
+  for (size_t i = 0; i < x.num_rows(); i++)
+    for (size_t j = 0; j < x.num_cols(); j++)
+      r.at(j, i) = x.at(i, j);
+  return r;
+}
+
+template<typename X, typename Y>
+bool same(X const& x, Y const& y) {
+  if (x.num_rows() != y.num_rows() || x.num_cols() != y.num_cols())
+    return false;
+  for (size_t i = 0; i < x.num_rows(); i++)
+    for (size_t j = 0; j < x.num_cols(); j++)
+      if (x.at(i, j) != y.at(i, j))
+        return false;
+  return true;
+}
+
+template<typename L>
+void check_square(size_t n) {
+  dense<L> const a = filled<L>(n, n, 1), c0 = filled<L>(n, n, 3);
+
+  dense<L> c = c0;
+  double const* const storage = c.data();
+  c += a;
+  CHECK(same(c, combine(1, c0, 1, a)));
+  c -= a;
+  CHECK(same(c, c0));
+  c *= 3.0;
+  CHECK(same(c, combine(3, c0, 0, c0)));
+  // none of the above needed new storage
+  CHECK(c.data() == storage);
+
+  // the destination at the element being written
+  c = c0;
+  c += c;
+  CHECK(same(c, combine(2, c0, 0, c0)));
+  c = c0;
+  c -= 2.0 * c;
+  CHECK(same(c, combine(-1, c0, 0, c0)));
+  c = c0;
+  c += a - c;
+  CHECK(same(c, a));
+
+  // elsewhere
+  c = c0;
+  c -= transpose(c);
+  CHECK(same(c, combine(1, c0, -1, transposed(c0))));
+  c = c0;
+  c += transpose(c) + transpose(a);
+  CHECK(same(c, combine(1, combine(1, c0, 1, transposed(c0)), 1, transposed(a))));
+  if (n > 1) {
+    c = c0;
+    block(c, 0, 0, n - 1, n - 1) += block(c, 1, 1, n - 1, n - 1);
+    naive expected = c0;
+    for (size_t i = 0; i + 1 < n; i++)
+      for (size_t j = 0; j + 1 < n; j++)
+        expected.at(i, j) += c0.at(i + 1, j + 1);
+    CHECK(same(c, expected));
+
+    c = c0;
+    block(c, 1, 0, n - 1, n) -= block(c, 0, 0, n - 1, n) * 2.0;
+    expected = c0;
+    for (size_t i = 1; i < n; i++)
+      for (size_t j = 0; j < n; j++)
+        expected.at(i, j) -= 2 * c0.at(i - 1, j);
+    CHECK(same(c, expected));
+  }
+
+  // as a factor
+  c = c0;
+  c *= a;
+  CHECK(same(c, product(c0, a)));
+  c = c0;
+  c *= c;
+  CHECK(same(c, product(c0, c0)));
+  c = c0;
+  c *= transpose(c);
+  CHECK(same(c, product(c0, transposed(c0))));
+  c = c0;
+  c *= a + c;
+  CHECK(same(c, product(c0, combine(1, a, 1, c0))));
+  c = c0;
+  c += c * a;
+  CHECK(same(c, combine(1, c0, 1, product(c0, a))));
+}
+
+// c (m x k) *= b (k x n) changes the shape
+template<typename L>
+void check_rectangular(size_t m, size_t n, size_t k) {
+  dense<L> const b = filled<L>(k, n, 2), c0 = filled<L>(m, k, 3);
+  dense<L> c = c0;
+  c *= b;
+  CHECK(same(c, product(c0, b)));
+  c = c0;
+  c *= b * 2.0;
+  CHECK(same(c, combine(2, product(c0, b), 0, product(c0, b))));
+}
+
+int main() {
+  set_default_thread_pool_size(4);
+  size_t const default_threshold = parallel_eval_threshold();
+  for (size_t n : {1, 3, 17, 64, 130, 301})
+    for (size_t threshold : {size_t(1), default_threshold}) {
+      set_parallel_eval_threshold(threshold);
+      check_square<row_major>(n);
+      check_square<col_major>(n);
+    }
+  check_rectangular<row_major>(5, 7, 4);
+  check_rectangular<col_major>(5, 7, 4);
+  check_rectangular<row_major>(129, 65, 300);
+  check_rectangular<col_major>(129, 65, 300);
+  return test_result();
+}
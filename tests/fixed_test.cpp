@@ -0,0 +1,183 @@
+#include "test.hpp"
+#include "fixed.hpp"
+
+// fixed size matrices in constant expressions, down to C++14: the example
+// of the fixed_matrix documentation and the compound assignments, checked
+// by static_assert, then the same expressions at run time, where they go
+// through packets instead. then the 3 x 3, 4 x 4 and 6 x 6 transforms at
+// run time against naive loops: products, inline in larger expressions or
+// nested, sums, compound assignments reading the destination, and mixed
+// with matrix<T> on either side.
+
+constexpr fixed_matrix<double, 2, 2> flip = { {0, 1}, {1, 0} };
+constexpr fixed_matrix<double, 2, 2> m = flip * flip + flip;
+static_assert(m.at(0, 0) == 1 && m.at(0, 1) == 1 &&
+              m.at(1, 0) == 1 && m.at(1, 1) == 1, "flip * flip + flip");
+
+constexpr fixed_matrix<int, 2, 3> a = { {1, 2, 3}, {4, 5, 6} };
+constexpr fixed_matrix<int, 3, 2> at = transpose(a);
+constexpr fixed_matrix<int, 2, 2> aat = a * at;
+static_assert(at.at(2, 0) == 3 && at.at(0, 1) == 4, "transpose");
+static_assert(aat.at(0, 0) == 14 && aat.at(0, 1) == 32 &&
+              aat.at(1, 0) == 32 && aat.at(1, 1) == 77, "a * a'");
+
+constexpr fixed_matrix<int, 2, 2> compound() {
+  fixed_matrix<int, 2, 2> r = { {1, 2}, {3, 4} };
+  fixed_matrix<int, 2, 2> const s = r;
+  r += s;            // 2 4 / 6 8
+  r -= s * s;        // 2 4 / 6 8 - 7 10 / 15 22
+  r *= 2;            // -10 -12 / -18 -28
+  r *= s;            // -46 -68 / -102 -148
+  return r;
+}
+
+constexpr fixed_matrix<int, 2, 2> c = compound();
+static_assert(c.at(0, 0) == -46 && c.at(0, 1) == -68 &&
+              c.at(1, 0) == -102 && c.at(1, 1) == -148, "compound assignments");
+
+template<typename X>
+X& filled(X& x, size_t seed) {
+  for (size_t i = 0; i < x.num_rows(); i++)
+    for (size_t j = 0; j < x.num_cols(); j++)
+      x.at(i, j) = int((i * 7 + j * 3 + seed * 5) % 9) - 4;
+  return x;
+}
+
+template<typename T>
+using naive = matrix<T>;
+
+// x and y element by element, scaled: alpha * x + beta * y
+template<typename T, typename X, typename Y>
+naive<T> combine(T alpha, X const& x, T beta, Y const& y) {
+  naive<T> r(x.num_rows(), x.num_cols(), std::vector<T>(x.num_rows() * x.num_cols()));
+  for (size_t i = 0; i < x.num_rows(); i++)
+    for (size_t j = 0; j < x.num_cols(); j++)
+      r.at(i, j) = alpha * x.at(i, j) + beta * y.at(i, j);
+  return r;
+}
+
+template<typename T, typename X, typename Y>
+naive<T> product(X const& x, Y const& y) {
+  naive<T> r(x.num_rows(), y.num_cols(), std::vector<T>(x.num_rows() * y.num_cols()));
+  for (size_t i = 0; i < x.num_rows(); i++)
+    for (size_t j = 0; j < y.num_cols(); j++)
+      for (size_t p = 0; p < x.num_cols(); p++)
+        r.at(i, j) += x.at(i, p) * y.at(p, j);
+  return r;
+}
+
+template<typename T, typename X>
+naive<T> transposed(X const& x) {
+  naive<T> r(x.num_cols(), x.num_rows(), std::vector<T>(x.num_rows() * x.num_cols()));
+  for (size_t i = 0; i < x.num_rows(); i++)
+    for (size_t j = 0; j < x.num_cols(); j++)
+      r.at(j, i) = x.at(i, j);
+  return r;
+}
+
+template<typename X, typename Y>
+bool same(X const& x, Y const& y) {
+  if (x.num_rows() != y.num_rows() || x.num_cols() != y.num_cols())
+    return false;
+  for (size_t i = 0; i < x.num_rows(); i++)
+    for (size_t j = 0; j < x.num_cols(); j++)
+      if (x.at(i, j) != y.at(i, j))
+        return false;
+  return true;
+}
+
+template<typename T, size_t N>
+void check_transform() {
+  using fixed = fixed_matrix<T, N, N>;
+  fixed a, b, c;
+  filled(a, 1);
+  filled(b, 2);
+  filled(c, 3);
+  naive<T> const ab = product<T>(a, b);
+
+  fixed r = a * b;
+  CHECK(same(r, ab));
+  r = a * b + c;
+  CHECK(same(r, combine<T>(1, ab, 1, c)));
+  r = c - T(2) * (a * b);
+  CHECK(same(r, combine<T>(1, c, -2, ab)));
+  r = a * b * c;
+  CHECK(same(r, product<T>(ab, c)));
+  r = transpose(a) * b;
+  CHECK(same(r, product<T>(transposed<T>(a), b)));
+  r = a * transpose(b) + transpose(c);
+  CHECK(same(r, combine<T>(1, product<T>(a, transposed<T>(b)), 1, transposed<T>(c))));
+  r = (a + c) * (b - c);
+  CHECK(same(r, product<T>(combine<T>(1, a, 1, c), combine<T>(1, b, -1, c))));
+  r = a + b - c * T(3);
+  CHECK(same(r, combine<T>(1, combine<T>(1, a, 1, b), -3, c)));
+
+  // the destination on the right-hand side
+  r = c;
+  r = r * a;
+  CHECK(same(r, product<T>(c, a)));
+  r = c;
+  r = a * r + r;
+  CHECK(same(r, combine<T>(1, product<T>(a, c), 1, c)));
+  r = c;
+  r *= r;
+  CHECK(same(r, product<T>(c, c)));
+  r = c;
+  r += r * b;
+  CHECK(same(r, combine<T>(1, c, 1, product<T>(c, b))));
+  r = c;
+  r -= transpose(r);
+  CHECK(same(r, combine<T>(1, c, -1, transposed<T>(c))));
+
+  // with matrix<T>, in either order and as the destination
+  naive<T> d(N, N, std::vector<T>(N * N));
+  filled(d, 4);
+  naive<T> m = a * d;
+  CHECK(same(m, product<T>(a, d)));
+  m = d * a + b;
+  CHECK(same(m, combine<T>(1, product<T>(d, a), 1, b)));
+  m = a + d;
+  CHECK(same(m, combine<T>(1, a, 1, d)));
+  r = d * a - c;
+  CHECK(same(r, combine<T>(1, product<T>(d, a), -1, c)));
+  r = a;
+  r += d;
+  CHECK(same(r, combine<T>(1, a, 1, d)));
+  r = a;
+  r *= d;
+  CHECK(same(r, product<T>(a, d)));
+  naive<T> wide(N, 2 * N + 1, std::vector<T>(N * (2 * N + 1)));
+  filled(wide, 5);
+  m = a * wide;
+  CHECK(same(m, product<T>(a, wide)));
+}
+
+template<typename T>
+void check_transforms() {
+  check_transform<T, 3>();
+  check_transform<T, 4>();
+  check_transform<T, 6>();
+}
+
+int main() {
+  fixed_matrix<double, 2, 2> f = flip;
+  fixed_matrix<double, 2, 2> const g = f * f + f;
+  for (size_t i = 0; i < 2; i++)
+    for (size_t j = 0; j < 2; j++)
+      CHECK(g.at(i, j) == m.at(i, j));
+
+  fixed_matrix<int, 2, 2> r = { {1, 2}, {3, 4} };
+  fixed_matrix<int, 2, 2> const s = r;
+  r += s;
+  r -= s * s;
+  r *= 2;
+  r *= s;
+  for (size_t i = 0; i < 2; i++)
+    for (size_t j = 0; j < 2; j++)
+      CHECK(r.at(i, j) == c.at(i, j));
+
+  check_transforms<double>();
+  check_transforms<float>();
+  check_transforms<int>();
+  return test_result();
+}
@@ -0,0 +1,241 @@
+#include "test.hpp"
+#include "matrix.hpp"
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+// scaled products and their sums with another operand, which the evaluator
+// fuses into one gemm call (see detail::gemm_expr), against naive loops.
+// the cases that matter are those where the destination is also read:
+// as the added term (c = a * b + c, c -= 2 * (a * b)), transposed
+// (c = a * b + transpose(c)), or as a factor (c = c * b + c, c += c * b),
+// and transposed factors on either side of the product. destinations are
+// row- and column-major, square sizes past the gemm micro-tile and
+// parallel_eval_threshold(). elements are small integers, so the products
+// are exact.
+
+template<typename L>
+using dense = matrix<double, std::allocator<double>, L>;
+using naive = matrix<double>;
+
+template<typename L>
+dense<L> filled(size_t rows, size_t cols, size_t seed) {
+  dense<L> m(naive(rows, cols, std::vector<double>(rows * cols)));
+  for (size_t i = 0; i < rows; i++)
+    for (size_t j = 0; j < cols; j++)
+      m.at(i, j) = double(int((i * 7 + j * 3 + seed * 5) % 9) - 4);
+  return m;
+}
+
+// x and y element by element, scaled: alpha * x + beta * y
+template<typename X, typename Y>
+naive combine(double alpha, X const& x, double beta, Y const& y) {
+  naive r(x.num_rows(), x.num_cols(), std::vector<double>(x.num_rows() * x.num_cols()));
+  for (size_t i = 0; i < x.num_rows(); i++)
+    for (size_t j = 0; j < x.num_cols(); j++)
+      r.at(i, j) = alpha * x.at(i, j) + beta * y.at(i, j);
+  return r;
+}
+
+template<typename X, typename Y>
+naive product(X const& x, Y const& y) {
+  naive r(x.num_rows(), y.num_cols(), std::vector<double>(x.num_rows() * y.num_cols()));
+  for (size_t i = 0; i < x.num_rows(); i++)
+    for (size_t j = 0; j < y.num_cols(); j++)
+      for (size_t p = 0; p < x.num_cols(); p++)
+        r.at(i, j) += x.at(i, p) * y.at(p, j);
+  return r;
+}
+
+template<typename X>
+naive transposed(X const& x) {
+  naive r(x.num_cols(), x.num_rows(), std::vector<double>(x.num_rows() * x.num_cols()));
+  for (size_t i = 0; i < x.num_rows(); i++)
+    for (size_t j = 0; j < x.num_cols(); j++)
+      r.at(j, i) = x.at(i, j);
+  return r;
+}
+
+template<typename X, typename Y>
+bool same(X const& x, Y const& y) {
+  if (x.num_rows() != y.num_rows() || x.num_cols() != y.num_cols())
+    return false;
+  for (size_t i = 0; i < x.num_rows(); i++)
+    for (size_t j = 0; j < x.num_cols(); j++)
+      if (x.at(i, j) != y.at(i, j))
+        return false;
+  return true;
+}
+
+// the assignments below really take the fused path
+template<typename E>
+using fused = std::is_same<detail::eval_tag<E, double, row_major>, detail::gemm_tag>;
+
+naive const x, y, z;
+static_assert(fused<decltype(x * y + transpose(z))>::value, "c = a * b + c'");
+static_assert(fused<decltype(2 * (x * y))>::value, "c -= 2 * (a * b)");
+static_assert(fused<decltype(transpose(x) * y + z)>::value, "c = a' * b + c");
+static_assert(fused<decltype(x * transpose(y) * 2.0 - z)>::value, "c = a * b' * 2 - c");
+static_assert(fused<decltype(transpose(y) * transpose(x) * -1.0 + transpose(z))>::value,
+              "c = -b' * a' + c'");
+static_assert(fused<decltype(0.5 * z + transpose(x * y) * 3.0)>::value, "c = c / 2 + 3 (a * b)'");
+static_assert(fused<decltype(z * y + z)>::value, "c = c * b + c");
+
+template<typename L>
+void check_square(size_t n) {
+  dense<L> const a = filled<L>(n, n, 1), b = filled<L>(n, n, 2), c0 = filled<L>(n, n, 3);
+  naive const ab = product(a, b);
+  naive const tab = product(transposed(a), b), atb = product(a, transposed(b));
+
+  dense<L> c = c0;
+  c = a * b + transpose(c);
+  CHECK(same(c, combine(1, ab, 1, transposed(c0))));
+
+  c = c0;
+  c -= 2 * (a * b);
+  CHECK(same(c, combine(1, c0, -2, ab)));
+
+  c = c0;
+  c += a * b;
+  CHECK(same(c, combine(1, c0, 1, ab)));
+
+  c = c0;
+  c = 2.0 * (a * b) + 3.0 * c;
+  CHECK(same(c, combine(2, ab, 3, c0)));
+
+  c = c0;
+  c = c - a * b;
+  CHECK(same(c, combine(1, c0, -1, ab)));
+
+  // transposed factors, on either side
+  c = c0;
+  c = transpose(a) * b + c;
+  CHECK(same(c, combine(1, tab, 1, c0)));
+
+  c = c0;
+  c = a * transpose(b) * 2.0 - c;
+  CHECK(same(c, combine(2, atb, -1, c0)));
+
+  c = c0;
+  c -= transpose(a) * b;
+  CHECK(same(c, combine(1, c0, -1, tab)));
+
+  c = c0;
+  c = transpose(b) * transpose(a) * -1.0 + transpose(c);
+  CHECK(same(c, combine(-1, transposed(ab), 1, transposed(c0))));
+
+  c = c0;
+  c = 0.5 * c + transpose(a * b) * 3.0;
+  CHECK(same(c, combine(0.5, c0, 3, transposed(ab))));
+
+  // the destination as a factor
+  c = c0;
+  c = c * b + c;
+  CHECK(same(c, combine(1, product(c0, b), 1, c0)));
+
+  c = c0;
+  c += c * b;
+  CHECK(same(c, combine(1, c0, 1, product(c0, b))));
+
+  c = c0;
+  c = 2 * (a * transpose(c)) - c;
+  CHECK(same(c, combine(2, product(a, transposed(c0)), -1, c0)));
+}
+
+template<typename L>
+void check_rectangular(size_t m, size_t n, size_t k) {
+  dense<L> const a = filled<L>(m, k, 1), b = filled<L>(k, n, 2), c0 = filled<L>(m, n, 3);
+  dense<L> const at = filled<L>(k, m, 4), bt = filled<L>(n, k, 5);
+  naive const ab = product(a, b);
+
+  dense<L> c = c0;
+  c -= 2 * (a * b);
+  CHECK(same(c, combine(1, c0, -2, ab)));
+
+  c = c0;
+  c = transpose(at) * b - c;
+  CHECK(same(c, combine(1, product(transposed(at), b), -1, c0)));
+
+  c = c0;
+  c = 3 * (a * transpose(bt)) + c;
+  CHECK(same(c, combine(3, product(a, transposed(bt)), 1, c0)));
+
+  c = c0;
+  c += transpose(at) * transpose(bt);
+  CHECK(same(c, combine(1, c0, 1, product(transposed(at), transposed(bt)))));
+}
+
+double largest(naive const& x) {
+  double r = x.at(0, 0);
+  for (size_t i = 0; i < x.num_rows(); i++)
+    for (size_t j = 0; j < x.num_cols(); j++)
+      r = std::max(r, x.at(i, j));
+  return r;
+}
+
+// a named expression holding products is evaluated anew each time: the
+// products are materialized for one evaluation only, so an operand changed
+// in between shows in the next one, through assignment and reductions alike
+void check_reevaluation(size_t n) {
+  naive a = filled<row_major>(n, n, 1);
+  naive const b = filled<row_major>(n, n, 2), c = filled<row_major>(n, n, 3);
+  double const two = 2;
+  auto const p = a * b;
+  auto const q = c - c;
+  auto const e = q + p;
+  auto const f = e * two;
+  for (int round = 0; round < 3; round++) {
+    naive const expected = combine(2, product(a, b), 0, c);
+    naive m = f;
+    CHECK(same(m, expected));
+    CHECK(max(f) == largest(expected));
+    m = f;
+    CHECK(same(m, expected));
+    // p is read while an operand of another product, which reads it too,
+    // is evaluated aside
+    m = p + (p + c) * b;
+    CHECK(same(m, combine(1, product(a, b), 1,
+                          product(combine(1, product(a, b), 1, c), b))));
+    a.at(0, 0) += 100;
+    a.at(n - 1, n / 2) -= 7;
+  }
+}
+
+// temporaries of the scratch pool dropped on another thread than the one
+// that made them: after that thread is gone, and while it keeps using its
+// pool
+void check_scratch_threads() {
+  naive const a = filled<row_major>(9, 6, 1), b = filled<row_major>(6, 9, 2);
+  naive const ab = product(a, b);
+  detail::scratch_handle<double> kept;
+  std::thread([&] { kept = scratch_pool<double>::local().evaluate(a * b); }).join();
+  CHECK(same(*kept, ab));
+  kept.reset();
+
+  std::vector<detail::scratch_handle<double> > handles;
+  for (int k = 0; k < 64; k++)
+    handles.push_back(scratch_pool<double>::local().evaluate(a * b));
+  std::thread dropper([&] { handles.clear(); });
+  for (int k = 0; k < 64; k++)
+    CHECK(same(*scratch_pool<double>::local().evaluate(a * b), ab));
+  dropper.join();
+}
+
+int main() {
+  set_default_thread_pool_size(4);
+  size_t const default_threshold = parallel_eval_threshold();
+  for (size_t n : {1, 3, 17, 64, 130, 301})
+    for (size_t threshold : {size_t(1), default_threshold}) {
+      set_parallel_eval_threshold(threshold);
+      check_square<row_major>(n);
+      check_square<col_major>(n);
+    }
+  check_rectangular<row_major>(5, 7, 4);
+  check_rectangular<col_major>(5, 7, 4);
+  check_rectangular<row_major>(129, 65, 300);
+  check_rectangular<col_major>(129, 65, 300);
+  check_reevaluation(3);
+  check_reevaluation(70);
+  check_scratch_threads();
+  return test_result();
+}
@@ -0,0 +1,64 @@
+#include "test.hpp"
+#include "gemm.hpp"
+#include <cstdint>
+#include <vector>
+
+// every kernel the host has, for each element type with vector kernels,
+// against a triple loop: shapes that aren't multiples of the micro-tile or
+// of kc, so edge tiles go through gemm_write_back and products span several
+// panels along k, row- and column-major C, and the alpha and beta cases the
+// write-back distinguishes. elements are small integers, so every type
+// computes the exact same result.
+
+template<typename T>
+std::vector<T> values(size_t n, int seed) {
+  std::vector<T> v(n);
+  for (size_t i = 0; i < n; i++)
+    v[i] = T(int((i * 7 + seed * 13) % 9) - 4);
+  return v;
+}
+
+template<typename T>
+void check_product(size_t m, size_t n, size_t k, T alpha, T beta, bool col_major_c) {
+  std::vector<T> const a = values<T>(m * k, 1), b = values<T>(k * n, 2);
+  std::vector<T> c = values<T>(m * n, 3), expected = c;
+  std::ptrdiff_t const rs_c = col_major_c ? 1 : n, cs_c = col_major_c ? m : 1;
+  for (size_t i = 0; i < m; i++)
+    for (size_t j = 0; j < n; j++) {
+      T sum = T();
+      for (size_t p = 0; p < k; p++)
+        sum += a[i * k + p] * b[p * n + j];
+      T& e = expected[i * rs_c + j * cs_c];
+      e = alpha * sum + beta * e;
+    }
+  gemm<T>(m, n, k, alpha, a.data(), k, 1, b.data(), n, 1, beta, c.data(), rs_c, cs_c);
+  CHECK(c == expected);
+}
+
+template<typename T>
+void check_type() {
+  size_t const sizes[] = {1, 3, 7, 17, 130, 301};
+  T const scalings[][2] = {{T(1), T(0)}, {T(2), T(0)}, {T(1), T(1)}, {T(-1), T(3)}};
+  for (size_t m : sizes)
+    for (size_t n : sizes)
+      for (size_t k : sizes) {
+        if (m * n * k > 200 * 200 * 200)
+          continue;
+        for (auto const& s : scalings)
+          for (bool col_major_c : {false, true})
+            check_product<T>(m, n, k, s[0], s[1], col_major_c);
+      }
+}
+
+int main() {
+  gemm_isa const isas[] = {gemm_isa::scalar, gemm_isa::sse42, gemm_isa::avx2,
+                           gemm_isa::avx512};
+  for (gemm_isa isa : isas) {
+    if (set_gemm_kernel_isa(isa) != isa)
+      continue; // not supported here
+    check_type<double>();
+    check_type<float>();
+    check_type<std::int32_t>();
+  }
+  return test_result();
+}
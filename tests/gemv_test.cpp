@@ -0,0 +1,215 @@
+#include "test.hpp"
+#include "vector.hpp"
+#include <cmath>
+#include <limits>
+#include <vector>
+
+// matrix-vector products against naive loops. first the gemv engine of
+// gemv.hpp on raw memory: A with contiguous rows, contiguous columns or
+// neither, x and y with unit and larger increments, alpha and beta other
+// than one and zero, y left unread at beta == 0 (it starts out NaN) and
+// untouched between its increments, at sizes past the four rows and
+// columns the kernels take at a time and past gemv_parallel_work. then the
+// same through col_vector and row_vector: a * x and x * a, gemv() and
+// gevm(), x a column of a matrix and y one of a view, and y among the
+// operands. elements are small integers, so the results are exact.
+
+using naive = matrix<double>;
+using naive_cm = matrix<double, std::allocator<double>, col_major>;
+
+double value(size_t i, size_t j, size_t seed) {
+  return double(int((i * 7 + j * 3 + seed * 5) % 9) - 4);
+}
+
+// y (m) = alpha * A * x + beta * y, one row at a time
+std::vector<double> reference(size_t m, size_t n, double alpha, double const* a,
+                              std::ptrdiff_t rs_a, std::ptrdiff_t cs_a, double const* x,
+                              std::ptrdiff_t incx, double beta, std::vector<double> y) {
+  for (size_t i = 0; i < m; i++) {
+    double dot = 0;
+    for (size_t k = 0; k < n; k++)
+      dot += a[std::ptrdiff_t(i) * rs_a + std::ptrdiff_t(k) * cs_a] * x[std::ptrdiff_t(k) * incx];
+    y[i] = beta == 0 ? alpha * dot : alpha * dot + beta * y[i];
+  }
+  return y;
+}
+
+// A is an m x n part of a larger array: rows rs_a apart and columns cs_a
+// apart, as given by the layout under test
+void check_engine(size_t m, size_t n, std::ptrdiff_t rs_a, std::ptrdiff_t cs_a,
+                  std::ptrdiff_t incx, std::ptrdiff_t incy) {
+  size_t const span = m == 0 || n == 0 ? 1 :
+    (m - 1) * size_t(rs_a) + (n - 1) * size_t(cs_a) + 1;
+  std::vector<double> a(span, 1000);
+  for (size_t i = 0; i < m; i++)
+    for (size_t k = 0; k < n; k++)
+      a[i * size_t(rs_a) + k * size_t(cs_a)] = value(i, k, 1);
+  std::vector<double> x(std::max<size_t>(n, 1) * size_t(incx), 1000);
+  for (size_t k = 0; k < n; k++)
+    x[k * size_t(incx)] = value(k, 0, 2);
+
+  double const padding = 1000;
+  double const nan = std::numeric_limits<double>::quiet_NaN();
+  for (double alpha : {1.0, -3.0})
+    for (double beta : {0.0, 1.0, 2.0}) {
+      std::vector<double> y(std::max<size_t>(m, 1) * size_t(incy), padding), y0(m);
+      for (size_t i = 0; i < m; i++)
+        y[i * size_t(incy)] = y0[i] = beta == 0 ? nan : value(i, 0, 3);
+      gemv(m, n, alpha, a.data(), rs_a, cs_a, x.data(), incx, beta, y.data(), incy);
+      std::vector<double> const expected =
+        reference(m, n, alpha, a.data(), rs_a, cs_a, x.data(), incx, beta, y0);
+      bool ok = true;
+      for (size_t i = 0; i < y.size(); i++)
+        ok = ok && (i % size_t(incy) == 0 && i / size_t(incy) < m
+                    ? y[i] == expected[i / size_t(incy)] : y[i] == padding);
+      CHECK(ok);
+    }
+}
+
+void check_engine(size_t m, size_t n) {
+  for (std::ptrdiff_t incx : {1, 3})
+    for (std::ptrdiff_t incy : {1, 2}) {
+      // contiguous rows, with and without padding between them
+      check_engine(m, n, std::ptrdiff_t(n), 1, incx, incy);
+      check_engine(m, n, std::ptrdiff_t(n) + 5, 1, incx, incy);
+      // contiguous columns
+      check_engine(m, n, 1, std::ptrdiff_t(m) + 3, incx, incy);
+      // neither: every other column of a row-major array
+      check_engine(m, n, std::ptrdiff_t(2 * n + 1), 2, incx, incy);
+    }
+}
+
+template<typename X, typename Y>
+bool same(X const& x, Y const& y) {
+  if (x.num_rows() != y.num_rows() || x.num_cols() != y.num_cols())
+    return false;
+  for (size_t i = 0; i < x.num_rows(); i++)
+    for (size_t j = 0; j < x.num_cols(); j++)
+      if (x.at(i, j) != y.at(i, j))
+        return false;
+  return true;
+}
+
+template<typename X, typename Y>
+naive product(X const& x, Y const& y) {
+  naive r(x.num_rows(), y.num_cols(), std::vector<double>(x.num_rows() * y.num_cols()));
+  for (size_t i = 0; i < x.num_rows(); i++)
+    for (size_t j = 0; j < y.num_cols(); j++)
+      for (size_t p = 0; p < x.num_cols(); p++)
+        r.at(i, j) += x.at(i, p) * y.at(p, j);
+  return r;
+}
+
+// x and y element by element, scaled: alpha * x + beta * y
+template<typename X, typename Y>
+naive combine(double alpha, X const& x, double beta, Y const& y) {
+  naive r(x.num_rows(), x.num_cols(), std::vector<double>(x.num_rows() * x.num_cols()));
+  for (size_t i = 0; i < x.num_rows(); i++)
+    for (size_t j = 0; j < x.num_cols(); j++)
+      r.at(i, j) = alpha * x.at(i, j) + beta * y.at(i, j);
+  return r;
+}
+
+template<typename X>
+X& filled(X& x, size_t seed) {
+  for (size_t i = 0; i < x.num_rows(); i++)
+    for (size_t j = 0; j < x.num_cols(); j++)
+      x.at(i, j) = value(i, j, seed);
+  return x;
+}
+
+template<typename M>
+void check_vectors(size_t m, size_t n) {
+  M a(naive(m, n, std::vector<double>(m * n)));
+  filled(a, 1);
+  col_vector<double> x(n), y(m);
+  row_vector<double> xr(m), yr(n);
+  filled(x, 2);
+  filled(y, 3);
+  filled(xr, 4);
+  filled(yr, 5);
+  naive const ax = product(a, x), xa = product(xr, a);
+
+  col_vector<double> z = a * x;
+  CHECK(same(z, ax));
+  row_vector<double> w = xr * a;
+  CHECK(same(w, xa));
+  z = transpose(a) * transpose(xr);
+  CHECK(same(z, naive(transpose(xa))));
+  z = a * x * 2.0 + y;
+  CHECK(same(z, combine(2, ax, 1, y)));
+
+  col_vector<double> const y0 = y;
+  gemv(2.0, a, x, -1.0, y);
+  CHECK(same(y, combine(2, ax, -1, y0)));
+  gemv(1.0, a, x, 0.0, y);
+  CHECK(same(y, ax));
+  row_vector<double> const yr0 = yr;
+  gevm(-2.0, xr, a, 3.0, yr);
+  CHECK(same(yr, combine(-2, xa, 3, yr0)));
+
+  // x a column of a matrix, y a column of a view
+  naive b(n, 3, std::vector<double>(n * 3)), c(m, 3, std::vector<double>(m * 3));
+  filled(b, 6);
+  filled(c, 7);
+  naive const c0 = c;
+  col(c, 1) = a * col(b, 2);
+  naive expected = c0;
+  for (size_t i = 0; i < m; i++) {
+    expected.at(i, 1) = 0;
+    for (size_t k = 0; k < n; k++)
+      expected.at(i, 1) += a.at(i, k) * b.at(k, 2);
+  }
+  CHECK(same(c, expected));
+  gemv(1.0, a, col(b, 0), 2.0, y);
+  for (size_t i = 0; i < m; i++) {
+    double dot = 0;
+    for (size_t k = 0; k < n; k++)
+      dot += a.at(i, k) * b.at(k, 0);
+    CHECK(y[i] == dot + 2 * ax.at(i, 0));
+  }
+}
+
+// y among the operands of its own product
+void check_aliased(size_t n) {
+  naive a(n, n, std::vector<double>(n * n));
+  filled(a, 1);
+  col_vector<double> x(n);
+  filled(x, 2);
+  col_vector<double> const x0 = x;
+  naive const ax = product(a, x0);
+  x = a * x;
+  CHECK(same(x, ax));
+  x = x0;
+  gemv(1.0, a, x, 1.0, x);
+  CHECK(same(x, combine(1, ax, 1, x0)));
+  x = x0;
+  gemv(2.0, a, x * 1.0, -1.0, x);
+  CHECK(same(x, combine(2, ax, -1, x0)));
+
+  row_vector<double> r(n);
+  filled(r, 3);
+  row_vector<double> const r0 = r;
+  gevm(1.0, r, a, 1.0, r);
+  CHECK(same(r, combine(1, product(r0, a), 1, r0)));
+}
+
+int main() {
+  set_default_thread_pool_size(4);
+  for (auto size : {std::make_pair(0, 3), std::make_pair(3, 0), std::make_pair(1, 1),
+                    std::make_pair(3, 5), std::make_pair(17, 9), std::make_pair(64, 64),
+                    std::make_pair(1000, 333), std::make_pair(131, 2001)})
+    check_engine(size.first, size.second);
+  size_t const default_threshold = parallel_eval_threshold();
+  for (size_t threshold : {size_t(1), default_threshold}) {
+    set_parallel_eval_threshold(threshold);
+    for (auto size : {std::make_pair(1, 1), std::make_pair(3, 5), std::make_pair(17, 9),
+                      std::make_pair(1000, 333)}) {
+      check_vectors<naive>(size.first, size.second);
+      check_vectors<naive_cm>(size.first, size.second);
+    }
+    check_aliased(7);
+    check_aliased(300);
+  }
+  return test_result();
+}
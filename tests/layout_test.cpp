@@ -0,0 +1,197 @@
+#include "test.hpp"
+#include "matrix.hpp"
+#include <vector>
+
+// matrices stored in each layout of layout.hpp, against naive loops over
+// row-major ones: elements where the layout says they are, conversions
+// between layouts, element-wise expressions whose operands share one
+// layout or mix several, transposes, products and compound assignments,
+// into destinations of every layout, including transposes of the
+// destination itself. sizes are on both sides of the tile
+// size, past the gemm micro-tile and parallel_eval_threshold(). elements
+// are small integers, so the products are exact.
+
+template<typename L>
+using dense = matrix<double, std::allocator<double>, L>;
+using naive = matrix<double>;
+
+naive filled(size_t rows, size_t cols, size_t seed) {
+  naive m(rows, cols, std::vector<double>(rows * cols));
+  for (size_t i = 0; i < rows; i++)
+    for (size_t j = 0; j < cols; j++)
+      m.at(i, j) = double(int((i * 7 + j * 3 + seed * 5) % 9) - 4);
+  return m;
+}
+
+// x and y element by element, scaled: alpha * x + beta * y
+template<typename X, typename Y>
+naive combine(double alpha, X const& x, double beta, Y const& y) {
+  naive r(x.num_rows(), x.num_cols(), std::vector<double>(x.num_rows() * x.num_cols()));
+  for (size_t i = 0; i < x.num_rows(); i++)
+    for (size_t j = 0; j < x.num_cols(); j++)
+      r.at(i, j) = alpha * x.at(i, j) + beta * y.at(i, j);
+  return r;
+}
+
+template<typename X, typename Y>
+naive product(X const& x, Y const& y) {
+  naive r(x.num_rows(), y.num_cols(), std::vector<double>(x.num_rows() * y.num_cols()));
+  for (size_t i = 0; i < x.num_rows(); i++)
+    for (size_t j = 0; j < y.num_cols(); j++)
+      for (size_t p = 0; p < x.num_cols(); p++)
+        r.at(i, j) += x.at(i, p) * y.at(p, j);
+  return r;
+}
+
+template<typename X>
+naive transposed(X const& x) {
+  naive r(x.num_cols(), x.num_rows(), std::vector<double>(x.num_rows() * x.num_cols()));
+  for (size_t i = 0; i < x.num_rows(); i++)
+    for (size_t j = 0; j < x.num_cols(); j++)
+      r.at(j, i) = x.at(i, j);
+  return r;
+}
+
+template<typename X, typename Y>
+bool same(X const& x, Y const& y) {
+  if (x.num_rows() != y.num_rows() || x.num_cols() != y.num_cols())
+    return false;
+  for (size_t i = 0; i < x.num_rows(); i++)
+    for (size_t j = 0; j < x.num_cols(); j++)
+      if (x.at(i, j) != y.at(i, j))
+        return false;
+  return true;
+}
+
+template<typename L>
+void check_storage(size_t rows, size_t cols) {
+  naive const x = filled(rows, cols, 1);
+  dense<L> const a(x);
+  CHECK(same(a, x));
+  bool placed = true;
+  for (size_t i = 0; i < rows; i++)
+    for (size_t j = 0; j < cols; j++)
+      placed = placed && a.data()[L::index(i, j, rows, cols)] == x.at(i, j);
+  CHECK(placed);
+  // and back
+  naive const y(a);
+  CHECK(same(y, x));
+}
+
+// L the destination and first operand, M the other operand
+template<typename L, typename M>
+void check_expressions(size_t rows, size_t cols) {
+  naive const x = filled(rows, cols, 1), y = filled(rows, cols, 2);
+  naive const z = filled(rows, cols, 3), s = filled(cols, rows, 4);
+  dense<L> const a(x), c(z);
+  dense<M> const b(y), t(s);
+
+  // one layout, read in storage order
+  dense<L> r = a + c * 2.0 - a;
+  CHECK(same(r, combine(2, z, 0, x)));
+  // two
+  r = a + b;
+  CHECK(same(r, combine(1, x, 1, y)));
+  r = b - a * 3.0 + c;
+  CHECK(same(r, combine(1, combine(1, y, -3, x), 1, z)));
+  r = a + transpose(t);
+  CHECK(same(r, combine(1, x, 1, transposed(s))));
+  dense<M> q = a - b;
+  CHECK(same(q, combine(1, x, -1, y)));
+  q = transpose(a);
+  CHECK(same(q, transposed(x)));
+
+  r = a;
+  r += b;
+  CHECK(same(r, combine(1, x, 1, y)));
+  r -= c * 2.0;
+  CHECK(same(r, combine(1, combine(1, x, 1, y), -2, z)));
+  r *= 2.0;
+  CHECK(same(r, combine(2, combine(1, x, 1, y), -4, z)));
+}
+
+template<typename L, typename M>
+void check_products(size_t m, size_t n, size_t k) {
+  naive const x = filled(m, k, 1), y = filled(k, n, 2), z = filled(m, n, 3);
+  naive const w = filled(n, k, 4), v = filled(k, m, 6);
+  dense<L> const a(x), c(z);
+  dense<M> const b(y), bt(w), u(v);
+  naive const xy = product(x, y);
+
+  dense<L> r = a * b;
+  CHECK(same(r, xy));
+  dense<M> q = a * b;
+  CHECK(same(q, xy));
+  r = a * b * 2.0 + c;
+  CHECK(same(r, combine(2, xy, 1, z)));
+  r = c;
+  r += a * b;
+  CHECK(same(r, combine(1, z, 1, xy)));
+  r = a * transpose(bt);
+  CHECK(same(r, product(x, transposed(w))));
+  // a product whose operand is itself an expression
+  r = (a + transpose(u)) * b;
+  CHECK(same(r, product(combine(1, x, 1, transposed(v)), y)));
+  naive const sq = filled(k, k, 5);
+  dense<M> const d(sq);
+  r = a;
+  r *= d;
+  CHECK(same(r, product(x, sq)));
+}
+
+// right-hand sides reading the destination transposed, which can't be
+// written in place
+template<typename L>
+void check_transposed_self(size_t rows, size_t cols) {
+  naive const x = filled(rows, cols, 1);
+  dense<L> a(x);
+  a = transpose(a);
+  CHECK(same(a, transposed(x)));
+  a = transpose(a) * 2.0;
+  CHECK(same(a, combine(2, x, 0, x)));
+  if (rows == cols) {
+    a = dense<L>(x);
+    a = a + transpose(a);
+    CHECK(same(a, combine(1, x, 1, transposed(x))));
+    a = dense<L>(x);
+    a -= transpose(a);
+    CHECK(same(a, combine(1, x, -1, transposed(x))));
+  }
+}
+
+template<typename L, typename M>
+void check_pair() {
+  for (auto size : {std::make_pair(1, 1), std::make_pair(3, 5), std::make_pair(17, 16),
+                    std::make_pair(130, 67), std::make_pair(301, 300)})
+    check_expressions<L, M>(size.first, size.second);
+  check_products<L, M>(5, 7, 4);
+  check_products<L, M>(129, 65, 300);
+}
+
+template<typename L>
+void check_layout() {
+  for (auto size : {std::make_pair(1, 1), std::make_pair(3, 5), std::make_pair(17, 16),
+                    std::make_pair(130, 67)})
+    check_storage<L>(size.first, size.second);
+  for (auto size : {std::make_pair(1, 1), std::make_pair(3, 5), std::make_pair(17, 17),
+                    std::make_pair(130, 67), std::make_pair(301, 301)})
+    check_transposed_self<L>(size.first, size.second);
+  check_pair<L, L>();
+  check_pair<L, row_major>();
+  check_pair<L, col_major>();
+  check_pair<L, tiled<4> >();
+  check_pair<L, tiled<> >();
+}
+
+int main() {
+  set_default_thread_pool_size(4);
+  size_t const default_threshold = parallel_eval_threshold();
+  for (size_t threshold : {size_t(1), default_threshold}) {
+    set_parallel_eval_threshold(threshold);
+    check_layout<row_major>();
+    check_layout<col_major>();
+    check_layout<tiled<4> >();
+    check_layout<tiled<> >();
+  }
+  return test_result();
+}
@@ -0,0 +1,166 @@
+#include "test.hpp"
+#include "fixed.hpp"
+#include <vector>
+
+// products of fixed_matrix operands with one dynamic dimension against
+// naive loops: an N x 4 point cloud times a 4 x 4 transform, N x 3 times
+// 3 x 4, a 4 x 4 transform and an 8 x 16 layer times 4 x N and 16 x N
+// blocks of features, whose shallow inner dimension sends them through
+// multiply_narrow, with a known width or not, and the shapes around them
+// that go to gemm instead: an inner dimension of 17 or N, a transposed
+// right operand. N runs from none to past parallel_eval_threshold().
+// elements are small integers, so the products are exact.
+
+constexpr size_t D = dynamic_extent;
+
+template<typename X>
+X& filled(X& x, size_t seed) {
+  for (size_t i = 0; i < x.num_rows(); i++)
+    for (size_t j = 0; j < x.num_cols(); j++)
+      x.at(i, j) = int((i * 7 + j * 3 + seed * 5) % 9) - 4;
+  return x;
+}
+
+template<typename T>
+using naive = matrix<T>;
+
+// x and y element by element, scaled: alpha * x + beta * y
+template<typename T, typename X, typename Y>
+naive<T> combine(T alpha, X const& x, T beta, Y const& y) {
+  naive<T> r(x.num_rows(), x.num_cols(), std::vector<T>(x.num_rows() * x.num_cols()));
+  for (size_t i = 0; i < x.num_rows(); i++)
+    for (size_t j = 0; j < x.num_cols(); j++)
+      r.at(i, j) = alpha * x.at(i, j) + beta * y.at(i, j);
+  return r;
+}
+
+template<typename T, typename X, typename Y>
+naive<T> product(X const& x, Y const& y) {
+  naive<T> r(x.num_rows(), y.num_cols(), std::vector<T>(x.num_rows() * y.num_cols()));
+  for (size_t i = 0; i < x.num_rows(); i++)
+    for (size_t j = 0; j < y.num_cols(); j++)
+      for (size_t p = 0; p < x.num_cols(); p++)
+        r.at(i, j) += x.at(i, p) * y.at(p, j);
+  return r;
+}
+
+template<typename T, typename X>
+naive<T> transposed(X const& x) {
+  naive<T> r(x.num_cols(), x.num_rows(), std::vector<T>(x.num_rows() * x.num_cols()));
+  for (size_t i = 0; i < x.num_rows(); i++)
+    for (size_t j = 0; j < x.num_cols(); j++)
+      r.at(j, i) = x.at(i, j);
+  return r;
+}
+
+template<typename X, typename Y>
+bool same(X const& x, Y const& y) {
+  if (x.num_rows() != y.num_rows() || x.num_cols() != y.num_cols())
+    return false;
+  for (size_t i = 0; i < x.num_rows(); i++)
+    for (size_t j = 0; j < x.num_cols(); j++)
+      if (x.at(i, j) != y.at(i, j))
+        return false;
+  return true;
+}
+
+// the shapes below really take the kernel they are meant to
+template<typename E1, typename E2>
+using narrow = typename detail::product_kernel<E1, E2, void>::narrow;
+
+static_assert(narrow<fixed_matrix<float, D, 4>, fixed_matrix<float, 4, 4> >::value,
+              "points * transform");
+static_assert(narrow<fixed_matrix<float, 8, 16>, fixed_matrix<float, 16, D> >::value,
+              "weights * features");
+static_assert(!narrow<fixed_matrix<float, 8, 17>, fixed_matrix<float, 17, D> >::value,
+              "too deep");
+static_assert(!narrow<fixed_matrix<float, 4, D>, fixed_matrix<float, D, 4> >::value,
+              "dynamic depth");
+
+template<typename T>
+void check_points(size_t n) {
+  fixed_matrix<T, D, 4> pts(n, 4);
+  fixed_matrix<T, 4, 4> t;
+  fixed_matrix<T, D, 3> p3(n, 3);
+  fixed_matrix<T, 3, 4> t34;
+  filled(pts, 1);
+  filled(t, 2);
+  filled(p3, 3);
+  filled(t34, 4);
+  naive<T> const pt = product<T>(pts, t);
+
+  fixed_matrix<T, D, 4> r = pts * t;
+  CHECK(same(r, pt));
+  r = pts * t + pts;
+  CHECK(same(r, combine<T>(1, pt, 1, pts)));
+  r = p3 * t34;
+  CHECK(same(r, product<T>(p3, t34)));
+  naive<T> m = p3 * t34;
+  CHECK(same(m, product<T>(p3, t34)));
+  m = pts * t;
+  CHECK(same(m, pt));
+  // the transposed right operand isn't read with unit column stride
+  r = pts * transpose(t);
+  CHECK(same(r, product<T>(pts, transposed<T>(t))));
+  // a dynamic left operand goes to gemm
+  naive<T> const dyn(pts);
+  r = dyn * t;
+  CHECK(same(r, pt));
+
+  // the destination as the left operand
+  r = pts;
+  r = r * t;
+  CHECK(same(r, pt));
+  r = pts;
+  r *= t;
+  CHECK(same(r, pt));
+  r += pts;
+  r -= pts * T(2);
+  CHECK(same(r, combine<T>(1, pt, -1, pts)));
+
+  // 4 x N: the width is dynamic, the depth isn't, except in w * pts
+  fixed_matrix<T, 4, D> w = transpose(pts);
+  CHECK(same(w, transposed<T>(pts)));
+  fixed_matrix<T, 4, D> tw = t * w;
+  CHECK(same(tw, product<T>(t, transposed<T>(pts))));
+  fixed_matrix<T, 4, 4> gram = w * pts;
+  CHECK(same(gram, product<T>(transposed<T>(pts), pts)));
+}
+
+template<typename T>
+void check_features(size_t n) {
+  fixed_matrix<T, 16, D> x(16, n);
+  fixed_matrix<T, 8, 16> w;
+  fixed_matrix<T, 17, D> y(17, n);
+  fixed_matrix<T, 8, 17> v;
+  filled(x, 5);
+  filled(w, 6);
+  filled(y, 7);
+  filled(v, 8);
+
+  fixed_matrix<T, 8, D> h = w * x;
+  CHECK(same(h, product<T>(w, x)));
+  h = w * x * T(2) - h;
+  CHECK(same(h, product<T>(w, x)));
+  h = v * y;
+  CHECK(same(h, product<T>(v, y)));
+  naive<T> m = w * x;
+  CHECK(same(m, product<T>(w, x)));
+}
+
+int main() {
+  set_default_thread_pool_size(4);
+  size_t const default_threshold = parallel_eval_threshold();
+  for (size_t threshold : {size_t(1), default_threshold}) {
+    set_parallel_eval_threshold(threshold);
+    for (size_t n : {0, 1, 5, 1000, 100000}) {
+      check_points<double>(n);
+      check_points<float>(n);
+    }
+    for (size_t n : {0, 1, 7, 33, 20000}) {
+      check_features<double>(n);
+      check_features<float>(n);
+    }
+  }
+  return test_result();
+}
@@ -0,0 +1,114 @@
+#include "test.hpp"
+#include "matrix.hpp"
+#include <cstdint>
+#include <vector>
+
+// element-wise expressions evaluated by SIMD packets (see packet.hpp),
+// against naive loops: by flat index over the whole storage, and line by
+// line over a block of a larger matrix. every length from one element to
+// three packets and one, so each range ends with a tail that isn't a
+// multiple of the lane width, for element types with 1 to 16 lanes. with
+// the threshold at one each range split off for the pool has a tail of its
+// own. elements are small integers, so every result is exact.
+
+template<typename T, typename L = row_major>
+using dense = matrix<T, std::allocator<T>, L>;
+
+template<typename T, typename L = row_major>
+dense<T, L> filled(size_t rows, size_t cols, size_t seed) {
+  dense<T, L> m(dense<T>(rows, cols, std::vector<T>(rows * cols)));
+  for (size_t i = 0; i < rows; i++)
+    for (size_t j = 0; j < cols; j++)
+      m.at(i, j) = T(int((i * 7 + j * 3 + seed * 5) % 9) - 4);
+  return m;
+}
+
+// the expressions below really take the packet paths
+template<typename E, typename Tag>
+using evaluated_by = std::is_same<detail::eval_tag<E, float, row_major>, Tag>;
+
+dense<float> const x, y;
+dense<float, col_major> const z;
+static_assert(evaluated_by<decltype(x + y * 2.0f - x), detail::linear_tag>::value,
+              "a + b * 2 - c by flat index");
+static_assert(evaluated_by<decltype(x - block(x, 0, 0, 0, 0)), detail::strided_linear_tag>::value,
+              "a - block by lines");
+static_assert(evaluated_by<decltype(transpose(z) + x), detail::linear_tag>::value,
+              "a column-major transpose is row-major");
+
+template<typename T>
+void check_packet_traits() {
+  using traits = packet_traits<T>;
+  std::vector<T> in(traits::lanes), out(traits::lanes);
+  for (size_t k = 0; k < traits::lanes; k++)
+    in[k] = T(k + 1);
+  traits::store(out.data(), traits::load(in.data()) * traits::set1(T(2)));
+  bool ok = true;
+  for (size_t k = 0; k < traits::lanes; k++)
+    ok = ok && out[k] == T(2 * (k + 1));
+  CHECK(ok);
+}
+
+template<typename T, typename L>
+void check_lengths() {
+  size_t const lanes = packet_traits<T>::lanes;
+  for (size_t rows : {1, 2, 3})
+    for (size_t cols = 1; cols <= 3 * lanes + 1; cols++) {
+      dense<T, L> const a = filled<T, L>(rows, cols, 1), b = filled<T, L>(rows, cols, 2);
+      dense<T, L> const c = filled<T, L>(rows, cols, 3);
+
+      dense<T, L> r = a + b * T(2) - c;
+      bool ok = true;
+      for (size_t i = 0; i < rows; i++)
+        for (size_t j = 0; j < cols; j++)
+          ok = ok && r.at(i, j) == T(a.at(i, j) + b.at(i, j) * T(2) - c.at(i, j));
+      CHECK(ok);
+
+      r += T(3) * a;
+      r -= b;
+      ok = true;
+      for (size_t i = 0; i < rows; i++)
+        for (size_t j = 0; j < cols; j++)
+          ok = ok && r.at(i, j) == T(a.at(i, j) + b.at(i, j) * T(2) - c.at(i, j) +
+                                     T(3) * a.at(i, j) - b.at(i, j));
+      CHECK(ok);
+
+      // an interior block of a larger matrix, so no line starts or ends
+      // where the storage does
+      dense<T, L> big = filled<T, L>(rows + 2, cols + 3, 4);
+      dense<T, L> const before = big;
+      block(big, 1, 2, rows, cols) = a - block(before, 2, 1, rows, cols) + c;
+      ok = true;
+      for (size_t i = 0; i < rows + 2; i++)
+        for (size_t j = 0; j < cols + 3; j++) {
+          bool const inside = i >= 1 && i < rows + 1 && j >= 2 && j < cols + 2;
+          T const expected = inside ? T(a.at(i - 1, j - 2) - before.at(i + 1, j - 1) +
+                                        c.at(i - 1, j - 2))
+                                    : before.at(i, j);
+          ok = ok && big.at(i, j) == expected;
+        }
+      CHECK(ok);
+    }
+}
+
+template<typename T>
+void check_type() {
+  check_packet_traits<T>();
+  check_lengths<T, row_major>();
+  check_lengths<T, col_major>();
+}
+
+int main() {
+  set_default_thread_pool_size(4);
+  size_t const default_threshold = parallel_eval_threshold();
+  for (size_t threshold : {size_t(1), default_threshold}) {
+    set_parallel_eval_threshold(threshold);
+    check_type<double>();
+    check_type<float>();
+    check_type<std::int64_t>();
+    check_type<std::int32_t>();
+    check_type<std::int16_t>();
+    check_type<std::int8_t>();
+  }
+  return test_result();
+}
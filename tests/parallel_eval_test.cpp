@@ -0,0 +1,117 @@
+#include "test.hpp"
+#include "matrix.hpp"
+#include <cstdint>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+// expressions evaluated in parallel, split into ranges of rows over a pool
+// of four, against a serial loop: a + b - c * 2 as in the request, operands
+// of mixed element types read element by element, and a transpose walked
+// tile by tile, at sizes on both sides of parallel_eval_threshold() and with
+// the threshold at one, its default and SIZE_MAX. below the threshold
+// nothing leaves the calling thread. elements are small integers, so every
+// split computes the exact same result.
+
+template<typename T, typename L = row_major>
+using dense = matrix<T, std::allocator<T>, L>;
+
+template<typename T, typename L = row_major>
+dense<T, L> filled(size_t rows, size_t cols, size_t seed) {
+  dense<T, L> m(dense<T>(rows, cols, std::vector<T>(rows * cols)));
+  for (size_t i = 0; i < rows; i++)
+    for (size_t j = 0; j < cols; j++)
+      m.at(i, j) = T(int((i * 7 + j * 3 + seed * 5) % 9) - 4);
+  return m;
+}
+
+// reads its operand element by element, and notes the threads that do
+template<typename E>
+class recorded : public matrix_expr<recorded<E> > {
+  E const& operand_;
+  std::mutex& mutex_;
+  std::set<std::thread::id>& threads_;
+
+public:
+  recorded(E const& operand, std::mutex& mutex, std::set<std::thread::id>& threads)
+    : operand_(operand), mutex_(mutex), threads_(threads) {
+    this->num_rows_ = operand.num_rows();
+    this->num_cols_ = operand.num_cols();
+  }
+
+  auto at(size_t row, size_t col) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    threads_.insert(std::this_thread::get_id());
+    return operand_.at(row, col);
+  }
+};
+
+template<typename T, typename L>
+void check_expressions(size_t rows, size_t cols) {
+  dense<T, L> const a = filled<T, L>(rows, cols, 1), b = filled<T, L>(rows, cols, 2);
+  dense<T, L> const c = filled<T, L>(rows, cols, 3);
+  dense<double, L> const d = filled<double, L>(rows, cols, 4);
+  dense<T, L> const t = filled<T, L>(cols, rows, 5);
+
+  dense<T, L> const r = a + b - c * T(2);
+  dense<double, L> const mixed = a - d;
+  dense<T, L> const tr = a + transpose(t);
+  bool ok = true, mixed_ok = true, tr_ok = true;
+  for (size_t i = 0; i < rows; i++)
+    for (size_t j = 0; j < cols; j++) {
+      ok = ok && r.at(i, j) == a.at(i, j) + b.at(i, j) - c.at(i, j) * T(2);
+      mixed_ok = mixed_ok && mixed.at(i, j) == double(a.at(i, j)) - d.at(i, j);
+      tr_ok = tr_ok && tr.at(i, j) == a.at(i, j) + t.at(j, i);
+    }
+  CHECK(ok);
+  CHECK(mixed_ok);
+  CHECK(tr_ok);
+
+  // into a matrix that already has storage, of another shape
+  dense<T, L> e = filled<T, L>(3, 2, 6);
+  e = a + b - c * T(2);
+  CHECK(e.num_rows() == rows && e.num_cols() == cols);
+  bool same = true;
+  for (size_t i = 0; i < rows; i++)
+    for (size_t j = 0; j < cols; j++)
+      same = same && e.at(i, j) == r.at(i, j);
+  CHECK(same);
+}
+
+template<typename T>
+void check_type(size_t rows, size_t cols) {
+  check_expressions<T, row_major>(rows, cols);
+  check_expressions<T, col_major>(rows, cols);
+}
+
+// the 20 x 20 case of matrixtest.cpp stays on the calling thread
+void check_serial() {
+  dense<int> const a = filled<int>(20, 20, 1);
+  std::mutex mutex;
+  std::set<std::thread::id> threads;
+  dense<int> const r = recorded<dense<int> >(a, mutex, threads);
+  CHECK(threads.size() == 1 && *threads.begin() == std::this_thread::get_id());
+  bool ok = true;
+  for (size_t i = 0; i < 20; i++)
+    for (size_t j = 0; j < 20; j++)
+      ok = ok && r.at(i, j) == a.at(i, j);
+  CHECK(ok);
+}
+
+int main() {
+  set_default_thread_pool_size(4);
+  size_t const default_threshold = parallel_eval_threshold();
+  check_serial();
+  for (size_t threshold : {size_t(1), default_threshold, SIZE_MAX}) {
+    set_parallel_eval_threshold(threshold);
+    for (auto size : {std::make_pair(1, 1), std::make_pair(20, 20), std::make_pair(256, 256),
+                      std::make_pair(257, 255), std::make_pair(1000, 301),
+                      std::make_pair(7, 20000), std::make_pair(20000, 7)}) {
+      check_type<double>(size.first, size.second);
+      check_type<float>(size.first, size.second);
+      check_type<std::int32_t>(size.first, size.second);
+    }
+  }
+  return test_result();
+}
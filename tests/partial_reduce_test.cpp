@@ -0,0 +1,142 @@
+#include "test.hpp"
+#include "reduce.hpp"
+#include <cstdint>
+#include <vector>
+
+// rowwise() and colwise() reductions against serial loops. the operand's
+// layout decides the path: reducing along its storage lines (rowwise on a
+// row-major operand) folds each line, reducing across them (colwise on a
+// row-major operand, rowwise on a column-major one) accumulates whole
+// lines into a row of partial results, which ranges of lines build in
+// parallel and then combine. both run on row- and column-major matrices,
+// blocks and mixed layouts, past parallel_eval_threshold() on a pool of
+// four and with the threshold at one, and on empty operands. elements are
+// small integers, so sums are exact in any order.
+
+template<typename T, typename L>
+using dense = matrix<T, std::allocator<T>, L>;
+
+template<typename T, typename L>
+dense<T, L> filled(size_t rows, size_t cols, size_t seed) {
+  dense<T, L> m(dense<T, row_major>(rows, cols, std::vector<T>(rows * cols)));
+  for (size_t i = 0; i < rows; i++)
+    for (size_t j = 0; j < cols; j++)
+      m.at(i, j) = T(int((i * 7 + j * 3 + seed) % 11) - 5);
+  return m;
+}
+
+// sum, mean and max of line k of e: row k for rowwise, column k otherwise
+template<typename T>
+struct line {
+  T sum = T(), mean = T(), max = T();
+
+  template<typename E>
+  line(E const& e, bool rowwise, size_t k) {
+    size_t const n = rowwise ? e.num_cols() : e.num_rows();
+    max = n == 0 ? detail::smallest<T>() : rowwise ? e.at(k, 0) : e.at(0, k);
+    for (size_t p = 0; p < n; p++) {
+      T const v = rowwise ? e.at(k, p) : e.at(p, k);
+      sum += v;
+      max = v > max ? v : max;
+    }
+    mean = n == 0 ? sum : sum / T(n);
+  }
+};
+
+// the partial sums, means and maxima of e, evaluated into matrices of
+// layout L
+template<typename T, typename L, typename E>
+void check_partial(E const& e) {
+  size_t const rows = e.num_rows(), cols = e.num_cols();
+
+  dense<T, L> const rs = rowwise(e).sum(), rm = rowwise(e).mean(), rx = rowwise(e).max();
+  CHECK(rs.num_rows() == rows && rs.num_cols() == 1);
+  CHECK(rx.num_rows() == rows && rx.num_cols() == 1);
+  for (size_t i = 0; i < rows; i++) {
+    line<T> const x(e, true, i);
+    CHECK(rs.at(i, 0) == x.sum);
+    CHECK(rm.at(i, 0) == x.mean);
+    CHECK(rx.at(i, 0) == x.max);
+  }
+
+  dense<T, L> const cs = colwise(e).sum(), cm = colwise(e).mean(), cx = colwise(e).max();
+  CHECK(cs.num_rows() == 1 && cs.num_cols() == cols);
+  CHECK(cx.num_rows() == 1 && cx.num_cols() == cols);
+  for (size_t j = 0; j < cols; j++) {
+    line<T> const x(e, false, j);
+    CHECK(cs.at(0, j) == x.sum);
+    CHECK(cm.at(0, j) == x.mean);
+    CHECK(cx.at(0, j) == x.max);
+  }
+}
+
+template<typename T, typename L1, typename L2>
+void check_layouts(size_t rows, size_t cols) {
+  dense<T, L1> const a = filled<T, L1>(rows, cols, 1);
+  dense<T, L2> const b = filled<T, L2>(rows, cols, 2);
+  check_partial<T, row_major>(a);
+  check_partial<T, col_major>(a);
+  auto const diff = a - b;
+  check_partial<T, row_major>(diff);
+  if (rows > 3 && cols > 3) {
+    auto const view = block(a, 1, 2, rows - 2, cols - 3);
+    check_partial<T, row_major>(view);
+    check_partial<T, col_major>(view);
+  }
+}
+
+template<typename T>
+void check_type(size_t rows, size_t cols) {
+  check_layouts<T, row_major, row_major>(rows, cols);
+  check_layouts<T, col_major, col_major>(rows, cols);
+  check_layouts<T, row_major, col_major>(rows, cols);
+}
+
+// a named partial reduction is computed anew by each evaluation, so a
+// change to its operand shows in the next one: assigned, inside a larger
+// expression that reads it twice, and reduced to a scalar
+template<typename L>
+void check_reevaluation(size_t rows, size_t cols) {
+  dense<double, L> a = filled<double, L>(rows, cols, 1);
+  auto const s = rowwise(a).sum();
+  auto const x = colwise(a).max();
+  for (size_t round = 0; round < 3; round++) {
+    dense<double, L> const rs = s, twice = s + s, cx = x;
+    double total = 0;
+    for (size_t i = 0; i < rows; i++) {
+      line<double> const expected(a, true, i);
+      CHECK(rs.at(i, 0) == expected.sum);
+      CHECK(twice.at(i, 0) == 2 * expected.sum);
+      total += expected.sum;
+    }
+    for (size_t j = 0; j < cols; j++)
+      CHECK(cx.at(0, j) == line<double>(a, false, j).max);
+    CHECK(sum(s) == total);
+    a.at(round % rows, (round * 5) % cols) += 10;
+    a.at(rows - 1, cols - 1) -= 3;
+  }
+}
+
+int main() {
+  set_default_thread_pool_size(4);
+  size_t const default_threshold = parallel_eval_threshold();
+  for (size_t threshold : {size_t(1), default_threshold}) {
+    set_parallel_eval_threshold(threshold);
+    for (auto size : {std::make_pair(0, 0), std::make_pair(0, 5), std::make_pair(6, 0),
+                      std::make_pair(1, 1), std::make_pair(7, 1), std::make_pair(1, 9),
+                      std::make_pair(37, 29), std::make_pair(400, 300),
+                      std::make_pair(3000, 31), std::make_pair(21, 4000)}) {
+      check_type<double>(size.first, size.second);
+      check_type<float>(size.first, size.second);
+      check_type<std::int32_t>(size.first, size.second);
+    }
+  }
+  for (size_t threshold : {size_t(1), default_threshold}) {
+    set_parallel_eval_threshold(threshold);
+    check_reevaluation<row_major>(7, 5);
+    check_reevaluation<col_major>(7, 5);
+    check_reevaluation<row_major>(400, 300);
+    check_reevaluation<col_major>(400, 300);
+  }
+  return test_result();
+}
@@ -0,0 +1,161 @@
+#include "test.hpp"
+#include "reduce.hpp"
+#include <cmath>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+// reductions to a scalar against serial loops, through each way reduce()
+// reads an expression: flat packets of row- and column-major matrices,
+// packets along the lines of blocks (strided views), and elements of
+// operands of mixed layouts. sizes reach past parallel_eval_threshold() and
+// run on a pool of four, so the parallel folds and their combining are
+// exercised; a threshold of one splits the small ones too. elements are
+// small integers, so sums are exact in any order for every type, and the
+// smallest and largest elements are unique unless a test wants ties.
+
+template<typename T, typename L>
+using dense = matrix<T, std::allocator<T>, L>;
+
+template<typename T, typename L>
+dense<T, L> small(size_t rows, size_t cols, size_t seed) {
+  dense<T, L> m(dense<T, row_major>(rows, cols, std::vector<T>(rows * cols)));
+  for (size_t i = 0; i < rows; i++)
+    for (size_t j = 0; j < cols; j++)
+      m.at(i, j) = T(int((i * 7 + j * 3 + seed) % 9) - 4);
+  return m;
+}
+
+// small values with a single smallest and largest element, which stay so
+// with small values added: away from the edges, so blocks keep them too
+template<typename T, typename L>
+dense<T, L> planted(size_t rows, size_t cols, size_t seed) {
+  dense<T, L> m = small<T, L>(rows, cols, seed);
+  if (rows * cols > 1) {
+    m.at(rows / 2, cols / 2) = T(-20);
+    m.at(rows - 1 - rows / 4, cols / 4 + 2 < cols ? cols / 4 + 2 : 0) = T(20);
+  }
+  return m;
+}
+
+// the serial results for an expression e, read element by element
+template<typename T>
+struct expected {
+  T sum = T(), min = T(), max = T(), l1 = T(), l2 = T(), inf = T();
+  std::pair<size_t, size_t> argmin, argmax;
+
+  template<typename E>
+  explicit expected(E const& e) {
+    min = max = e.at(0, 0);
+    for (size_t i = 0; i < e.num_rows(); i++)
+      for (size_t j = 0; j < e.num_cols(); j++) {
+        T const v = e.at(i, j);
+        sum += v;
+        l1 += v < T() ? -v : v;
+        l2 += v * v;
+        inf = std::max(inf, v < T() ? -v : v);
+        if (v < min) {
+          min = v;
+          argmin = {i, j};
+        }
+        if (v > max) {
+          max = v;
+          argmax = {i, j};
+        }
+      }
+  }
+};
+
+template<typename T, typename E>
+void check_reductions(matrix_expr<E> const& expr) {
+  E const& e = static_cast<E const&>(expr);
+  expected<T> const x(e);
+  CHECK(sum(e) == x.sum);
+  CHECK(min(e) == x.min);
+  CHECK(max(e) == x.max);
+  CHECK(argmin(e) == x.argmin);
+  CHECK(argmax(e) == x.argmax);
+  CHECK(norm_l1(e) == x.l1);
+  CHECK(squared_norm(e) == x.l2);
+  CHECK(norm_inf(e) == x.inf);
+  // a double for integers, and sqrt is correctly rounded
+  using norm_t = decltype(norm(e));
+  CHECK(norm(e) == std::sqrt(static_cast<norm_t>(x.l2)));
+  CHECK(mean(e) == x.sum / T(e.num_rows() * e.num_cols()));
+}
+
+template<typename T, typename E1, typename E2>
+void check_dot(E1 const& a, E2 const& b) {
+  T d = T();
+  for (size_t i = 0; i < a.num_rows(); i++)
+    for (size_t j = 0; j < a.num_cols(); j++)
+      d += a.at(i, j) * b.at(i, j);
+  CHECK(dot(a, b) == d);
+}
+
+template<typename T, typename L1, typename L2>
+void check_layouts(size_t rows, size_t cols) {
+  dense<T, L1> const a = planted<T, L1>(rows, cols, 1);
+  dense<T, L2> const b = small<T, L2>(rows, cols, 2);
+  dense<T, L1> const c = small<T, L1>(rows, cols, 3);
+
+  check_reductions<T>(a);
+  check_reductions<T>(a + b);
+  check_reductions<T>(a - c);
+  check_dot<T>(b, c);
+  check_dot<T>(c, c);
+
+  if (rows > 3 && cols > 3) {
+    auto const va = block(a, 1, 2, rows - 2, cols - 3);
+    auto const vc = block(c, 2, 1, rows - 2, cols - 3);
+    check_reductions<T>(va);
+    check_reductions<T>(va - vc);
+    check_dot<T>(va, vc);
+  }
+}
+
+template<typename T>
+void check_type(size_t rows, size_t cols) {
+  check_layouts<T, row_major, row_major>(rows, cols);
+  check_layouts<T, col_major, col_major>(rows, cols);
+  check_layouts<T, row_major, col_major>(rows, cols);
+  check_layouts<T, col_major, row_major>(rows, cols);
+}
+
+// ties go to the first in storage order: by rows, or by columns for a
+// column-major operand
+void check_ties() {
+  matrix<double> const r = {{0, 1, 0}, {1, 0, 1}};
+  dense<double, col_major> const c(r);
+  CHECK(argmax(r) == std::make_pair(size_t(0), size_t(1)));
+  CHECK(argmax(c) == std::make_pair(size_t(1), size_t(0)));
+  CHECK(argmin(r) == std::make_pair(size_t(0), size_t(0)));
+  CHECK(argmin(c) == std::make_pair(size_t(0), size_t(0)));
+}
+
+// the norm of integers isn't truncated
+void check_integer_norm() {
+  matrix<int> const a = {{1, 1}, {1, 0}};
+  static_assert(std::is_same<decltype(norm(a)), double>::value, "norm of int");
+  CHECK(std::abs(norm(a) - std::sqrt(3.0)) < 1e-12);
+  CHECK(squared_norm(a) == 3);
+  matrix<int> const b = {{3, 4}};
+  CHECK(norm(b) == 5);
+  CHECK(norm(b - b) == 0);
+}
+
+int main() {
+  set_default_thread_pool_size(4);
+  check_ties();
+  check_integer_norm();
+  for (size_t threshold : {size_t(1), parallel_eval_threshold()}) {
+    set_parallel_eval_threshold(threshold);
+    for (auto size : {std::make_pair(1, 1), std::make_pair(5, 3), std::make_pair(37, 29),
+                      std::make_pair(400, 300), std::make_pair(129, 1031)}) {
+      check_type<double>(size.first, size.second);
+      check_type<float>(size.first, size.second);
+      check_type<std::int32_t>(size.first, size.second);
+    }
+  }
+  return test_result();
+}
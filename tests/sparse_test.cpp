@@ -0,0 +1,221 @@
+#include "test.hpp"
+#include "sparse.hpp"
+#include <cstdint>
+#include <random>
+#include <vector>
+
+// csr and csc matrices built from dense ones, converted and written back,
+// and added to and subtracted from dense operands, on either side and into
+// the dense operand itself, against naive loops. then sparse products
+// against the same products of dense copies: spgemm into
+// csr and csc, sparse * sparse into dense storage, and every sparse format
+// times a dense operand in both orders. the sparse pairs come in two
+// densities, a few entries per row of wide results so that spgemm sums rows
+// in its hash table, and many so that it takes the dense array with stamps.
+// elements are small integers, so the results are exact. everything runs
+// once on the calling thread and once split over a pool of four.
+
+using dense = matrix<double>;
+using dense_cm = matrix<double, std::allocator<double>, col_major>;
+
+// rows x cols, each element nonzero with probability density
+dense random_matrix(size_t rows, size_t cols, double density, unsigned seed) {
+  std::mt19937 gen(seed);
+  std::uniform_real_distribution<double> pick(0, 1);
+  std::vector<double> v(rows * cols);
+  for (auto& x : v)
+    if (pick(gen) < density)
+      x = double(int(gen() % 9) - 4);
+  return dense(rows, cols, std::move(v));
+}
+
+template<typename E1, typename E2>
+bool same(matrix_expr<E1> const& x, matrix_expr<E2> const& y) {
+  E1 const& a = static_cast<E1 const&>(x);
+  E2 const& b = static_cast<E2 const&>(y);
+  if (a.num_rows() != b.num_rows() || a.num_cols() != b.num_cols())
+    return false;
+  for (size_t i = 0; i < a.num_rows(); i++)
+    for (size_t j = 0; j < a.num_cols(); j++)
+      if (a.at(i, j) != b.at(i, j))
+        return false;
+  return true;
+}
+
+// inner indices strictly ascending within every outer index
+bool sorted(std::vector<size_t> const& ptr, std::vector<size_t> const& idx) {
+  for (size_t o = 0; o + 1 < ptr.size(); o++)
+    for (size_t p = ptr[o] + 1; p < ptr[o + 1]; p++)
+      if (idx[p - 1] >= idx[p])
+        return false;
+  return true;
+}
+
+// x and y element by element, scaled: alpha * x + beta * y
+template<typename X, typename Y>
+dense combine(double alpha, X const& x, double beta, Y const& y) {
+  dense r(x.num_rows(), x.num_cols(), std::vector<double>(x.num_rows() * x.num_cols()));
+  for (size_t i = 0; i < x.num_rows(); i++)
+    for (size_t j = 0; j < x.num_cols(); j++)
+      r.at(i, j) = alpha * x.at(i, j) + beta * y.at(i, j);
+  return r;
+}
+
+void check_elementwise(size_t m, size_t n, double density, unsigned seed) {
+  dense const ds = random_matrix(m, n, density, seed);
+  dense const x = random_matrix(m, n, 1, seed + 1);
+  size_t nonzeros = 0;
+  for (size_t i = 0; i < m; i++)
+    for (size_t j = 0; j < n; j++)
+      nonzeros += ds.at(i, j) != 0;
+
+  csr_matrix<double> r(ds);
+  csc_matrix<double> c(ds);
+  CHECK(r.nonzeros() == nonzeros && c.nonzeros() == nonzeros);
+  CHECK(same(r, ds));
+  CHECK(same(c, ds));
+  CHECK(sorted(r.row_ptr(), r.col_idx()));
+  CHECK(sorted(c.col_ptr(), c.row_idx()));
+  CHECK(same(csr_matrix<double>(m, n, r.row_ptr(), r.col_idx(), r.values()), ds));
+  CHECK(same(csc_matrix<double>(m, n, c.col_ptr(), c.row_idx(), c.values()), ds));
+  CHECK(same(csr_matrix<double>(c), ds));
+  CHECK(same(csc_matrix<double>(r), ds));
+
+  dense d = r;
+  CHECK(same(d, ds));
+  dense_cm d_cm = c;
+  CHECK(same(d_cm, ds));
+  d_cm = r;
+  CHECK(same(d_cm, ds));
+
+  // with a dense operand, on either side
+  d = r + x;
+  CHECK(same(d, combine(1, ds, 1, x)));
+  d = x + c;
+  CHECK(same(d, combine(1, ds, 1, x)));
+  d = x - r;
+  CHECK(same(d, combine(-1, ds, 1, x)));
+  d = c - x * 2.0;
+  CHECK(same(d, combine(1, ds, -2, x)));
+  d_cm = x - c;
+  CHECK(same(d_cm, combine(-1, ds, 1, x)));
+  d_cm = r - x;
+  CHECK(same(d_cm, combine(1, ds, -1, x)));
+  // two sparse operands, element by element
+  d = r + c;
+  CHECK(same(d, combine(2, ds, 0, x)));
+
+  // the dense operand is the destination
+  d = x;
+  d = d + r;
+  CHECK(same(d, combine(1, ds, 1, x)));
+  d = x;
+  d = c - d;
+  CHECK(same(d, combine(1, ds, -1, x)));
+  d = x;
+  d = d * 2.0 - r;
+  CHECK(same(d, combine(-1, ds, 2, x)));
+  d = x;
+  d += r;
+  d -= c * 3.0;
+  CHECK(same(d, combine(-2, ds, 1, x)));
+  d_cm = x;
+  d_cm -= r;
+  d_cm += c;
+  d_cm += c;
+  CHECK(same(d_cm, combine(1, ds, 1, x)));
+
+  // the values change in place, the pattern doesn't
+  for (double& v : r.values())
+    v *= 3;
+  CHECK(same(r, combine(3, ds, 0, x)));
+  d = x + r;
+  CHECK(same(d, combine(3, ds, 1, x)));
+}
+
+void check_spgemm(size_t m, size_t k, size_t n, double density, unsigned seed) {
+  dense const da = random_matrix(m, k, density, seed);
+  dense const db = random_matrix(k, n, density, seed + 1);
+  dense const expected = da * db;
+  csr_matrix<double> const ra(da), rb(db);
+  csc_matrix<double> const ca(da), cb(db);
+
+  csr_matrix<double> const rr = ra * rb;
+  CHECK(same(rr, expected));
+  CHECK(sorted(rr.row_ptr(), rr.col_idx()));
+  csc_matrix<double> const cc = ca * cb;
+  CHECK(same(cc, expected));
+  CHECK(sorted(cc.col_ptr(), cc.row_idx()));
+  // mixed formats convert the odd one out
+  csr_matrix<double> const rc = ra * cb;
+  CHECK(same(rc, expected));
+  csc_matrix<double> const cr = ca * rb;
+  CHECK(same(cr, expected));
+
+  dense const d_rr = ra * rb;
+  CHECK(same(d_rr, expected));
+  dense const d_cc = ca * cb;
+  CHECK(same(d_cc, expected));
+  dense_cm const dcm_rr = ra * rb;
+  CHECK(same(dcm_rr, expected));
+  dense_cm const dcm_cc = ca * cb;
+  CHECK(same(dcm_cc, expected));
+}
+
+void check_dense_operand(size_t m, size_t k, size_t n, double density, unsigned seed) {
+  dense const ds = random_matrix(m, k, density, seed);
+  dense const x = random_matrix(k, n, 1, seed + 1);
+  dense const y = random_matrix(n, m, 1, seed + 2);
+  dense_cm const x_cm(x);
+  dense const sx = ds * x, ys = y * ds;
+  csr_matrix<double> const r(ds);
+  csc_matrix<double> const c(ds);
+
+  dense const rx = r * x;
+  CHECK(same(rx, sx));
+  dense const cx = c * x;
+  CHECK(same(cx, sx));
+  dense const rx_cm = r * x_cm;
+  CHECK(same(rx_cm, sx));
+  dense_cm const cx_cm = c * x_cm;
+  CHECK(same(cx_cm, sx));
+  dense const yr = y * r;
+  CHECK(same(yr, ys));
+  dense const yc = y * c;
+  CHECK(same(yc, ys));
+  dense_cm const yr_cm = y * r;
+  CHECK(same(yr_cm, ys));
+  dense_cm const yc_cm = y * c;
+  CHECK(same(yc_cm, ys));
+
+  // a single column, SpMV
+  dense const v = random_matrix(k, 1, 1, seed + 3);
+  dense const sv = ds * v, rv = r * v, cv = c * v;
+  CHECK(same(rv, sv));
+  CHECK(same(cv, sv));
+}
+
+int main() {
+  set_default_thread_pool_size(4);
+  for (size_t threshold : {SIZE_MAX, size_t(1)}) {
+    set_parallel_eval_threshold(threshold);
+    // ~4 products per row of 900 columns: hash table
+    check_spgemm(120, 700, 900, 0.003, 1);
+    // ~60 products per row of 80 columns: dense array with stamps
+    check_spgemm(90, 70, 80, 0.3, 2);
+    // rows of both kinds in one product, and empty rows and columns
+    check_spgemm(200, 300, 600, 0.01, 3);
+    check_spgemm(1, 1, 1, 1, 4);
+    check_spgemm(0, 5, 3, 0.5, 5);
+    check_spgemm(6, 0, 4, 0.5, 6);
+
+    check_dense_operand(37, 50, 23, 0.1, 7);
+    check_dense_operand(300, 200, 9, 0.02, 8);
+
+    check_elementwise(1, 1, 1, 9);
+    check_elementwise(0, 4, 0.5, 10);
+    check_elementwise(37, 50, 0.1, 11);
+    check_elementwise(400, 300, 0.01, 12);
+  }
+  return test_result();
+}
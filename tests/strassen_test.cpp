@@ -0,0 +1,47 @@
+#include "test.hpp"
+#include "strassen.hpp"
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Strassen-Winograd is off by default, so nothing else runs it. with a low
+// cutoff these sizes recurse a few levels: 65 and 127 peel a row and column
+// at the top, 200 = 8 * 25 halves three times before peeling. the recursion
+// runs sequentially on a pool of one thread and with the parallel top level
+// on a pool of four.
+
+template<typename T>
+std::vector<T> values(size_t n, int seed) {
+  std::vector<T> v(n);
+  for (size_t i = 0; i < n; i++)
+    v[i] = T(int((i * 7 + seed * 13) % 9) - 4);
+  return v;
+}
+
+template<typename T>
+double max_error(size_t n) {
+  std::vector<T> const a = values<T>(n * n, 1), b = values<T>(n * n, 2);
+  std::vector<T> expected(n * n), c(n * n);
+  gemm<T>(n, n, n, T(1), a.data(), n, 1, b.data(), n, 1, T(), expected.data(), n, 1);
+  strassen_gemm<T>(n, a.data(), n, b.data(), n, c.data(), n);
+  double error = 0;
+  for (size_t i = 0; i < n * n; i++)
+    error = std::max(error, std::abs(double(c[i]) - double(expected[i])));
+  return error;
+}
+
+int main() {
+  set_strassen_options({16, 16});
+  for (size_t threads : {1, 4}) {
+    set_default_thread_pool(std::make_shared<thread_pool>(threads));
+    for (size_t n : {64, 65, 127, 200}) {
+      // integer products are exact, floating point ones within rounding of
+      // sums of a few hundred small integers
+      CHECK(max_error<std::int32_t>(n) == 0);
+      CHECK(max_error<double>(n) < 1e-9);
+      CHECK(max_error<float>(n) < 1e-2);
+    }
+  }
+  return test_result();
+}
@@ -0,0 +1,32 @@
+#ifndef TEST
+#define TEST
+
+#include <iostream>
+
+// checks for the test programs in this directory. each one is a single
+// translation unit that exits with 1 when a check fails, e.g.
+//   g++ -std=c++14 -O2 -pthread -I.. gemm_test.cpp && ./a.out
+// a failed check prints where it is and what it checked, and the program
+// carries on with the rest.
+
+inline int& test_failures() {
+  static int failures = 0;
+  return failures;
+}
+
+#define CHECK(cond)                                                         \
+  do {                                                                      \
+    if (!(cond)) {                                                          \
+      std::cerr << __FILE__ << ':' << __LINE__ << ": " #cond "\n";          \
+      test_failures()++;                                                    \
+    }                                                                       \
+  } while (0)
+
+// what main returns
+inline int test_result() {
+  if (test_failures() != 0)
+    std::cerr << test_failures() << " checks failed\n";
+  return test_failures() != 0;
+}
+
+#endif
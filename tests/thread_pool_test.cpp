@@ -0,0 +1,179 @@
+#include "test.hpp"
+#include "matrix.hpp"
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+// the work-stealing pool of thread_pool.hpp: parallel_for hands every index
+// to exactly one call, in chunks of at least the grain, nested loops finish
+// on pools of any size, parallel_reduce combines in chunk order whatever the
+// schedule, tasks still queued run before the pool goes away, and a pool
+// replaced with set_default_thread_pool stays alive for whoever still holds
+// it while evaluation moves to the new one.
+
+// how many times each index of [0, n) was visited
+struct visits {
+  std::unique_ptr<std::atomic<int>[]> counts;
+  size_t n;
+
+  explicit visits(size_t n) : counts(new std::atomic<int>[n]), n(n) {
+    for (size_t i = 0; i < n; i++)
+      counts[i] = 0;
+  }
+
+  void add(size_t first, size_t last) {
+    for (size_t i = first; i < last; i++)
+      counts[i]++;
+  }
+
+  bool once() const {
+    for (size_t i = 0; i < n; i++)
+      if (counts[i] != 1)
+        return false;
+    return true;
+  }
+};
+
+void check_cover(thread_pool& pool) {
+  for (size_t n : {0, 1, 7, 1000, 1001})
+    for (size_t grain : {0, 1, 3, 64, 5000}) {
+      visits v(n);
+      std::atomic<bool> chunked{true};
+      pool.parallel_for(n, grain, [&](size_t first, size_t last) {
+        size_t const g = std::max<size_t>(grain, 1);
+        if (first >= last || first % g != 0 || (last - first < g && last != n))
+          chunked = false;
+        v.add(first, last);
+      });
+      CHECK(v.once());
+      CHECK(chunked);
+    }
+}
+
+// loops started from inside a loop's chunks, on the same pool
+void check_nested(thread_pool& pool) {
+  size_t const outer = 16, inner = 300;
+  visits v(outer * inner);
+  pool.parallel_for(outer, 1, [&](size_t first, size_t last) {
+    for (size_t i = first; i < last; i++)
+      pool.parallel_for(inner, 7, [&v, i, inner](size_t a, size_t b) {
+        v.add(i * inner + a, i * inner + b);
+      });
+  });
+  CHECK(v.once());
+
+  // and from a submitted task, which runs on a worker
+  visits w(inner);
+  std::atomic<bool> finished{false};
+  pool.submit([&] {
+    pool.parallel_for(inner, 5, [&w](size_t a, size_t b) { w.add(a, b); });
+    finished = true;
+  });
+  while (!finished)
+    std::this_thread::yield();
+  CHECK(w.once());
+}
+
+// concatenation doesn't commute, so any combine out of chunk order shows
+void check_reduce(thread_pool& pool) {
+  for (size_t n : {0, 1, 26, 1000})
+    for (size_t grain : {1, 4, 100}) {
+      std::string expected;
+      for (size_t i = 0; i < n; i++)
+        expected += char('a' + i % 26);
+      std::string const r = pool.parallel_reduce(
+          n, grain, std::string(),
+          [](size_t first, size_t last) {
+            std::string s;
+            for (size_t i = first; i < last; i++)
+              s += char('a' + i % 26);
+            return s;
+          },
+          [](std::string const& x, std::string const& y) { return x + y; });
+      CHECK(r == expected);
+    }
+}
+
+// tasks, some submitted from other tasks, all run by the time the pool is
+// destroyed
+void check_submit(size_t threads) {
+  std::atomic<int> ran{0};
+  {
+    thread_pool pool(threads);
+    for (int k = 0; k < 100; k++)
+      pool.submit([&pool, &ran] {
+        ran++;
+        pool.submit([&ran] { ran++; });
+      });
+  }
+  CHECK(ran == 200);
+}
+
+void check_pool(thread_pool& pool) {
+  check_cover(pool);
+  check_nested(pool);
+  check_reduce(pool);
+}
+
+// evaluation above the threshold goes to whichever pool is the default now
+void check_default_pool() {
+  auto mine = std::make_shared<thread_pool>(3);
+  set_default_thread_pool(mine);
+  CHECK(default_thread_pool_ptr() == mine);
+  CHECK(&default_thread_pool() == mine.get());
+
+  size_t const default_threshold = parallel_eval_threshold();
+  set_parallel_eval_threshold(1);
+  matrix<int> a(300, 200, std::vector<int>(300 * 200));
+  for (size_t i = 0; i < a.num_rows(); i++)
+    for (size_t j = 0; j < a.num_cols(); j++)
+      a.at(i, j) = int((i * 7 + j * 3) % 9) - 4;
+
+  // a replaced pool still works for a holder of its pointer
+  std::shared_ptr<thread_pool> const held = default_thread_pool_ptr();
+  set_default_thread_pool_size(2);
+  CHECK(default_thread_pool().size() == 2);
+  mine.reset();
+  visits v(1000);
+  held->parallel_for(1000, 10, [&v](size_t first, size_t last) { v.add(first, last); });
+  CHECK(v.once());
+
+  matrix<int> const b = a + a * 2;
+  bool ok = true;
+  for (size_t i = 0; i < a.num_rows(); i++)
+    for (size_t j = 0; j < a.num_cols(); j++)
+      ok = ok && b.at(i, j) == 3 * a.at(i, j);
+  CHECK(ok);
+
+  // a pool sized and pinned by the host
+  thread_pool_options options;
+  options.threads = 2;
+  options.cpus = {0};
+  set_default_thread_pool(options);
+  CHECK(default_thread_pool().size() == 2);
+  matrix<int> const c = a - a * 3;
+  ok = true;
+  for (size_t i = 0; i < a.num_rows(); i++)
+    for (size_t j = 0; j < a.num_cols(); j++)
+      ok = ok && c.at(i, j) == -2 * a.at(i, j);
+  CHECK(ok);
+  set_parallel_eval_threshold(default_threshold);
+}
+
+int main() {
+  for (size_t threads : {1, 2, 4, 8}) {
+    thread_pool pool(threads);
+    CHECK(pool.size() == threads);
+    check_pool(pool);
+    check_submit(threads);
+  }
+  thread_pool_options options;
+  options.threads = 4;
+  options.cpus = {0};
+  thread_pool pinned(options);
+  CHECK(pinned.size() == 4);
+  check_pool(pinned);
+  check_default_pool();
+  return test_result();
+}
@@ -0,0 +1,117 @@
+#include "test.hpp"
+#include "matrix.hpp"
+#include <complex>
+#include <cstdint>
+#include <vector>
+
+// the blocked transpose engine of transpose.hpp against naive loops:
+// transpose_copy between arrays with padded leading dimensions, and
+// transpose_in_place, square and not, at sizes that aren't a multiple of
+// the 32 x 32 block or of the register kernel's tile and past
+// transpose_parallel_work, for element types with a register kernel and
+// without. then matrices transposing themselves, a = transpose(a), in each
+// layout.
+
+template<typename T>
+T value(size_t i, size_t j) {
+  return T(int((i * 7 + j * 3) % 97) - 48);
+}
+
+template<typename T>
+void check_copy(size_t rows, size_t cols) {
+  size_t const lds = cols + 3, ldd = rows + 5;
+  T const padding = T(1000);
+  std::vector<T> src(rows * lds, padding), dst(cols * ldd, padding);
+  for (size_t i = 0; i < rows; i++)
+    for (size_t j = 0; j < cols; j++)
+      src[i * lds + j] = value<T>(i, j);
+  transpose_copy(rows, cols, src.data(), lds, dst.data(), ldd);
+  bool ok = true;
+  for (size_t j = 0; j < cols; j++)
+    for (size_t i = 0; i < ldd; i++)
+      ok = ok && dst[j * ldd + i] == (i < rows ? value<T>(i, j) : padding);
+  CHECK(ok);
+}
+
+template<typename T>
+void check_in_place(size_t rows, size_t cols) {
+  std::vector<T> data(rows * cols);
+  for (size_t i = 0; i < rows; i++)
+    for (size_t j = 0; j < cols; j++)
+      data[i * cols + j] = value<T>(i, j);
+  transpose_in_place(data.data(), rows, cols);
+  bool ok = true;
+  for (size_t j = 0; j < cols; j++)
+    for (size_t i = 0; i < rows; i++)
+      ok = ok && data[j * rows + i] == value<T>(i, j);
+  CHECK(ok);
+}
+
+template<typename T>
+void check_type() {
+  // the last ones are past transpose_parallel_work
+  for (auto size : {std::make_pair(1, 1), std::make_pair(1, 9), std::make_pair(9, 1),
+                    std::make_pair(3, 5), std::make_pair(4, 4), std::make_pair(8, 8),
+                    std::make_pair(31, 33), std::make_pair(32, 32), std::make_pair(33, 65),
+                    std::make_pair(100, 7), std::make_pair(513, 513),
+                    std::make_pair(600, 501), std::make_pair(257, 1029)}) {
+    check_copy<T>(size.first, size.second);
+    check_in_place<T>(size.first, size.second);
+  }
+}
+
+template<typename L>
+using dense = matrix<double, std::allocator<double>, L>;
+
+template<typename L>
+void check_matrix(size_t rows, size_t cols) {
+  dense<L> a(matrix<double>(rows, cols, std::vector<double>(rows * cols)));
+  for (size_t i = 0; i < rows; i++)
+    for (size_t j = 0; j < cols; j++)
+      a.at(i, j) = value<double>(i, j);
+  dense<L> const a0 = a;
+
+  dense<L> t = transpose(a);
+  bool ok = t.num_rows() == cols && t.num_cols() == rows;
+  for (size_t i = 0; ok && i < rows; i++)
+    for (size_t j = 0; j < cols; j++)
+      ok = ok && t.at(j, i) == a0.at(i, j);
+  CHECK(ok);
+
+  a = transpose(a);
+  ok = a.num_rows() == cols && a.num_cols() == rows;
+  for (size_t i = 0; ok && i < rows; i++)
+    for (size_t j = 0; j < cols; j++)
+      ok = ok && a.at(j, i) == a0.at(i, j);
+  CHECK(ok);
+
+  // and back
+  a.transpose_in_place();
+  ok = a.num_rows() == rows && a.num_cols() == cols;
+  for (size_t i = 0; ok && i < rows; i++)
+    for (size_t j = 0; j < cols; j++)
+      ok = ok && a.at(i, j) == a0.at(i, j);
+  CHECK(ok);
+}
+
+template<typename L>
+void check_layout() {
+  for (auto size : {std::make_pair(1, 1), std::make_pair(3, 5), std::make_pair(33, 33),
+                    std::make_pair(100, 7), std::make_pair(513, 513),
+                    std::make_pair(600, 501)})
+    check_matrix<L>(size.first, size.second);
+}
+
+int main() {
+  set_default_thread_pool_size(4);
+  check_type<double>();
+  check_type<float>();
+  check_type<std::int64_t>();
+  check_type<std::int32_t>();
+  check_type<std::int16_t>();
+  check_type<std::complex<double> >();
+  check_layout<row_major>();
+  check_layout<col_major>();
+  check_layout<tiled<> >();
+  return test_result();
+}
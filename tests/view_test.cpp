@@ -0,0 +1,293 @@
+#include "test.hpp"
+#include "matrix.hpp"
+#include <vector>
+
+// matrices taking over a vector without copying it, and matrix_view over
+// memory owned by the caller, against naive loops: a view over a buffer
+// whose lines are padded out to a stride, read by element-wise expressions
+// and products, written through without touching the padding, and read
+// while its memory is also the destination; and blocks, rows, columns and
+// slices of a matrix, read and written the same ways, overlapping each
+// other or not. views are row- and column-major, at sizes past the gemm
+// micro-tile and parallel_eval_threshold().
+
+template<typename L>
+using dense = matrix<double, std::allocator<double>, L>;
+using naive = matrix<double>;
+
+template<typename L>
+dense<L> filled(size_t rows, size_t cols, size_t seed) {
+  dense<L> m(naive(rows, cols, std::vector<double>(rows * cols)));
+  for (size_t i = 0; i < rows; i++)
+    for (size_t j = 0; j < cols; j++)
+      m.at(i, j) = double(int((i * 7 + j * 3 + seed * 5) % 9) - 4);
+  return m;
+}
+
+// x and y element by element, scaled: alpha * x + beta * y
+template<typename X, typename Y>
+naive combine(double alpha, X const& x, double beta, Y const& y) {
+  naive r(x.num_rows(), x.num_cols(), std::vector<double>(x.num_rows() * x.num_cols()));
+  for (size_t i = 0; i < x.num_rows(); i++)
+    for (size_t j = 0; j < x.num_cols(); j++)
+      r.at(i, j) = alpha * x.at(i, j) + beta * y.at(i, j);
+  return r;
+}
+
+template<typename X, typename Y>
+naive product(X const& x, Y const& y) {
+  naive r(x.num_rows(), y.num_cols(), std::vector<double>(x.num_rows() * y.num_cols()));
+  for (size_t i = 0; i < x.num_rows(); i++)
+    for (size_t j = 0; j < y.num_cols(); j++)
+      for (size_t p = 0; p < x.num_cols(); p++)
+        r.at(i, j) += x.at(i, p) * y.at(p, j);
+  return r;
+}
+
+template<typename X, typename Y>
+bool same(X const& x, Y const& y) {
+  if (x.num_rows() != y.num_rows() || x.num_cols() != y.num_cols())
+    return false;
+  for (size_t i = 0; i < x.num_rows(); i++)
+    for (size_t j = 0; j < x.num_cols(); j++)
+      if (x.at(i, j) != y.at(i, j))
+        return false;
+  return true;
+}
+
+// the vector's buffer becomes the matrix's storage, and comes back out
+void check_move() {
+  std::vector<double> v(6 * 4, 1.0);
+  double const* const buffer = v.data();
+  naive m(6, 4, std::move(v));
+  CHECK(m.data() == buffer);
+  CHECK(m.at(5, 3) == 1.0);
+  std::vector<double> const back = m.release();
+  CHECK(back.data() == buffer);
+}
+
+// a rows x cols view over lines of stride elements, the rest of each line
+// being padding that must keep its value
+template<typename L>
+void check_buffer(size_t rows, size_t cols) {
+  size_t const inner = L::inner(rows, cols), outer = L::outer(rows, cols);
+  size_t const stride = inner + 3;
+  double const padding = 1000;
+  std::vector<double> buffer(outer * stride, padding);
+  matrix_view<double, L> v(buffer.data(), rows, cols, stride);
+  dense<L> const a = filled<L>(rows, cols, 1), b = filled<L>(rows, cols, 2);
+  dense<L> const k = filled<L>(cols, cols, 3);
+
+  v = a + b;
+  CHECK(same(v, combine(1, a, 1, b)));
+  v += a * 2.0;
+  CHECK(same(v, combine(3, a, 1, b)));
+  v -= b;
+  CHECK(same(v, combine(3, a, 0, b)));
+  v *= 2.0;
+  CHECK(same(v, combine(6, a, 0, b)));
+
+  // read as an operand, through a read-only view
+  matrix_view<double const, L> const r = v;
+  dense<L> m = r - a;
+  CHECK(same(m, combine(5, a, 0, b)));
+  m = r * k;
+  CHECK(same(m, product(combine(6, a, 0, b), k)));
+  m = transpose(r) * r;
+  naive rt(cols, rows, std::vector<double>(rows * cols));
+  for (size_t i = 0; i < rows; i++)
+    for (size_t j = 0; j < cols; j++)
+      rt.at(j, i) = r.at(i, j);
+  CHECK(same(m, product(rt, r)));
+
+  // products written through the view, reading it as well
+  v = a * k;
+  CHECK(same(v, product(a, k)));
+  naive const ak(v);
+  v = v * k;
+  CHECK(same(v, product(ak, k)));
+  naive const akk(v);
+  v += v * k;
+  CHECK(same(v, combine(1, akk, 1, product(akk, k))));
+
+  bool untouched = true;
+  for (size_t o = 0; o < outer; o++)
+    for (size_t p = inner; p < stride; p++)
+      untouched = untouched && buffer[o * stride + p] == padding;
+  CHECK(untouched);
+}
+
+// the destination's own storage viewed on the right-hand side
+template<typename L>
+void check_self(size_t n) {
+  dense<L> const b = filled<L>(n, n, 2), c0 = filled<L>(n, n, 3);
+  dense<L> c = c0;
+  c = view(c) * b;
+  CHECK(same(c, product(c0, b)));
+  c = c0;
+  c = b * view(c) + view(c);
+  CHECK(same(c, combine(1, product(b, c0), 1, c0)));
+  c = c0;
+  view(c) = view(c) * view(c);
+  CHECK(same(c, product(c0, c0)));
+}
+
+// the rows x cols elements of x from (row, col) on
+template<typename X>
+naive part(X const& x, size_t row, size_t col, size_t rows, size_t cols) {
+  naive r(rows, cols, std::vector<double>(rows * cols));
+  for (size_t i = 0; i < rows; i++)
+    for (size_t j = 0; j < cols; j++)
+      r.at(i, j) = x.at(row + i, col + j);
+  return r;
+}
+
+// x with y written over it from (row, col) on
+template<typename X, typename Y>
+naive overwritten(X const& x, size_t row, size_t col, Y const& y) {
+  naive r(x);
+  for (size_t i = 0; i < y.num_rows(); i++)
+    for (size_t j = 0; j < y.num_cols(); j++)
+      r.at(row + i, col + j) = y.at(i, j);
+  return r;
+}
+
+// blocks, rows and columns of an n x (n + 3) matrix, n > 5
+template<typename L>
+void check_parts(size_t n) {
+  dense<L> const a = filled<L>(n, n + 3, 1), b = filled<L>(n, n + 3, 2);
+  dense<L> const c = filled<L>(n, n + 3, 3);
+
+  // reads
+  naive m = block(a, 1, 2, n - 2, 4);
+  CHECK(same(m, part(a, 1, 2, n - 2, 4)));
+  m = block(a, 1, 2, n - 2, 4) + block(b, 0, 3, n - 2, 4) * 2.0;
+  CHECK(same(m, combine(1, part(a, 1, 2, n - 2, 4), 2, part(b, 0, 3, n - 2, 4))));
+  m = row(a, 3) - row(b, n - 1);
+  CHECK(same(m, combine(1, part(a, 3, 0, 1, n + 3), -1, part(b, n - 1, 0, 1, n + 3))));
+  m = transpose(col(a, 1)) * block(b, 0, 2, n, 4);
+  naive at(1, n, std::vector<double>(n));
+  for (size_t i = 0; i < n; i++)
+    at.at(0, i) = a.at(i, 1);
+  CHECK(same(m, product(at, part(b, 0, 2, n, 4))));
+
+  // writes
+  dense<L> d = a;
+  block(d, 1, 2, n - 2, 4) = block(b, 0, 0, n - 2, 4) + block(c, 2, 3, n - 2, 4);
+  CHECK(same(d, overwritten(a, 1, 2, combine(1, part(b, 0, 0, n - 2, 4), 1,
+                                             part(c, 2, 3, n - 2, 4)))));
+  d = a;
+  row(d, 3) += row(d, 0) * 2.0;
+  col(d, 1) -= col(b, 2);
+  naive expected = a;
+  for (size_t j = 0; j < n + 3; j++)
+    expected.at(3, j) += 2 * a.at(0, j);
+  for (size_t i = 0; i < n; i++)
+    expected.at(i, 1) -= b.at(i, 2);
+  CHECK(same(d, expected));
+  d = a;
+  block(d, 0, 0, 2, 3) *= 3.0;
+  CHECK(same(d, overwritten(a, 0, 0, combine(3, part(a, 0, 0, 2, 3), 0, part(a, 0, 0, 2, 3)))));
+
+  // overlapping the block written
+  d = a;
+  block(d, 1, 0, n - 1, n + 3) = block(d, 0, 0, n - 1, n + 3) * 2.0;
+  CHECK(same(d, overwritten(a, 1, 0, combine(2, part(a, 0, 0, n - 1, n + 3), 0,
+                                             part(a, 0, 0, n - 1, n + 3)))));
+  d = a;
+  block(d, 0, 0, 4, 4) = transpose(block(d, 0, 1, 4, 4));
+  naive t(4, 4, std::vector<double>(16));
+  for (size_t i = 0; i < 4; i++)
+    for (size_t j = 0; j < 4; j++)
+      t.at(i, j) = a.at(j, 1 + i);
+  CHECK(same(d, overwritten(a, 0, 0, t)));
+
+  // products into a block, from blocks of other matrices and of its own
+  d = a;
+  block(d, 2, 1, n - 3, n - 4) = block(b, 0, 0, n - 3, 5) * block(c, 1, 1, 5, n - 4);
+  CHECK(same(d, overwritten(a, 2, 1, product(part(b, 0, 0, n - 3, 5),
+                                             part(c, 1, 1, 5, n - 4)))));
+  d = a;
+  block(d, 0, 0, 4, 4) = block(d, 0, 0, 4, 4) * block(d, 1, 1, 4, 4);
+  CHECK(same(d, overwritten(a, 0, 0, product(part(a, 0, 0, 4, 4), part(a, 1, 1, 4, 4)))));
+  d = a;
+  block(d, 1, 1, n - 1, 3) += block(b, 1, 0, n - 1, n) * block(c, 0, 2, n, 3);
+  CHECK(same(d, overwritten(a, 1, 1, combine(1, part(a, 1, 1, n - 1, 3), 1,
+                                             product(part(b, 1, 0, n - 1, n),
+                                                     part(c, 0, 2, n, 3))))));
+
+  // a matrix assigned a block of itself
+  d = a;
+  d = block(d, 1, 1, n - 1, n);
+  CHECK(same(d, part(a, 1, 1, n - 1, n)));
+
+  // assigning a view copies the elements rather than rebinding it
+  d = a;
+  auto v = block(d, 0, 0, 2, 2);
+  auto const w = block(b, 0, 0, 2, 2);
+  v = w;
+  CHECK(same(d, overwritten(a, 0, 0, part(b, 0, 0, 2, 2))));
+  CHECK(v.data() == d.data());
+}
+
+// every step-th row of a row-major matrix, or column of a column-major one
+void check_slices(size_t n) {
+  naive a = filled<row_major>(n, 6, 1);
+  naive const a0 = a;
+  size_t const count = (n + 1) / 2;
+  naive expected(count, 6, std::vector<double>(count * 6));
+  for (size_t i = 0; i < count; i++)
+    for (size_t j = 0; j < 6; j++)
+      expected.at(i, j) = a0.at(2 * i, j);
+  naive m = row_slice(a, 0, count, 2);
+  CHECK(same(m, expected));
+  m = row_slice(a, 0, count, 2) * transpose(row_slice(a, 0, count, 2));
+  naive et(6, count, std::vector<double>(count * 6));
+  for (size_t i = 0; i < count; i++)
+    for (size_t j = 0; j < 6; j++)
+      et.at(j, i) = expected.at(i, j);
+  CHECK(same(m, product(expected, et)));
+  row_slice(a, 0, count, 2) *= 0.0;
+  row_slice(a, 1, n / 2, 2) += row_slice(a, 1, n / 2, 2);
+  bool ok = true;
+  for (size_t i = 0; i < n; i++)
+    for (size_t j = 0; j < 6; j++)
+      ok = ok && a.at(i, j) == (i % 2 == 0 ? 0 : 2 * a0.at(i, j));
+  CHECK(ok);
+
+  dense<col_major> c = filled<col_major>(6, n, 2);
+  dense<col_major> const c0 = c;
+  naive got = col_slice(c, 1, n / 2, 2);
+  naive cexpected(6, n / 2, std::vector<double>(6 * (n / 2)));
+  for (size_t i = 0; i < 6; i++)
+    for (size_t j = 0; j < n / 2; j++)
+      cexpected.at(i, j) = c0.at(i, 1 + 2 * j);
+  CHECK(same(got, cexpected));
+  col_slice(c, 1, n / 2, 2) = col_slice(c, 0, n / 2, 2) - col_slice(c0, 1, n / 2, 2);
+  ok = true;
+  for (size_t i = 0; i < 6; i++)
+    for (size_t j = 0; j < n; j++)
+      ok = ok && c.at(i, j) == (j % 2 == 0 ? c0.at(i, j) : c0.at(i, j - 1) - c0.at(i, j));
+  CHECK(ok);
+}
+
+int main() {
+  set_default_thread_pool_size(4);
+  size_t const default_threshold = parallel_eval_threshold();
+  check_move();
+  for (size_t threshold : {size_t(1), default_threshold}) {
+    set_parallel_eval_threshold(threshold);
+    for (size_t n : {1, 3, 17, 130, 301}) {
+      check_buffer<row_major>(n, n / 2 + 1);
+      check_buffer<col_major>(n, n / 2 + 1);
+      check_self<row_major>(n);
+      check_self<col_major>(n);
+    }
+    for (size_t n : {6, 9, 40, 203}) {
+      check_parts<row_major>(n);
+      check_parts<col_major>(n);
+      check_slices(n);
+    }
+  }
+  return test_result();
+}
@@ -0,0 +1,272 @@
+#ifndef THREAD_POOL
+#define THREAD_POOL
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <memory>
+#include <algorithm>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// persistent work-stealing pool, the execution backend for everything in the
+// library that runs in parallel (expression evaluation, gemm, reductions).
+//
+// threads are started once and sleep while there is no work, so handing a
+// loop to the pool costs a wakeup rather than a thread creation. every worker
+// owns a deque: it pushes and pops its own tasks at the back, and when it runs
+// dry it steals from the front of the others'. tasks submitted from outside
+// the pool are dealt round-robin over the workers' deques.
+
+struct thread_pool_options {
+  // threads running a loop, including the caller: n - 1 workers are started
+  size_t threads = std::thread::hardware_concurrency();
+  // worker i is pinned to cpu cpus[i % cpus.size()]; empty leaves placement
+  // to the OS. ignored where affinity isn't supported.
+  std::vector<int> cpus;
+};
+
+class thread_pool {
+  struct worker_queue {
+    std::mutex mutex;
+    std::deque<std::function<void()> > tasks;
+  };
+
+  std::vector<std::unique_ptr<worker_queue> > queues_;
+  std::vector<std::thread> workers_;
+
+  // queued tasks nobody has taken yet. raised before a task is pushed, so it
+  // never underflows, and checked by workers before going to sleep
+  std::atomic<size_t> pending_{0};
+  std::atomic<size_t> next_queue_{0};
+  std::mutex sleep_mutex_;
+  std::condition_variable wake_;
+  bool stop_ = false;
+
+  struct worker_id {
+    thread_pool const* pool = nullptr;
+    size_t index = 0;
+  };
+
+  static worker_id& current_worker() {
+    thread_local worker_id id;
+    return id;
+  }
+
+  bool pop(size_t index, std::function<void()>& task) {
+    worker_queue& q = *queues_[index];
+    std::lock_guard<std::mutex> lock(q.mutex);
+    if (q.tasks.empty())
+      return false;
+    task = std::move(q.tasks.back());
+    q.tasks.pop_back();
+    pending_--;
+    return true;
+  }
+
+  bool steal(size_t thief, std::function<void()>& task) {
+    for (size_t i = 1; i < queues_.size(); i++) {
+      worker_queue& q = *queues_[(thief + i) % queues_.size()];
+      std::lock_guard<std::mutex> lock(q.mutex);
+      if (q.tasks.empty())
+        continue;
+      task = std::move(q.tasks.front());
+      q.tasks.pop_front();
+      pending_--;
+      return true;
+    }
+    return false;
+  }
+
+  void work(size_t index) {
+    current_worker() = {this, index};
+    std::function<void()> task;
+    for (;;) {
+      if (pop(index, task) || steal(index, task)) {
+        task();
+        task = nullptr;
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(sleep_mutex_);
+      wake_.wait(lock, [this] { return stop_ || pending_ > 0; });
+      if (stop_ && pending_ == 0)
+        return;
+    }
+  }
+
+  static void pin(std::thread& thread, int cpu) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+#else
+    (void)thread;
+    (void)cpu;
+#endif
+  }
+
+  // state of one parallel_for, shared with the helper tasks so that a helper
+  // that only starts after the loop has finished finds nothing left to do
+  // instead of a dangling reference
+  struct loop_state {
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> done{0};
+    size_t chunks;
+    std::mutex mutex;
+    std::condition_variable finished;
+  };
+
+public:
+  explicit thread_pool(thread_pool_options const& options) {
+    size_t const threads = std::max<size_t>(options.threads, 1);
+    for (size_t i = 1; i < threads; i++)
+      queues_.emplace_back(new worker_queue);
+    for (size_t i = 0; i + 1 < threads; i++) {
+      workers_.emplace_back([this, i] { work(i); });
+      if (!options.cpus.empty())
+        pin(workers_.back(), options.cpus[i % options.cpus.size()]);
+    }
+  }
+
+  explicit thread_pool(size_t threads = std::thread::hardware_concurrency())
+    : thread_pool(thread_pool_options{threads, {}}) {}
+
+  thread_pool(thread_pool const&) = delete;
+  thread_pool& operator=(thread_pool const&) = delete;
+
+  // runs every task still queued, then joins the workers
+  ~thread_pool() {
+    {
+      std::lock_guard<std::mutex> lock(sleep_mutex_);
+      stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto& worker : workers_)
+      worker.join();
+  }
+
+  size_t size() const {
+    return workers_.size() + 1;
+  }
+
+  // queues a task. from a worker of this pool it goes onto that worker's own
+  // deque, where it is likely to run while its data is still in cache.
+  void submit(std::function<void()> task) {
+    if (workers_.empty()) {
+      task();
+      return;
+    }
+    worker_id const& self = current_worker();
+    size_t const index = self.pool == this ? self.index
+                         : next_queue_++ % queues_.size();
+    pending_++;
+    {
+      std::lock_guard<std::mutex> lock(queues_[index]->mutex);
+      queues_[index]->tasks.push_back(std::move(task));
+    }
+    { // pairs with the predicate check in work(), so the wakeup isn't lost
+      std::lock_guard<std::mutex> lock(sleep_mutex_);
+    }
+    wake_.notify_one();
+  }
+
+  // calls f(begin, end) for consecutive chunks of at least grain indices
+  // covering [0, n), and returns once all of them are done. the calling
+  // thread takes chunks as well, so nested loops can't deadlock the pool.
+  template<typename F>
+  void parallel_for(size_t n, size_t grain, F const& f) {
+    grain = std::max<size_t>(grain, 1);
+    size_t const chunks = (n + grain - 1) / grain;
+    if (chunks <= 1 || workers_.empty()) {
+      if (n > 0)
+        f(size_t(0), n);
+      return;
+    }
+
+    auto state = std::make_shared<loop_state>();
+    state->chunks = chunks;
+
+    // f outlives every call made through run: chunks are only handed out
+    // while done < chunks, and this function doesn't return before that
+    auto run = [state, &f, n, grain] {
+      size_t chunk;
+      while ((chunk = state->next++) < state->chunks) {
+        f(chunk * grain, std::min(n, (chunk + 1) * grain));
+        if (++state->done == state->chunks) {
+          std::lock_guard<std::mutex> lock(state->mutex);
+          state->finished.notify_all();
+        }
+      }
+    };
+
+    size_t const helpers = std::min(workers_.size(), chunks - 1);
+    for (size_t i = 0; i < helpers; i++)
+      submit(run);
+    run();
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->finished.wait(lock, [&state] {
+      return state->done == state->chunks;
+    });
+  }
+
+  // combines map(begin, end) over the chunks of a parallel_for, in chunk
+  // order, so the result doesn't depend on scheduling
+  template<typename R, typename Map, typename Combine>
+  R parallel_reduce(size_t n, size_t grain, R init, Map const& map,
+                    Combine const& combine) {
+    grain = std::max<size_t>(grain, 1);
+    std::vector<R> partial((n + grain - 1) / grain, init);
+    parallel_for(n, grain, [&partial, &map, grain](size_t first, size_t last) {
+      partial[first / grain] = map(first, last);
+    });
+    for (auto const& r : partial)
+      init = combine(init, r);
+    return init;
+  }
+};
+
+namespace detail {
+
+inline std::shared_ptr<thread_pool>& default_thread_pool_slot() {
+  static std::shared_ptr<thread_pool> pool = std::make_shared<thread_pool>();
+  return pool;
+}
+
+} // namespace detail
+
+// pool shared by all parallel work in the library. loops hold a reference for
+// as long as they run, so replacing the pool never pulls it out from under
+// them.
+inline std::shared_ptr<thread_pool> default_thread_pool_ptr() {
+  return std::atomic_load(&detail::default_thread_pool_slot());
+}
+
+// valid until the pool is replaced
+inline thread_pool& default_thread_pool() {
+  return *default_thread_pool_ptr();
+}
+
+// plugs in a pool owned by the host application, e.g. one sized and pinned to
+// match its own threads
+inline void set_default_thread_pool(std::shared_ptr<thread_pool> pool) {
+  std::atomic_store(&detail::default_thread_pool_slot(), std::move(pool));
+}
+
+inline void set_default_thread_pool(thread_pool_options const& options) {
+  set_default_thread_pool(std::make_shared<thread_pool>(options));
+}
+
+inline void set_default_thread_pool_size(size_t threads) {
+  set_default_thread_pool(std::make_shared<thread_pool>(threads));
+}
+
+#endif
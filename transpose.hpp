@@ -0,0 +1,266 @@
+#ifndef TRANSPOSE
+#define TRANSPOSE
+
+#include <cstddef>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+#include <memory>
+#include "gemm_kernels.hpp"
+#include "thread_pool.hpp"
+
+// transposition of row-major arrays, the engine behind materializing
+// transpose(expr).
+//
+// out of place, the source is walked in blocks small enough that a block of
+// it and the matching block of the destination share L1, and each block in
+// square tiles of one vector register per row, transposed in registers with
+// shuffles: 4 x 4 for 8 byte elements and 8 x 8 for 4 byte ones with AVX,
+// half that with SSE. transposing only moves bits, so those kernels serve
+// every trivially copyable type of the two sizes; anything else goes through
+// a scalar loop over the same blocks.
+//
+// in place, square arrays swap pairs of blocks across the diagonal. other
+// shapes follow the cycles of the permutation instead, with one bit per
+// element to mark those already moved.
+
+namespace detail {
+
+// dst (K x K, leading dimension ldd) = transpose of src (K x K, lds), for
+// elements of one size; K is the kernel's tile
+struct transpose_kernel {
+  size_t tile;
+  void (*fn)(void const* src, size_t lds, void* dst, size_t ldd);
+};
+
+} // namespace detail
+
+#ifdef MATRIX_X86_KERNELS
+
+MATRIX_TARGET_BEGIN(MATRIX_TARGET_SSE42)
+namespace detail {
+namespace sse42 {
+
+inline void transpose_64(void const* src, size_t lds, void* dst, size_t ldd) {
+  double const* s = static_cast<double const*>(src);
+  double* d = static_cast<double*>(dst);
+  __m128d const r0 = _mm_loadu_pd(s);
+  __m128d const r1 = _mm_loadu_pd(s + lds);
+  _mm_storeu_pd(d, _mm_unpacklo_pd(r0, r1));
+  _mm_storeu_pd(d + ldd, _mm_unpackhi_pd(r0, r1));
+}
+
+inline void transpose_32(void const* src, size_t lds, void* dst, size_t ldd) {
+  float const* s = static_cast<float const*>(src);
+  float* d = static_cast<float*>(dst);
+  __m128 r0 = _mm_loadu_ps(s);
+  __m128 r1 = _mm_loadu_ps(s + lds);
+  __m128 r2 = _mm_loadu_ps(s + 2 * lds);
+  __m128 r3 = _mm_loadu_ps(s + 3 * lds);
+  _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+  _mm_storeu_ps(d, r0);
+  _mm_storeu_ps(d + ldd, r1);
+  _mm_storeu_ps(d + 2 * ldd, r2);
+  _mm_storeu_ps(d + 3 * ldd, r3);
+}
+
+} // namespace sse42
+} // namespace detail
+MATRIX_TARGET_END
+
+MATRIX_TARGET_BEGIN(MATRIX_TARGET_AVX2)
+namespace detail {
+namespace avx2 {
+
+inline void transpose_64(void const* src, size_t lds, void* dst, size_t ldd) {
+  double const* s = static_cast<double const*>(src);
+  double* d = static_cast<double*>(dst);
+  __m256d const r0 = _mm256_loadu_pd(s);
+  __m256d const r1 = _mm256_loadu_pd(s + lds);
+  __m256d const r2 = _mm256_loadu_pd(s + 2 * lds);
+  __m256d const r3 = _mm256_loadu_pd(s + 3 * lds);
+  // pairs within 128 bit lanes, then swap the lanes across pairs of rows
+  __m256d const t0 = _mm256_unpacklo_pd(r0, r1);
+  __m256d const t1 = _mm256_unpackhi_pd(r0, r1);
+  __m256d const t2 = _mm256_unpacklo_pd(r2, r3);
+  __m256d const t3 = _mm256_unpackhi_pd(r2, r3);
+  _mm256_storeu_pd(d, _mm256_permute2f128_pd(t0, t2, 0x20));
+  _mm256_storeu_pd(d + ldd, _mm256_permute2f128_pd(t1, t3, 0x20));
+  _mm256_storeu_pd(d + 2 * ldd, _mm256_permute2f128_pd(t0, t2, 0x31));
+  _mm256_storeu_pd(d + 3 * ldd, _mm256_permute2f128_pd(t1, t3, 0x31));
+}
+
+inline void transpose_32(void const* src, size_t lds, void* dst, size_t ldd) {
+  float const* s = static_cast<float const*>(src);
+  float* d = static_cast<float*>(dst);
+  __m256 r[8], t[8];
+  for (size_t i = 0; i < 8; i++)
+    r[i] = _mm256_loadu_ps(s + i * lds);
+  // 2 x 2 blocks of single elements, then of pairs, then of 128 bit lanes
+  for (size_t i = 0; i < 8; i += 2) {
+    t[i] = _mm256_unpacklo_ps(r[i], r[i + 1]);
+    t[i + 1] = _mm256_unpackhi_ps(r[i], r[i + 1]);
+  }
+  for (size_t i = 0; i < 8; i += 4) {
+    r[i] = _mm256_shuffle_ps(t[i], t[i + 2], _MM_SHUFFLE(1, 0, 1, 0));
+    r[i + 1] = _mm256_shuffle_ps(t[i], t[i + 2], _MM_SHUFFLE(3, 2, 3, 2));
+    r[i + 2] = _mm256_shuffle_ps(t[i + 1], t[i + 3], _MM_SHUFFLE(1, 0, 1, 0));
+    r[i + 3] = _mm256_shuffle_ps(t[i + 1], t[i + 3], _MM_SHUFFLE(3, 2, 3, 2));
+  }
+  for (size_t i = 0; i < 4; i++) {
+    _mm256_storeu_ps(d + i * ldd, _mm256_permute2f128_ps(r[i], r[i + 4], 0x20));
+    _mm256_storeu_ps(d + (i + 4) * ldd, _mm256_permute2f128_ps(r[i], r[i + 4], 0x31));
+  }
+}
+
+} // namespace avx2
+} // namespace detail
+MATRIX_TARGET_END
+
+#endif
+
+namespace detail {
+
+// the widest register kernel for elements of type T on this host, or none
+template<typename T>
+transpose_kernel active_transpose_kernel() {
+#ifdef MATRIX_X86_KERNELS
+  if (std::is_trivially_copyable<T>::value &&
+      (sizeof(T) == 8 || sizeof(T) == 4)) {
+    bool const wide = sizeof(T) == 8;
+    switch (active_gemm_isa()) {
+    case gemm_isa::avx512:
+    case gemm_isa::avx2:
+      return wide ? transpose_kernel{4, avx2::transpose_64}
+                  : transpose_kernel{8, avx2::transpose_32};
+    case gemm_isa::sse42:
+      return wide ? transpose_kernel{2, sse42::transpose_64}
+                  : transpose_kernel{4, sse42::transpose_32};
+    default:
+      break;
+    }
+  }
+#endif
+  return {0, nullptr};
+}
+
+// blocks of 32 x 32 keep a block of the source and one of the destination
+// within 16KB for doubles
+constexpr size_t transpose_block = 32;
+
+// rows [first, last) of src (rows x cols, lds) into columns of dst (ldd)
+template<typename T>
+void transpose_rows(size_t first, size_t last, size_t cols, T const* src,
+                    size_t lds, T* dst, size_t ldd, transpose_kernel kernel) {
+  size_t const K = kernel.fn ? kernel.tile : transpose_block;
+  for (size_t ib = first; ib < last; ib += transpose_block) {
+    size_t const ie = std::min(ib + transpose_block, last);
+    for (size_t jb = 0; jb < cols; jb += transpose_block) {
+      size_t const je = std::min(jb + transpose_block, cols);
+      size_t i = ib;
+      if (kernel.fn) {
+        for (; i + K <= ie; i += K) {
+          size_t j = jb;
+          for (; j + K <= je; j += K)
+            kernel.fn(src + i * lds + j, lds, dst + j * ldd + i, ldd);
+          for (; j < je; j++)
+            for (size_t ii = i; ii < i + K; ii++)
+              dst[j * ldd + ii] = src[ii * lds + j];
+        }
+      }
+      for (; i < ie; i++)
+        for (size_t j = jb; j < je; j++)
+          dst[j * ldd + i] = src[i * lds + j];
+    }
+  }
+}
+
+// swaps blocks (ib, jb) and (jb, ib) of a square array transposing both, or
+// transposes the diagonal block in place when ib == jb
+template<typename T>
+void transpose_block_pair(T* data, size_t n, size_t ib, size_t jb,
+                          T* tmp, transpose_kernel kernel) {
+  size_t const B = transpose_block;
+  size_t const ie = std::min(ib + B, n);
+  size_t const je = std::min(jb + B, n);
+  // tmp = block (jb, ib)', then block (jb, ib) = block (ib, jb)', then
+  // block (ib, jb) = tmp
+  transpose_rows(0, je - jb, ie - ib, data + jb * n + ib, n, tmp, B, kernel);
+  if (ib != jb)
+    transpose_rows(0, ie - ib, je - jb, data + ib * n + jb, n,
+                   data + jb * n + ib, n, kernel);
+  for (size_t i = ib; i < ie; i++)
+    std::copy(tmp + (i - ib) * B, tmp + (i - ib) * B + (je - jb),
+              data + i * n + jb);
+}
+
+} // namespace detail
+
+// below this many elements transposes run on the calling thread only
+constexpr size_t transpose_parallel_work = size_t(1) << 18;
+
+// dst (cols x rows, leading dimension ldd) = transpose of src (rows x cols,
+// leading dimension lds), both row-major. src and dst must not overlap.
+template<typename T>
+void transpose_copy(size_t rows, size_t cols, T const* src, size_t lds,
+                    T* dst, size_t ldd) {
+  detail::transpose_kernel const kernel = detail::active_transpose_kernel<T>();
+  if (rows * cols < transpose_parallel_work) {
+    detail::transpose_rows(0, rows, cols, src, lds, dst, ldd, kernel);
+    return;
+  }
+  size_t const B = detail::transpose_block;
+  size_t const blocks = (rows + B - 1) / B;
+  std::shared_ptr<thread_pool> const pool = default_thread_pool_ptr();
+  pool->parallel_for(blocks, 1, [&](size_t first, size_t last) {
+    detail::transpose_rows(first * B, std::min(last * B, rows), cols,
+                           src, lds, dst, ldd, kernel);
+  });
+}
+
+// transposes the rows x cols row-major array at data into a cols x rows one
+// in the same memory
+template<typename T>
+void transpose_in_place(T* data, size_t rows, size_t cols) {
+  size_t const N = rows * cols;
+  if (rows <= 1 || cols <= 1)
+    return;
+
+  if (rows == cols) {
+    detail::transpose_kernel const kernel = detail::active_transpose_kernel<T>();
+    size_t const B = detail::transpose_block;
+    size_t const blocks = (rows + B - 1) / B;
+    auto pairs = [=](size_t first, size_t last) {
+      std::unique_ptr<T[]> tmp(new T[B * B]);
+      for (size_t ib = first; ib < last; ib++)
+        for (size_t jb = ib; jb < blocks; jb++)
+          detail::transpose_block_pair(data, rows, ib * B, jb * B, tmp.get(), kernel);
+    };
+    if (N < transpose_parallel_work) {
+      pairs(0, blocks);
+    } else {
+      std::shared_ptr<thread_pool> const pool = default_thread_pool_ptr();
+      pool->parallel_for(blocks, 1, pairs);
+    }
+    return;
+  }
+
+  // element k = i * cols + j moves to j * rows + i. the first and last
+  // elements stay put; every other cycle is rotated once, starting from its
+  // first position not yet visited
+  std::vector<bool> moved(N);
+  for (size_t start = 1; start + 1 < N; start++) {
+    if (moved[start])
+      continue;
+    T carried = data[start];
+    size_t k = start;
+    do {
+      size_t const next = (k % cols) * rows + k / cols;
+      std::swap(carried, data[next]);
+      moved[next] = true;
+      k = next;
+    } while (k != start);
+  }
+}
+
+#endif
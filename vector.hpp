@@ -0,0 +1,234 @@
+#ifndef VECTOR
+#define VECTOR
+
+#include <vector>
+#include <cassert>
+#include <utility>
+#include <initializer_list>
+#include "matrix.hpp"
+
+// row and column vectors: 1 x n and n x 1 matrices that know it.
+//
+// col_vector<T> and row_vector<T> keep their elements contiguous, and the
+// dimension of length one is part of their type (see matrix_expr's
+// static_rows and static_cols), so operands of the wrong shape don't
+// compile. they take part in expressions like any matrix. a product with a
+// vector, a * x or x * a, goes to gemv (see gemv.hpp), which streams the
+// matrix once in the order it's stored, rather than to gemm.
+//
+// gemv() and gevm() below fold the scaling and accumulation into that pass,
+//   y = alpha * a * x + beta * y
+// the step iterative solvers repeat, without a temporary for a * x.
+
+template<typename T, bool Column, typename Alloc>
+class basic_vector : public matrix_expr<basic_vector<T, Column, Alloc> > {
+  using matrix_expr<basic_vector<T, Column, Alloc> >::num_rows_;
+  using matrix_expr<basic_vector<T, Column, Alloc> >::num_cols_;
+  // n x 1 or 1 x n row-major, contiguous either way. expressions are
+  // evaluated into it the way they are into any matrix
+  matrix<T, Alloc> elems_;
+
+  static matrix<T, Alloc> shaped(std::vector<T, Alloc> elems) {
+    size_t const n = elems.size();
+    return matrix<T, Alloc>(Column ? n : 1, Column ? 1 : n, std::move(elems));
+  }
+
+  void sync() {
+    num_rows_ = elems_.num_rows();
+    num_cols_ = elems_.num_cols();
+  }
+
+public:
+  static constexpr bool is_linear = true;
+  static constexpr bool is_strided_linear = true;
+  using layout = row_major;
+  static constexpr size_t static_rows = Column ? dynamic_extent : 1;
+  static constexpr size_t static_cols = Column ? 1 : dynamic_extent;
+
+  basic_vector() : basic_vector(std::vector<T, Alloc>()) {}
+
+  explicit basic_vector(size_t n, T const& value = T())
+    : basic_vector(std::vector<T, Alloc>(n, value)) {}
+
+  // takes over the elements. pass an rvalue to hand the buffer over
+  // without copying it
+  explicit basic_vector(std::vector<T, Alloc> elems) : elems_(shaped(std::move(elems))) {
+    sync();
+  }
+
+  basic_vector(std::initializer_list<T> list)
+    : basic_vector(std::vector<T, Alloc>(list)) {}
+
+  template<typename E>
+  basic_vector(matrix_expr<E> const& expr) : basic_vector() {
+    *this = expr;
+  }
+
+  template<typename E>
+  basic_vector& operator=(matrix_expr<E> const& expr) {
+    static_assert(detail::extents_agree(E::static_rows, static_rows) &&
+                  detail::extents_agree(E::static_cols, static_cols),
+                  "assigning a matrix to a vector");
+    assert((Column ? expr.num_cols() : expr.num_rows()) == 1);
+    elems_ = expr;
+    sync();
+    return *this;
+  }
+
+  size_t size() const {
+    return Column ? num_rows_ : num_cols_;
+  }
+
+  T operator[](size_t i) const {
+    return elems_.data()[i];
+  }
+
+  T& operator[](size_t i) {
+    return elems_.data()[i];
+  }
+
+  T at(size_t row, size_t col) const {
+    return elems_.at(row, col);
+  }
+
+  T& at(size_t row, size_t col) {
+    return elems_.at(row, col);
+  }
+
+  T at(size_t i) const {
+    return elems_.at(i);
+  }
+
+  packet_t<T> packet(size_t i) const {
+    return elems_.packet(i);
+  }
+
+  packet_t<T> packet(size_t row, size_t col) const {
+    return elems_.packet(row, col);
+  }
+
+  T const* data() const {
+    return elems_.data();
+  }
+
+  T* data() {
+    return elems_.data();
+  }
+
+  // hands the elements back out, leaving an empty vector
+  std::vector<T, Alloc> release() {
+    std::vector<T, Alloc> elems = elems_.release();
+    elems_ = shaped(std::vector<T, Alloc>());
+    sync();
+    return elems;
+  }
+
+  template<typename E>
+  basic_vector& operator+=(matrix_expr<E> const& expr) {
+    elems_ += expr;
+    return *this;
+  }
+
+  template<typename E>
+  basic_vector& operator-=(matrix_expr<E> const& expr) {
+    elems_ -= expr;
+    return *this;
+  }
+
+  template<typename S>
+  typename std::enable_if<detail::is_scalar_operand<S>::value, basic_vector&>::type
+  operator*=(S const& scalar) {
+    elems_ *= scalar;
+    return *this;
+  }
+};
+
+template<typename T, typename Alloc = std::allocator<T> >
+using col_vector = basic_vector<T, true, Alloc>;
+
+template<typename T, typename Alloc = std::allocator<T> >
+using row_vector = basic_vector<T, false, Alloc>;
+
+namespace detail {
+
+template<typename T, bool Column, typename A>
+dense_operand<T> as_dense(basic_vector<T, Column, A> const& v, scratch_handle<T>&) {
+  return {v.data(), v.num_rows(), v.num_cols(), std::ptrdiff_t(v.num_cols()), 1};
+}
+
+template<typename T, bool Column, typename A>
+bool shares_storage(basic_vector<T, Column, A> const& operand, T const* first, T const* last) {
+  return operand.data() < last && first < operand.data() + operand.size();
+}
+
+template<typename T, bool Column, typename A>
+bool overlaps_elsewhere(basic_vector<T, Column, A> const& operand,
+                        dense_operand<T> const& dst, bool in_place) {
+  scratch_handle<T> none;
+  return overlaps_elsewhere(as_dense(operand, none), dst, in_place);
+}
+
+template<typename T, bool Column, typename A>
+bool same_elements(basic_vector<T, Column, A> const& operand, dense_operand<T> const& dst) {
+  scratch_handle<T> none;
+  return same_elements(as_dense(operand, none), dst);
+}
+
+// an operand of gemv or gevm as strided memory. gemv writes y while it still
+// reads its operands, so one reading y's memory is evaluated aside first
+template<typename T, typename E>
+dense_operand<T> vector_operand(E const& expr, T const* first, T const* last,
+                                scratch_handle<T>& holder) {
+  if (shares_storage(expr, first, last)) {
+    holder = scratch_pool<T>::local().evaluate(expr);
+    return as_dense<T>(*holder, holder);
+  }
+  return as_dense<T>(expr, holder);
+}
+
+} // namespace detail
+
+// y = alpha * a * x + beta * y, in a single pass over a. y is not read when
+// beta is zero. operands that are expressions are materialized first, like
+// those of any product.
+template<typename T, typename E1, typename E2, typename A>
+col_vector<T, A>& gemv(T alpha, matrix_expr<E1> const& a, matrix_expr<E2> const& x,
+                       T beta, col_vector<T, A>& y) {
+  static_assert(detail::extents_agree(E2::static_cols, 1), "x is not a column vector");
+  static_assert(detail::extents_agree(E1::static_cols, E2::static_rows),
+                "inner dimensions of a product differ");
+  assert(a.num_cols() == x.num_rows() && x.num_cols() == 1 && a.num_rows() == y.size());
+  T const* const first = y.data();
+  T const* const last = first + y.size();
+  detail::scratch_handle<T> a_holder, x_holder;
+  detail::dense_operand<T> const m =
+    detail::vector_operand<T>(static_cast<E1 const&>(a), first, last, a_holder);
+  detail::dense_operand<T> const v =
+    detail::vector_operand<T>(static_cast<E2 const&>(x), first, last, x_holder);
+  gemv(m.rows, m.cols, alpha, m.data, m.row_stride, m.col_stride,
+       v.data, v.row_stride, beta, y.data(), 1);
+  return y;
+}
+
+// y = alpha * x * a + beta * y for row vectors x and y, the same pass over a
+// with its strides swapped
+template<typename T, typename E1, typename E2, typename A>
+row_vector<T, A>& gevm(T alpha, matrix_expr<E1> const& x, matrix_expr<E2> const& a,
+                       T beta, row_vector<T, A>& y) {
+  static_assert(detail::extents_agree(E1::static_rows, 1), "x is not a row vector");
+  static_assert(detail::extents_agree(E1::static_cols, E2::static_rows),
+                "inner dimensions of a product differ");
+  assert(x.num_rows() == 1 && x.num_cols() == a.num_rows() && a.num_cols() == y.size());
+  T const* const first = y.data();
+  T const* const last = first + y.size();
+  detail::scratch_handle<T> a_holder, x_holder;
+  detail::dense_operand<T> const m =
+    detail::vector_operand<T>(static_cast<E2 const&>(a), first, last, a_holder);
+  detail::dense_operand<T> const v =
+    detail::vector_operand<T>(static_cast<E1 const&>(x), first, last, x_holder);
+  gemv(m.cols, m.rows, alpha, m.data, m.col_stride, m.row_stride,
+       v.data, v.col_stride, beta, y.data(), 1);
+  return y;
+}
+
+#endif